@@ -0,0 +1,454 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef BANDED_H
+#define BANDED_H
+#include <vector>
+#include "myexceptions.h"
+#include "matrix.h"
+#include "complex.h"
+#include "kernels.h"
+#include "threadpool.h"
+#include "operator.h"
+using std::vector;
+/* TridiagonalMatrix {{{ */
+/*!\brief This class implements a tridiagonal square matrix.
+ *
+ * Only the three diagonals are stored, which makes the product and the
+ * solution of a linear system O(n) in time and memory.
+ */
+template <class T> class TridiagonalMatrix : public LinearOperator<T> {
+    public:
+        /* Default constructor {{{ */
+        /*!\brief Default constructor, the elements are set to zero. */
+        TridiagonalMatrix(int n=0) : _l(n,(T)0), _d(n,(T)0), _u(n,(T)0) {
+            _n=n;
+        };
+        /*!\brief Copies the three diagonals of a square matrix. */
+        explicit TridiagonalMatrix(const Matrix<T> &a)
+            : _l(a.n(),(T)0), _d(a.n(),(T)0), _u(a.n(),(T)0) {
+            if(!a.isSquare())
+                throw notSquare;
+            _n=a.n();
+            for(int i=0;i<_n;i++) {
+                _d[i]=a.template get<Unchecked>(i,i);
+                if(i>0)
+                    _l[i]=a.template get<Unchecked>(i,i-1);
+                if(i<_n-1)
+                    _u[i]=a.template get<Unchecked>(i,i+1);
+            }
+        };
+        /* }}} */
+        /* Access member method {{{ */
+        /*!\brief Returns the dimension of the matrix. */
+        int size(void) const { return _n; };
+        /*!\brief Returns the element a(i,i-1), i>0. */
+        T &lower(int i) {
+            if(i<1 || i>=_n)
+                throw outOfBounds;
+            return _l[i];
+        };
+        /*!\brief Returns the element a(i,i). */
+        T &diag(int i) {
+            if(i<0 || i>=_n)
+                throw outOfBounds;
+            return _d[i];
+        };
+        /*!\brief Returns the element a(i,i+1), i<n-1. */
+        T &upper(int i) {
+            if(i<0 || i>=_n-1)
+                throw outOfBounds;
+            return _u[i];
+        };
+        /*!\brief Access member method, zero outside of the diagonals. */
+        T at(int i, int j) const {
+            if(i<0 || i>=_n || j<0 || j>=_n)
+                throw outOfBounds;
+            if(j==i-1)
+                return _l[i];
+            if(j==i)
+                return _d[i];
+            if(j==i+1)
+                return _u[i];
+            return (T)0;
+        };
+        /*!\brief Returns the equivalent dense matrix. */
+        Matrix<T> matrix(void) const {
+            Matrix<T> res(_n,_n);
+            for(int i=0;i<_n;i++) {
+                res.template get<Unchecked>(i,i)=_d[i];
+                if(i>0)
+                    res.template get<Unchecked>(i,i-1)=_l[i];
+                if(i<_n-1)
+                    res.template get<Unchecked>(i,i+1)=_u[i];
+            }
+            return res;
+        };
+        /* }}} */
+        /* Algebraic operators {{{ */
+        /*!\brief Computes y=A*x. */
+        void apply(const T *x, T *y) const {
+            const T *l=&_l[0];
+            const T *d=&_d[0];
+            const T *u=&_u[0];
+            const int n=_n;
+            parallelFor(n,KERNEL_GRAIN,[&](long long i0, long long i1) {
+                for(long long i=i0;i<i1;i++) {
+                    T s=d[i]*x[i];
+                    if(i>0)
+                        s+=l[i]*x[i-1];
+                    if(i<n-1)
+                        s+=u[i]*x[i+1];
+                    y[i]=s;
+                }
+            });
+        };
+        /*!\brief Matrix-vector product. */
+        Ket<T> operator*(const Ket<T> &x) const {
+            return LinearOperator<T>::operator*(x);
+        };
+        /* }}} */
+        /* Solve {{{ */
+        /*!\brief Solves A*x=b in place with the Thomas algorithm.
+         *
+         * The algorithm does not pivot: it is stable for diagonally dominant
+         * or symmetric positive definite matrices, and throws singular if a
+         * pivot vanishes.
+         */
+        void solve(T *b) const {
+            if(_n==0)
+                return;
+            vector<T> c(_n);
+            if(_d[0]==(T)0)
+                throw singular;
+            T inv=((T)1)/_d[0];
+            c[0]=_u[0]*inv;
+            b[0]*=inv;
+            for(int i=1;i<_n;i++) {
+                T p=_d[i]-_l[i]*c[i-1];
+                if(p==(T)0)
+                    throw singular;
+                inv=((T)1)/p;
+                c[i]=(i<_n-1?_u[i]*inv:(T)0);
+                b[i]=(b[i]-_l[i]*b[i-1])*inv;
+            }
+            for(int i=_n-2;i>=0;i--)
+                b[i]-=c[i]*b[i+1];
+        };
+        /*!\brief Returns the solution of A*x=b. */
+        Ket<T> solve(const Ket<T> &b) const {
+            if(b.size()!=_n)
+                throw incompatibleSizes;
+            Ket<T> x(b);
+            solve(x.data());
+            return x;
+        };
+        /* }}} */
+    private:
+        int _n;         //!<\brief Dimension of the matrix.
+        vector<T> _l;   //!<\brief Lower diagonal, _l[0] is unused.
+        vector<T> _d;   //!<\brief Diagonal.
+        vector<T> _u;   //!<\brief Upper diagonal, _u[n-1] is unused.
+};
+/* }}} */
+/* BandedMatrix {{{ */
+/*!\brief This class implements a banded square matrix.
+ *
+ * The elements a(i,j) with -kl<=j-i<=ku are stored row by row, each row
+ * holding kl+ku+1 elements, so that the product costs O(n*(kl+ku)).
+ */
+template <class T> class BandedMatrix : public LinearOperator<T> {
+    public:
+        /* Default constructor {{{ */
+        /*!\brief Default constructor, the elements are set to zero.
+         *
+         * \param n Dimension of the matrix.
+         * \param kl Number of sub-diagonals.
+         * \param ku Number of super-diagonals.
+         */
+        BandedMatrix(int n=0, int kl=0, int ku=0) {
+            init(n,kl,ku);
+        };
+        /*!\brief Copies the elements of a square matrix within the band. */
+        BandedMatrix(const Matrix<T> &a, int kl, int ku) {
+            if(!a.isSquare())
+                throw notSquare;
+            init(a.n(),kl,ku);
+            for(int i=0;i<_n;i++)
+                for(int j=first(i);j<=last(i);j++)
+                    _data[index(i,j)]=a.template get<Unchecked>(i,j);
+        };
+        /* }}} */
+        /* Access member method {{{ */
+        /*!\brief Returns the dimension of the matrix. */
+        int size(void) const { return _n; };
+        /*!\brief Returns the number of sub-diagonals. */
+        int kl(void) const { return _kl; };
+        /*!\brief Returns the number of super-diagonals. */
+        int ku(void) const { return _ku; };
+        /*!\brief Access member method, (i,j) must lie within the band. */
+        T &at(int i, int j) {
+            if(i<0 || i>=_n || j<first(i) || j>last(i))
+                throw outOfBounds;
+            return _data[index(i,j)];
+        };
+        /*!\brief Access member method, zero outside of the band. */
+        T at(int i, int j) const {
+            if(i<0 || i>=_n || j<0 || j>=_n)
+                throw outOfBounds;
+            if(j<first(i) || j>last(i))
+                return (T)0;
+            return _data[index(i,j)];
+        };
+        /*!\brief Returns the equivalent dense matrix. */
+        Matrix<T> matrix(void) const {
+            Matrix<T> res(_n,_n);
+            for(int i=0;i<_n;i++)
+                for(int j=first(i);j<=last(i);j++)
+                    res.template get<Unchecked>(i,j)=_data[index(i,j)];
+            return res;
+        };
+        /* }}} */
+        /* Algebraic operators {{{ */
+        /*!\brief Computes y=A*x. */
+        void apply(const T *x, T *y) const {
+            parallelFor(_n,kernelRows(_w),[&](long long i0, long long i1) {
+                for(long long i=i0;i<i1;i++) {
+                    const int j0=first(i);
+                    y[i]=kernelDot(last(i)-j0+1,&_data[index(i,j0)],x+j0);
+                }
+            });
+        };
+        /*!\brief Matrix-vector product. */
+        Ket<T> operator*(const Ket<T> &x) const {
+            return LinearOperator<T>::operator*(x);
+        };
+        /*!\brief Returns the solution of A*x=b, see BandedLU. */
+        Ket<T> solve(const Ket<T> &b) const;
+        /* }}} */
+    private:
+        /*!\brief Sets the dimensions and allocates the elements. */
+        void init(int n, int kl, int ku) {
+            if(n<0 || kl<0 || ku<0)
+                throw outOfBounds;
+            _n=n;
+            _kl=(kl<n?kl:(n>0?n-1:0));
+            _ku=(ku<n?ku:(n>0?n-1:0));
+            _w=_kl+_ku+1;
+            _data.assign((long)_n*_w,(T)0);
+        };
+        /*!\brief Returns the first column stored in row i. */
+        int first(int i) const { return (i>_kl?i-_kl:0); };
+        /*!\brief Returns the last column stored in row i. */
+        int last(int i) const { return (i+_ku<_n?i+_ku:_n-1); };
+        /*!\brief Returns the position of a(i,j) in the array. */
+        long index(int i, int j) const { return (long)i*_w+j-i+_kl; };
+        int _n;             //!<\brief Dimension of the matrix.
+        int _kl;            //!<\brief Number of sub-diagonals.
+        int _ku;            //!<\brief Number of super-diagonals.
+        int _w;             //!<\brief Number of elements per row.
+        vector<T> _data;    //!<\brief Elements, stored row by row.
+};
+/* }}} */
+/* BandedLU {{{ */
+/*!\brief LU factorization with partial pivoting of a banded matrix.
+ *
+ * Pivoting within the kl rows below the diagonal widens the upper band of
+ * U to kl+ku, so each row of the factors holds 2*kl+ku+1 elements; the
+ * factorization costs O(n*kl*(kl+ku)) and each solve O(n*(kl+ku)).
+ * As in LAPACK, the row exchanges are interleaved with the elimination
+ * steps and L is not permuted afterwards.
+ */
+template <class T> class BandedLU {
+    public:
+        /*!\brief Factorizes a, throws singular if a is not invertible. */
+        BandedLU(const BandedMatrix<T> &a) {
+            _n=a.size();
+            _kl=a.kl();
+            _ku=a.ku()+a.kl();
+            _w=_kl+_ku+1;
+            _lu.assign((long)_n*_w,(T)0);
+            _piv.resize(_n);
+            for(int i=0;i<_n;i++)
+                for(int j=(i>_kl?i-_kl:0);j<=i+a.ku() && j<_n;j++)
+                    _lu[index(i,j)]=a.at(i,j);
+            for(int k=0;k<_n;k++) {
+                const int imax=(k+_kl<_n?k+_kl:_n-1);
+                const int jmax=(k+_ku<_n?k+_ku:_n-1);
+                int p=k;
+                for(int i=k+1;i<=imax;i++)
+                    if(magnitude(_lu[index(i,k)])>magnitude(_lu[index(p,k)]))
+                        p=i;
+                _piv[k]=p;
+                if(_lu[index(p,k)]==(T)0)
+                    throw singular;
+                if(p!=k)
+                    for(int j=k;j<=jmax;j++) {
+                        T tmp=_lu[index(k,j)];
+                        _lu[index(k,j)]=_lu[index(p,j)];
+                        _lu[index(p,j)]=tmp;
+                    }
+                T inv=((T)1)/_lu[index(k,k)];
+                for(int i=k+1;i<=imax;i++) {
+                    T l=_lu[index(i,k)]*inv;
+                    _lu[index(i,k)]=l;
+                    kernelAxpy(jmax-k,((T)0)-l,&_lu[index(k,k+1)],
+                            &_lu[index(i,k+1)]);
+                }
+            }
+        };
+        /*!\brief Returns the size of the system. */
+        int n(void) const { return _n; };
+        /*!\brief Returns the determinant. */
+        T det(void) const {
+            T res=(T)1;
+            for(int k=0;k<_n;k++) {
+                res*=_lu[index(k,k)];
+                if(_piv[k]!=k)
+                    res=((T)0)-res;
+            }
+            return res;
+        };
+        /*!\brief Solves A*x=b in place. */
+        void solve(T *b) const {
+            for(int k=0;k<_n;k++) {
+                if(_piv[k]!=k) {
+                    T tmp=b[k];
+                    b[k]=b[_piv[k]];
+                    b[_piv[k]]=tmp;
+                }
+                const int imax=(k+_kl<_n?k+_kl:_n-1);
+                for(int i=k+1;i<=imax;i++)
+                    b[i]-=_lu[index(i,k)]*b[k];
+            }
+            for(int i=_n-1;i>=0;i--) {
+                const int jmax=(i+_ku<_n?i+_ku:_n-1);
+                T s=b[i]-kernelDot(jmax-i,&_lu[index(i,i+1)],b+i+1);
+                b[i]=s/_lu[index(i,i)];
+            }
+        };
+        /*!\brief Returns the solution of A*x=b. */
+        Ket<T> solve(const Ket<T> &b) const {
+            if(b.size()!=_n)
+                throw incompatibleSizes;
+            Ket<T> x(b);
+            solve(x.data());
+            return x;
+        };
+    private:
+        /*!\brief Returns the position of a(i,j) in the array. */
+        long index(int i, int j) const { return (long)i*_w+j-i+_kl; };
+        int _n;             //!<\brief Size of the system.
+        int _kl;            //!<\brief Number of sub-diagonals of L.
+        int _ku;            //!<\brief Number of super-diagonals of U.
+        int _w;             //!<\brief Number of elements per row.
+        vector<T> _lu;      //!<\brief L and U factors, row by row.
+        vector<int> _piv;   //!<\brief Row exchanged with row k at step k.
+};
+/*!\brief Returns the solution of A*x=b. */
+template <class T> Ket<T> BandedMatrix<T>::solve(const Ket<T> &b) const {
+    return BandedLU<T>(*this).solve(b);
+};
+/* }}} */
+/* SymmetricMatrix {{{ */
+/*!\brief This class implements a symmetric or hermitian packed matrix.
+ *
+ * Only the upper triangle is stored, row by row, which halves the memory
+ * footprint. If the matrix is hermitian, a(j,i) is the conjugate of
+ * a(i,j); for real types both flavours coincide.
+ */
+template <class T> class SymmetricMatrix : public LinearOperator<T> {
+    public:
+        /* Default constructor {{{ */
+        /*!\brief Default constructor, the elements are set to zero. */
+        SymmetricMatrix(int n=0, bool hermitian=false)
+            : _data((long)n*(n+1)/2,(T)0) {
+            _n=n;
+            _hermitian=hermitian;
+        };
+        /*!\brief Copies the upper triangle of a square matrix.
+         *
+         * The lower triangle of a is ignored, use Matrix::isSymmetric() to
+         * check that no information is lost.
+         */
+        explicit SymmetricMatrix(const Matrix<T> &a, bool hermitian=false)
+            : _data((long)a.n()*(a.n()+1)/2) {
+            if(!a.isSquare())
+                throw notSquare;
+            _n=a.n();
+            _hermitian=hermitian;
+            for(int i=0;i<_n;i++)
+                for(int j=i;j<_n;j++)
+                    _data[index(i,j)]=a.template get<Unchecked>(i,j);
+        };
+        /* }}} */
+        /* Access member method {{{ */
+        /*!\brief Returns the dimension of the matrix. */
+        int size(void) const { return _n; };
+        /*!\brief Returns true if the matrix is hermitian. */
+        bool isHermitian(void) const { return _hermitian; };
+        /*!\brief Access member method. */
+        T at(int i, int j) const {
+            if(i<0 || i>=_n || j<0 || j>=_n)
+                throw outOfBounds;
+            if(i<=j)
+                return _data[index(i,j)];
+            return (_hermitian?conjugate(_data[index(j,i)])
+                    :_data[index(j,i)]);
+        };
+        /*!\brief Sets a(i,j), and a(j,i) accordingly. */
+        void set(int i, int j, const T &x) {
+            if(i<0 || i>=_n || j<0 || j>=_n)
+                throw outOfBounds;
+            if(i<=j)
+                _data[index(i,j)]=x;
+            else
+                _data[index(j,i)]=(_hermitian?conjugate(x):x);
+        };
+        /*!\brief Returns a pointer to the upper triangle, row by row. */
+        const T *data(void) const { return &_data[0]; };
+        /*!\brief Returns the equivalent dense matrix. */
+        Matrix<T> matrix(void) const {
+            Matrix<T> res(_n,_n);
+            for(int i=0;i<_n;i++)
+                for(int j=0;j<_n;j++)
+                    res.template get<Unchecked>(i,j)=at(i,j);
+            return res;
+        };
+        /* }}} */
+        /* Algebraic operators {{{ */
+        /*!\brief Computes y=A*x.
+         *
+         * Each packed row i contributes a scalar product to y(i) and an
+         * update of y(i+1..n-1), so the triangle is read once.
+         */
+        void apply(const T *x, T *y) const {
+            for(int i=0;i<_n;i++)
+                y[i]=0;
+            for(int i=0;i<_n;i++) {
+                const T *r=&_data[index(i,i)];
+                const int m=_n-i;
+                y[i]+=kernelDot(m,r,x+i);
+                if(_hermitian) {
+                    const T xi=x[i];
+                    for(int j=1;j<m;j++)
+                        y[i+j]+=conjugate(r[j])*xi;
+                } else
+                    kernelAxpy(m-1,x[i],r+1,y+i+1);
+            }
+        };
+        /*!\brief Matrix-vector product. */
+        Ket<T> operator*(const Ket<T> &x) const {
+            return LinearOperator<T>::operator*(x);
+        };
+        /* }}} */
+    private:
+        /*!\brief Returns the position of a(i,j), i<=j, in the array. */
+        long index(int i, int j) const {
+            return (long)i*_n-(long)i*(i-1)/2+j-i;
+        };
+        int _n;             //!<\brief Dimension of the matrix.
+        bool _hermitian;    //!<\brief True if a(j,i)=conj(a(i,j)).
+        vector<T> _data;    //!<\brief Upper triangle, stored row by row.
+};
+/* }}} */
+#endif //BANDED_H
+/* banded.h */
@@ -0,0 +1,381 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef BATCH_H
+#define BATCH_H
+#include <iostream>
+#include "myexceptions.h"
+#include "matrix.h"
+#include "complex.h"
+#include "threadpool.h"
+using std::ostream;
+/*!\brief Number of batch elements processed by a thread at a time. */
+#define BATCH_GRAIN 1024
+/* MatrixBatch {{{ */
+/*!\brief This class implements a batch of independent matrices of equal
+ * shape.
+ *
+ * The storage is "structure of arrays": element (i,j) of all the matrices
+ * is contiguous, so that the kernels below vectorize across the batch.
+ * A batch of kets is a batch of n x 1 matrices.
+ */
+template <class T> class MatrixBatch {
+    public:
+        /* Constructors {{{ */
+        /*!\brief Default constructor, count n x m zero matrices. */
+        MatrixBatch(int count=0, int n=0, int m=0) {
+            _count=count;
+            _n=n;
+            _m=m;
+            _data=0;
+            if(size()!=0) {
+                _data=new T[size()];
+                for(long long i=0;i<size();i++)
+                    _data[i]=0;
+            }
+        };
+        /*!\brief Copy constructor. */
+        MatrixBatch(const MatrixBatch<T> &other) {
+            _count=other._count;
+            _n=other._n;
+            _m=other._m;
+            _data=0;
+            if(size()!=0) {
+                _data=new T[size()];
+                for(long long i=0;i<size();i++)
+                    _data[i]=other._data[i];
+            }
+        };
+        /*!\brief Destructor. */
+        ~MatrixBatch(void) {
+            if(_data!=0)
+                delete[] _data;
+        };
+        /*!\brief Assignment operator. */
+        MatrixBatch<T> &operator=(const MatrixBatch<T> &other) {
+            if(this==&other)
+                return *this;
+            if(size()!=other.size()) {
+                if(_data!=0)
+                    delete[] _data;
+                _data=(other.size()!=0?new T[other.size()]:0);
+            }
+            _count=other._count;
+            _n=other._n;
+            _m=other._m;
+            for(long long i=0;i<size();i++)
+                _data[i]=other._data[i];
+            return *this;
+        };
+        /* }}} */
+        /* Access member methods {{{ */
+        /*!\brief Returns the number of matrices. */
+        int count(void) const { return _count; };
+        /*!\brief Returns the number of rows. */
+        int n(void) const { return _n; };
+        /*!\brief Returns the number of columns. */
+        int m(void) const { return _m; };
+        /*!\brief Returns the total number of elements. */
+        long long size(void) const { return (long long)_count*_n*_m; };
+        /*!\brief Returns element (i,j) of all the matrices. */
+        T *element(int i, int j) { return _data+(long long)(i*_m+j)*_count; };
+        /*!\brief Returns element (i,j) of all the matrices. */
+        const T *element(int i, int j) const {
+            return _data+(long long)(i*_m+j)*_count;
+        };
+        /*!\brief Returns a pointer to the elements. */
+        T *data(void) { return _data; };
+        /*!\brief Returns a pointer to the elements. */
+        const T *data(void) const { return _data; };
+        /*!\brief Returns an iterator to the first element. */
+        T *begin(void) { return _data; };
+        /*!\brief Returns an iterator past the last element. */
+        T *end(void) { return _data+size(); };
+        /*!\brief Returns an iterator to the first element. */
+        const T *begin(void) const { return _data; };
+        /*!\brief Returns an iterator past the last element. */
+        const T *end(void) const { return _data+size(); };
+        /*!\brief Access member method. */
+        T &at(int b, int i, int j) { return get<Checked>(b,i,j); };
+        /*!\brief Access member method. */
+        T at(int b, int i, int j) const { return get<Checked>(b,i,j); };
+        /*!\brief Access member method, with checking policy P. */
+        template <class P> T &get(int b, int i, int j) {
+            P::check(b>=0 && b<_count && i>=0 && i<_n && j>=0 && j<_m);
+            return element(i,j)[b];
+        };
+        /*!\brief Access member method, with checking policy P. */
+        template <class P> T get(int b, int i, int j) const {
+            P::check(b>=0 && b<_count && i>=0 && i<_n && j>=0 && j<_m);
+            return element(i,j)[b];
+        };
+        /*!\brief Returns a copy of matrix b. */
+        Matrix<T> matrix(int b) const {
+            if(b<0 || b>=_count)
+                throw outOfBounds;
+            Matrix<T> tmp(_n,_m);
+            T *d=tmp.data();
+            for(int i=0;i<_n;i++)
+                for(int j=0;j<_m;j++)
+                    d[i*_m+j]=element(i,j)[b];
+            return tmp;
+        };
+        /*!\brief Sets matrix b. */
+        void set(int b, const Matrix<T> &a) {
+            if(a.n()!=_n || a.m()!=_m)
+                throw incompatibleSizes;
+            if(b<0 || b>=_count)
+                throw outOfBounds;
+            const T *d=a.data();
+            for(int i=0;i<_n;i++)
+                for(int j=0;j<_m;j++)
+                    element(i,j)[b]=d[i*_m+j];
+        };
+        /* }}} */
+        /* Print {{{ */
+        /*!\brief Friend standard output operator. */
+        friend ostream &operator<<(ostream &os, const MatrixBatch<T> &other) {
+            for(int b=0;b<other._count;b++)
+                os << other.matrix(b) << endl;
+            return os;
+        };
+        /* }}} */
+        /* Algebraic operators {{{ */
+        /*!\brief Batched product, matrix b of the result is the product of
+         * the matrices b. */
+        MatrixBatch<T> operator*(const MatrixBatch<T> &other) const {
+            MatrixBatch<T> tmp(_count,_n,other._m);
+            multiply(*this,other,tmp);
+            return tmp;
+        };
+        /*!\brief Returns the batch of inverses, throws singular if one of
+         * the matrices is not invertible. */
+        MatrixBatch<T> inverse(void) const {
+            MatrixBatch<T> tmp(_count,_n,_n);
+            batchInverse(*this,tmp);
+            return tmp;
+        };
+        /*!\brief Returns the batch of determinants, as 1 x 1 matrices. */
+        MatrixBatch<T> det(void) const {
+            MatrixBatch<T> tmp(_count,1,1);
+            batchDet(*this,tmp.element(0,0));
+            return tmp;
+        };
+        /* }}} */
+    private:
+        T *_data;       //!<\brief Elements, _data[(i*_m+j)*_count+b].
+        int _count;     //!<\brief Number of matrices.
+        int _n;         //!<\brief Number of rows.
+        int _m;         //!<\brief Number of columns.
+};
+/* }}} */
+/* Batched kernels {{{ */
+/*!\brief Batched product c=a*b, b may be a batch of kets. */
+template <class T> void multiply(const MatrixBatch<T> &a,
+        const MatrixBatch<T> &b, MatrixBatch<T> &c) {
+    if(a.count()!=b.count() || a.m()!=b.n() || c.count()!=a.count()
+            || c.n()!=a.n() || c.m()!=b.m())
+        throw incompatibleSizes;
+    if(&c==&a || &c==&b)
+        throw incompatibleSizes;
+    const int n=a.n(),m=a.m(),p=b.m();
+    parallelFor(a.count(),BATCH_GRAIN,[&](long long b0, long long b1) {
+        for(int i=0;i<n;i++) {
+            for(int j=0;j<p;j++) {
+                T *__restrict__ r=c.element(i,j);
+                for(long long x=b0;x<b1;x++)
+                    r[x]=0;
+                for(int k=0;k<m;k++) {
+                    const T *__restrict__ u=a.element(i,k);
+                    const T *__restrict__ v=b.element(k,j);
+                    for(long long x=b0;x<b1;x++)
+                        r[x]+=u[x]*v[x];
+                }
+            }
+        }
+    });
+};
+/*!\brief Determinant of a single matrix, copied in the scratch array lu. */
+template <class T> T batchDet(T *lu, int n) {
+    T res=1;
+    for(int k=0;k<n;k++) {
+        int p=k;
+        for(int i=k+1;i<n;i++)
+            if(magnitude(lu[i*n+k])>magnitude(lu[p*n+k]))
+                p=i;
+        if(lu[p*n+k]==(T)0)
+            return 0;
+        if(p!=k) {
+            for(int j=0;j<n;j++) {
+                T tmp=lu[k*n+j];
+                lu[k*n+j]=lu[p*n+j];
+                lu[p*n+j]=tmp;
+            }
+            res=((T)0)-res;
+        }
+        res*=lu[k*n+k];
+        T inv=((T)1)/lu[k*n+k];
+        for(int i=k+1;i<n;i++) {
+            T f=lu[i*n+k]*inv;
+            for(int j=k+1;j<n;j++)
+                lu[i*n+j]-=f*lu[k*n+j];
+        }
+    }
+    return res;
+};
+/*!\brief Batched determinant, d must hold a.count() elements.
+ *
+ * Closed forms are used up to 3 x 3 and vectorize across the batch, larger
+ * matrices are factorized one at a time.
+ */
+template <class T> void batchDet(const MatrixBatch<T> &a, T *d) {
+    if(a.n()!=a.m())
+        throw incompatibleSizes;
+    const int n=a.n();
+    parallelFor(a.count(),BATCH_GRAIN,[&](long long b0, long long b1) {
+        if(n==1) {
+            const T *__restrict__ a00=a.element(0,0);
+            for(long long x=b0;x<b1;x++)
+                d[x]=a00[x];
+        } else if(n==2) {
+            const T *__restrict__ a00=a.element(0,0);
+            const T *__restrict__ a01=a.element(0,1);
+            const T *__restrict__ a10=a.element(1,0);
+            const T *__restrict__ a11=a.element(1,1);
+            for(long long x=b0;x<b1;x++)
+                d[x]=a00[x]*a11[x]-a01[x]*a10[x];
+        } else if(n==3) {
+            const T *e[9];
+            for(int i=0;i<9;i++)
+                e[i]=a.element(i/3,i%3);
+            for(long long x=b0;x<b1;x++)
+                d[x]=e[0][x]*(e[4][x]*e[8][x]-e[5][x]*e[7][x])
+                    -e[1][x]*(e[3][x]*e[8][x]-e[5][x]*e[6][x])
+                    +e[2][x]*(e[3][x]*e[7][x]-e[4][x]*e[6][x]);
+        } else {
+            T *lu=new T[n*n];
+            for(long long x=b0;x<b1;x++) {
+                for(int i=0;i<n;i++)
+                    for(int j=0;j<n;j++)
+                        lu[i*n+j]=a.element(i,j)[x];
+                d[x]=batchDet(lu,n);
+            }
+            delete[] lu;
+        }
+    });
+};
+/*!\brief Batched inverse, throws singular if one of the matrices is not
+ * invertible.
+ *
+ * Closed forms are used up to 3 x 3 and vectorize across the batch, larger
+ * matrices are inverted one at a time by Gauss-Jordan elimination.
+ */
+template <class T> void batchInverse(const MatrixBatch<T> &a,
+        MatrixBatch<T> &c) {
+    if(a.n()!=a.m() || c.count()!=a.count() || c.n()!=a.n()
+            || c.m()!=a.m() || &c==&a)
+        throw incompatibleSizes;
+    const int n=a.n();
+    parallelFor(a.count(),BATCH_GRAIN,[&](long long b0, long long b1) {
+        int bad=0;
+        if(n==1) {
+            const T *__restrict__ a00=a.element(0,0);
+            T *__restrict__ c00=c.element(0,0);
+            for(long long x=b0;x<b1;x++) {
+                bad|=(a00[x]==(T)0);
+                c00[x]=((T)1)/a00[x];
+            }
+        } else if(n==2) {
+            const T *__restrict__ a00=a.element(0,0);
+            const T *__restrict__ a01=a.element(0,1);
+            const T *__restrict__ a10=a.element(1,0);
+            const T *__restrict__ a11=a.element(1,1);
+            T *__restrict__ c00=c.element(0,0);
+            T *__restrict__ c01=c.element(0,1);
+            T *__restrict__ c10=c.element(1,0);
+            T *__restrict__ c11=c.element(1,1);
+            for(long long x=b0;x<b1;x++) {
+                T det=a00[x]*a11[x]-a01[x]*a10[x];
+                bad|=(det==(T)0);
+                T inv=((T)1)/det;
+                c00[x]=a11[x]*inv;
+                c01[x]=((T)0)-a01[x]*inv;
+                c10[x]=((T)0)-a10[x]*inv;
+                c11[x]=a00[x]*inv;
+            }
+        } else if(n==3) {
+            const T *e[9];
+            T *r[9];
+            for(int i=0;i<9;i++) {
+                e[i]=a.element(i/3,i%3);
+                r[i]=c.element(i/3,i%3);
+            }
+            for(long long x=b0;x<b1;x++) {
+                T c0=e[4][x]*e[8][x]-e[5][x]*e[7][x];
+                T c1=e[5][x]*e[6][x]-e[3][x]*e[8][x];
+                T c2=e[3][x]*e[7][x]-e[4][x]*e[6][x];
+                T det=e[0][x]*c0+e[1][x]*c1+e[2][x]*c2;
+                bad|=(det==(T)0);
+                T inv=((T)1)/det;
+                r[0][x]=c0*inv;
+                r[1][x]=(e[2][x]*e[7][x]-e[1][x]*e[8][x])*inv;
+                r[2][x]=(e[1][x]*e[5][x]-e[2][x]*e[4][x])*inv;
+                r[3][x]=c1*inv;
+                r[4][x]=(e[0][x]*e[8][x]-e[2][x]*e[6][x])*inv;
+                r[5][x]=(e[2][x]*e[3][x]-e[0][x]*e[5][x])*inv;
+                r[6][x]=c2*inv;
+                r[7][x]=(e[1][x]*e[6][x]-e[0][x]*e[7][x])*inv;
+                r[8][x]=(e[0][x]*e[4][x]-e[1][x]*e[3][x])*inv;
+            }
+        } else {
+            T *lu=new T[2*n*n];
+            T *res=lu+n*n;
+            for(long long x=b0;x<b1 && !bad;x++) {
+                for(int i=0;i<n;i++)
+                    for(int j=0;j<n;j++) {
+                        lu[i*n+j]=a.element(i,j)[x];
+                        res[i*n+j]=(i==j?1:0);
+                    }
+                for(int k=0;k<n && !bad;k++) {
+                    int p=k;
+                    for(int i=k+1;i<n;i++)
+                        if(magnitude(lu[i*n+k])>magnitude(lu[p*n+k]))
+                            p=i;
+                    if(lu[p*n+k]==(T)0) {
+                        bad=1;
+                        break;
+                    }
+                    for(int j=0;j<n && p!=k;j++) {
+                        T tmp=lu[k*n+j];
+                        lu[k*n+j]=lu[p*n+j];
+                        lu[p*n+j]=tmp;
+                        tmp=res[k*n+j];
+                        res[k*n+j]=res[p*n+j];
+                        res[p*n+j]=tmp;
+                    }
+                    T inv=((T)1)/lu[k*n+k];
+                    for(int j=0;j<n;j++) {
+                        lu[k*n+j]*=inv;
+                        res[k*n+j]*=inv;
+                    }
+                    for(int i=0;i<n;i++) {
+                        if(i==k)
+                            continue;
+                        T f=lu[i*n+k];
+                        for(int j=0;j<n;j++) {
+                            lu[i*n+j]-=f*lu[k*n+j];
+                            res[i*n+j]-=f*res[k*n+j];
+                        }
+                    }
+                }
+                for(int i=0;i<n;i++)
+                    for(int j=0;j<n;j++)
+                        c.element(i,j)[x]=res[i*n+j];
+            }
+            delete[] lu;
+        }
+        if(bad)
+            throw singular;
+    });
+};
+/* }}} */
+#endif //BATCH_H
+/* batch.h */
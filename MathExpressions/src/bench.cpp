@@ -0,0 +1,539 @@
+/* This file is a part of MathExpression. {{{
+ * Copyright (C) 2012 Romain Dubessy
+ *
+ * MathExpression is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MathExpression is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MathExpression.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * }}} */
+/* Benchmark suite.
+ *
+ * Usage: bench [--format=csv|json] [--filter=substring] [--max-size=n]
+ *              [--time=seconds] [--verbose]
+ * Each benchmark is repeated until it ran for the requested time, the
+ * results (time, heap allocations and allocated bytes per operation) are
+ * written on the standard output. With --verbose, progress is written on
+ * the standard error.
+ */
+#include <typeinfo>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+#include "expression.h"
+#include "program.h"
+#include "registry.h"
+#include "fixedmatrix.h"
+#include "batch.h"
+#include "banded.h"
+#include "kron.h"
+#include "tensor.h"
+#include "benchalloc.h"
+using namespace std;
+/* Result {{{ */
+/*!\brief Benchmark result. */
+struct Result {
+    string name;        //!<\brief Benchmark name.
+    int size;           //!<\brief Problem size.
+    long long iter;     //!<\brief Number of iterations.
+    double ns;          //!<\brief Time per iteration, in ns.
+    double allocs;      //!<\brief Allocations per iteration.
+    double bytes;       //!<\brief Allocated bytes per iteration.
+};
+static vector<Result> results;
+static string filter;
+static double minTime=0.2;
+static int maxSize=4096;
+static bool verbose=false;
+static volatile double sink;    //!<\brief Defeats dead code elimination.
+/*!\brief Returns a monotonic time, in seconds. */
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC,&t);
+    return t.tv_sec+1e-9*t.tv_nsec;
+}
+/*!\brief Runs f until it ran for minTime and records the result. */
+template <class F> void measure(const string &name, int size, F f) {
+    if(name.find(filter)==string::npos || size>maxSize)
+        return;
+    f();    //Warm up.
+    long long iter=0;
+    long long batch=1;
+    unsigned long long a0=nalloc;
+    unsigned long long b0=nbytes;
+    double t0=now();
+    double t=0;
+    while(t<minTime) {
+        for(long long i=0;i<batch;i++)
+            f();
+        iter+=batch;
+        batch*=2;
+        t=now()-t0;
+    }
+    Result r;
+    r.name=name;
+    r.size=size;
+    r.iter=iter;
+    r.ns=1e9*t/iter;
+    r.allocs=(double)(nalloc-a0)/iter;
+    r.bytes=(double)(nbytes-b0)/iter;
+    results.push_back(r);
+    if(verbose)
+        cerr << "[I] " << name << " " << size << " : " << r.ns << " ns"
+            << endl;
+}
+/* }}} */
+/* Expression trees {{{ */
+/*!\brief Deletes a tree built by parseString. */
+static void freeTree(Expression *exp) {
+    if(typeid(*exp)==typeid(BinaryOp)) {
+        freeTree(((BinaryOp*)exp)->left());
+        freeTree(((BinaryOp*)exp)->right());
+    } else if(typeid(*exp)==typeid(SingleValFunction))
+        freeTree(((SingleValFunction*)exp)->arg());
+    else if(typeid(*exp)==typeid(MultiValFunction)) {
+        MultiValFunction *f=(MultiValFunction*)exp;
+        for(int k=0;k<f->nargs();k++)
+            freeTree(f->arg(k));
+    }
+    delete exp;
+}
+/*!\brief Simplifies exp and deletes the result if it is a new constant.
+ *
+ * Constants and variables simplify to themselves or to their definition,
+ * which are kept.
+ */
+static void simplifyOnce(Expression *exp, VarDef &vars) {
+    Expression *res=exp->simplify(vars);
+    sink=(size_t)res;
+    if(res==exp || typeid(*res)==typeid(Variable))
+        return;
+    for(VarDef::iterator it=vars.begin();it!=vars.end();it++)
+        if(it->second==res)
+            return;
+    if(typeid(*res)==typeid(Constant) || typeid(*res)==typeid(BConstant)
+            || typeid(*res)==typeid(KConstant)
+            || typeid(*res)==typeid(MConstant))
+        freeTree(res);
+}
+/* }}} */
+/* Expression benchmarks {{{ */
+/*!\brief Returns a sum of n products of variables and constants. */
+static string hugeExpression(int n) {
+    ostringstream os;
+    for(int i=0;i<n;i++)
+        os << (i>0?"+":"") << "Sin[X*" << i << "]*Y";
+    return os.str();
+}
+static void benchParse(void) {
+    measure("parse/small",10,[]() {
+        freeTree(parseString("X+Exp[Y*Z]"));
+    });
+    for(int n=10;n<=1000;n*=10) {
+        string s=hugeExpression(n);
+        measure("parse/huge",n,[&]() {
+            freeTree(parseString(s));
+        });
+    }
+}
+static void benchNodes(void) {
+    VarDef vars;
+    vars["X"]=new Constant(0.5);
+    vars["Y"]=new Constant(1.5);
+    const char *nodes[][2]={
+        {"constant","1.5"},
+        {"variable","X"},
+        {"add","X+Y"},
+        {"sub","X-Y"},
+        {"mul","X*Y"},
+        {"div","X/Y"},
+        {"pow","X^Y"},
+        {"chain","X+Exp[Y*X]-Sqrt[X/Y]"},
+        {"mconstant","{{1,2},{3,4}}"},
+        {"bconstant","{1,2,3,4}"},
+        {"kconstant","{{1},{2},{3},{4}}"},
+        {"scale","X*{{1,2},{3,4}}"},
+        {"mproduct","{{1,2},{3,4}}*{{1,2},{3,4}}"},
+        {"mket","{{1,2},{3,4}}*{{1},{2}}"},
+        {"braket","{1,2}*{{1},{2}}"}
+    };
+    for(unsigned int i=0;i<sizeof(nodes)/sizeof(nodes[0]);i++) {
+        Expression *exp=parseString(nodes[i][1]);
+        measure(string("simplify/")+nodes[i][0],1,[&]() {
+            simplifyOnce(exp,vars);
+        });
+    }
+    for(int i=0;i<8;i++) {
+        //Scalar results only, evaluate() returns a new double.
+        Expression *exp=parseString(nodes[i][1]);
+        measure(string("evaluate/")+nodes[i][0],1,[&]() {
+            double *d=(double*)exp->evaluate(vars);
+            sink=*d;
+            delete d;
+        });
+    }
+    for(int i=0;i<Nfunc;i++) {
+        Expression *exp=parseString(funcNames[i]+"[X]");
+        measure("evaluate/"+funcNames[i],1,[&]() {
+            double *d=(double*)exp->evaluate(vars);
+            sink=*d;
+            delete d;
+        });
+    }
+}
+/*!\brief Evaluates a registered function of two arguments on n points,
+ * with and without its batch implementation. */
+static void benchFunctions(void) {
+    FunctionInfo f;
+    f.name="Gauss";
+    f.nargs=2;
+    f.scalar=[](const double *x) { return exp(-x[0]*x[0]/(x[1]*x[1])); };
+    f.flags=functionPure|functionThreadSafe;
+    functionRegistry().add(f);
+    f.name="GaussBatch";
+    f.batch=[](long long n, const double *const *x, double *out) {
+        for(long long i=0;i<n;i++)
+            out[i]=-x[0][i]*x[0][i]/(x[1][i]*x[1][i]);
+        funcApply(0,n,out,out);
+    };
+    functionRegistry().add(f);
+    const char *names[]={"Gauss","GaussBatch"};
+    for(int n=256;n<=4096;n*=4) {
+        vector<double> x(n),y(n,2.),out(n);
+        for(int i=0;i<n;i++)
+            x[i]=1e-3*i;
+        for(int k=0;k<2;k++) {
+            VarDef none;
+            Program p(parseString(string(names[k])+"[X,Y]+1"),none);
+            const double *in[2];
+            in[p.symbol("X")]=&x[0];
+            in[p.symbol("Y")]=&y[0];
+            measure(string("function/")+names[k],n,[&]() {
+                p.evaluate(n,in,&out[0]);
+                sink=out[0];
+            });
+        }
+    }
+}
+/* }}} */
+/* Matrix benchmarks {{{ */
+/*!\brief Fills a matrix with deterministic values. */
+static void fill(Matrix<double> &a) {
+    for(int i=0;i<a.n();i++)
+        for(int j=0;j<a.m();j++)
+            a.at(i,j)=1.0/(1+i+j);
+}
+/*!\brief Fills a vector with deterministic values. */
+static void fill(Vector<double> &a) {
+    for(int i=0;i<a.size();i++)
+        a[i]=1.0/(1+i);
+}
+static void benchMatrix(void) {
+    for(int n=8;n<=4096;n*=2) {
+        Matrix<double> a(n,n),b(n,n);
+        Ket<double> k(n);
+        Bra<double> br(n);
+        fill(a);
+        fill(b);
+        fill(k);
+        fill(br);
+        measure("matrix*matrix",n,[&]() {
+            Matrix<double> c=a*b;
+            sink=c.at(0,0);
+        });
+        measure("matrix*ket",n,[&]() {
+            Ket<double> c=a*k;
+            sink=c[0];
+        });
+        measure("bra*ket",n,[&]() {
+            sink=br*k;
+        });
+        measure("bra*matrix",n,[&]() {
+            Bra<double> c=br*a;
+            sink=c[0];
+        });
+        measure("bra*matrix*ket",n,[&]() {
+            sink=bilinear(br,a,k);
+        });
+        measure("ger",n,[&]() {
+            b.ger(1e-9,k,br);
+            sink=b.at(0,0);
+        });
+        measure("syrk",n,[&]() {
+            b.syrk(1.0,a);
+            sink=b.at(0,0);
+        });
+        measure("transpose",n,[&]() {
+            Matrix<double> c=a.transpose();
+            sink=c.at(0,0);
+        });
+        measure("transpose/inplace",n,[&]() {
+            b.transposeInPlace();
+            sink=b.at(0,0);
+        });
+    }
+    FixedMatrix<double,3,3> a,b;
+    FixedKet<double,3> k;
+    for(int i=0;i<3;i++) {
+        k[i]=1.0/(1+i);
+        for(int j=0;j<3;j++)
+            a(i,j)=b(i,j)=1.0/(1+i+j)+(i==j);
+    }
+    measure("fixed*fixed",3,[&]() {
+        FixedMatrix<double,3,3> c=a*b;
+        sink=c(0,0);
+    });
+    measure("fixed*ket",3,[&]() {
+        FixedKet<double,3> c=a*k;
+        sink=c[0];
+    });
+    measure("fixed/inverse",3,[&]() {
+        sink=a.inverse()(0,0);
+    });
+    for(int n=256;n<=4096;n*=4) {
+        MatrixBatch<double> u(n,2,2),v(n,2,2),w(n,2,2);
+        for(int i=0;i<2;i++)
+            for(int j=0;j<2;j++)
+                for(int b=0;b<n;b++)
+                    u.element(i,j)[b]=v.element(i,j)[b]=1.0/(1+i+j+b)+(i==j);
+        measure("batch2x2*batch2x2",n,[&]() {
+            multiply(u,v,w);
+            sink=w.element(0,0)[0];
+        });
+        measure("batch2x2/inverse",n,[&]() {
+            batchInverse(u,w);
+            sink=w.element(0,0)[0];
+        });
+    }
+    for(int n=256;n<=4096;n*=4) {
+        TridiagonalMatrix<double> t(n);
+        BandedMatrix<double> a(n,2,2);
+        Ket<double> k(n);
+        fill(k);
+        for(int i=0;i<n;i++) {
+            t.diag(i)=4;
+            if(i>0)
+                t.lower(i)=-1;
+            if(i<n-1)
+                t.upper(i)=-1;
+            for(int j=(i>2?i-2:0);j<=i+2 && j<n;j++)
+                a.at(i,j)=(i==j?6:-1);
+        }
+        measure("tridiagonal*ket",n,[&]() {
+            Ket<double> c=t*k;
+            sink=c[0];
+        });
+        measure("tridiagonal/solve",n,[&]() {
+            Ket<double> c=t.solve(k);
+            sink=c[0];
+        });
+        measure("banded*ket",n,[&]() {
+            Ket<double> c=a*k;
+            sink=c[0];
+        });
+        measure("banded/solve",n,[&]() {
+            Ket<double> c=a.solve(k);
+            sink=c[0];
+        });
+    }
+    for(int n=8;n<=4096;n*=2) {
+        Matrix<double> a(n,n);
+        Ket<double> k(n);
+        fill(a);
+        fill(k);
+        SymmetricMatrix<double> s(a);
+        measure("symmetric*ket",n,[&]() {
+            Ket<double> c=s*k;
+            sink=c[0];
+        });
+    }
+    for(int n=256;n<=4096;n*=4) {
+        Ket<double> k(n);
+        Bra<double> br(n);
+        fill(k);
+        fill(br);
+        measure("norm2",n,[&]() {
+            sink=norm2(k);
+        });
+        measure("norm2/kahan",n,[&]() {
+            sink=norm2<KahanSum>(k);
+        });
+        measure("norm2/pairwise",n,[&]() {
+            sink=norm2<PairwiseSum>(k);
+        });
+        measure("sum",n,[&]() {
+            sink=sum(k);
+        });
+        measure("maxAbs",n,[&]() {
+            sink=maxAbs(k);
+        });
+        measure("dotNorm",n,[&]() {
+            double norm;
+            sink=dotNorm(br,k,norm)+norm;
+        });
+    }
+    for(int n=4;n<=32;n*=2) {
+        Matrix<double> a(n,n);
+        fill(a);
+        KroneckerOperator<double> op;
+        for(int f=0;f<4;f++)
+            op.append(a);
+        Ket<double> k(op.size());
+        fill(k);
+        measure("kronecker*ket",op.size(),[&]() {
+            Ket<double> c=op*k;
+            sink=c[0];
+        });
+    }
+    for(int n=8;n<=64;n*=2) {
+        Tensor<double> a({n,n,n}),b({n,n,n});
+        for(long e=0;e<a.size();e++)
+            a.data()[e]=b.data()[e]=1.0/(1+e);
+        measure("tensor/permute",n,[&]() {
+            Tensor<double> c(a.permute({2,0,1}));
+            sink=c.data()[0];
+        });
+        measure("tensor/einsum",n,[&]() {
+            Tensor<double> c=einsum("abc,cbd->ad",a.view(),b.view());
+            sink=c.data()[0];
+        });
+    }
+    for(int n=64;n<=2048;n*=4) {
+        Matrix<double> a(n,n),b(n,n),c(n,n),d(n,n);
+        fill(a);
+        fill(b);
+        fill(c);
+        VarDef vars;
+        vars["A"]=new MConstant(a);
+        vars["B"]=new MConstant(b);
+        vars["C"]=new MConstant(c);
+        Expression *exp=parseString("2*A+3*B-C");
+        measure("axpby/simplify",n,[&]() {
+            simplifyOnce(exp,vars);
+        });
+        ShapeDef shapes;
+        Shape s={valueMatrix,n,n};
+        shapes["A"]=shapes["B"]=shapes["C"]=s;
+        VarDef none;
+        Program p(exp,none,shapes);
+        const double *x[3]={a.data(),b.data(),c.data()};
+        measure("axpby/program",n,[&]() {
+            p.evaluate(x,d.data());
+            sink=d.at(0,0);
+        });
+    }
+    for(int n=64;n<=512;n*=2) {
+        Matrix<double> a(n,n),b(n,n),c(n,n);
+        Ket<double> k(n);
+        fill(a);
+        fill(b);
+        fill(c);
+        fill(k);
+        VarDef vars;
+        vars["A"]=new MConstant(a);
+        vars["B"]=new MConstant(b);
+        vars["C"]=new MConstant(c);
+        vars["k"]=new KConstant(k);
+        Expression *exp=parseString("A*B*C*k");
+        measure("chain/parsed",n,[&]() {
+            simplifyOnce(exp,vars);
+        });
+        Expression *best=reorderProducts(exp,vars);
+        measure("chain/reordered",n,[&]() {
+            simplifyOnce(best,vars);
+        });
+    }
+    for(int n=64;n<=1024;n*=4) {
+        Matrix<double> a(n,n);
+        fill(a);
+        VarDef vars;
+        vars["A"]=new MConstant(a);
+        Expression *exp=parseString("Exp[A]");
+        measure("function/matrix",n,[&]() {
+            simplifyOnce(exp,vars);
+        });
+        //Element by element, as done before functions applied to arrays.
+        Expression *scalar=parseString("Exp[X]");
+        Constant x;
+        VarDef point;
+        point["X"]=&x;
+        measure("function/elements",n,[&]() {
+            Matrix<double> b(n,n);
+            for(int i=0;i<n;i++)
+                for(int j=0;j<n;j++) {
+                    double v=a.at(i,j);
+                    x.set(&v);
+                    double *d=(double*)scalar->evaluate(point);
+                    b.at(i,j)=*d;
+                    delete d;
+                }
+            sink=b.at(0,0);
+        });
+    }
+}
+/* }}} */
+/* Output {{{ */
+static void printCsv(void) {
+    cout << "name,size,iterations,ns,allocs,bytes" << endl;
+    for(unsigned int i=0;i<results.size();i++) {
+        const Result &r=results[i];
+        cout << r.name << "," << r.size << "," << r.iter << "," << r.ns
+            << "," << r.allocs << "," << r.bytes << endl;
+    }
+}
+static void printJson(void) {
+    cout << "[" << endl;
+    for(unsigned int i=0;i<results.size();i++) {
+        const Result &r=results[i];
+        cout << "  {\"name\": \"" << r.name << "\", \"size\": " << r.size
+            << ", \"iterations\": " << r.iter << ", \"ns\": " << r.ns
+            << ", \"allocs\": " << r.allocs << ", \"bytes\": " << r.bytes
+            << "}" << (i+1<results.size()?",":"") << endl;
+    }
+    cout << "]" << endl;
+}
+/* }}} */
+int main(int argc, char *argv[]) {
+    string format="csv";
+    for(int i=1;i<argc;i++) {
+        string s(argv[i]);
+        if(s.compare(0,9,"--format=")==0)
+            format=s.substr(9);
+        else if(s.compare(0,9,"--filter=")==0)
+            filter=s.substr(9);
+        else if(s.compare(0,11,"--max-size=")==0)
+            maxSize=atoi(s.substr(11).c_str());
+        else if(s.compare(0,7,"--time=")==0)
+            minTime=atof(s.substr(7).c_str());
+        else if(s=="--verbose")
+            verbose=true;
+        else {
+            cerr << "Usage: " << argv[0] << " [--format=csv|json]"
+                << " [--filter=substring] [--max-size=n] [--time=seconds]"
+                << " [--verbose]" << endl;
+            return -1;
+        }
+    }
+    benchParse();
+    benchNodes();
+    benchFunctions();
+    benchMatrix();
+    if(format=="json")
+        printJson();
+    else
+        printCsv();
+    return 0;
+}
+/* bench.cpp */
@@ -0,0 +1,49 @@
+/* This file is a part of MathExpression. {{{
+ * Copyright (C) 2012 Romain Dubessy
+ *
+ * MathExpression is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MathExpression is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MathExpression.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * }}} */
+#include <cstdlib>
+#include <new>
+#include "benchalloc.h"
+using namespace std;
+/* Allocation counting {{{ */
+atomic<unsigned long long> nalloc(0);
+atomic<unsigned long long> nbytes(0);
+void *operator new(size_t n) {
+    nalloc.fetch_add(1,memory_order_relaxed);
+    nbytes.fetch_add(n,memory_order_relaxed);
+    void *p=malloc(n==0?1:n);
+    if(p==0)
+        throw bad_alloc();
+    return p;
+}
+void *operator new[](size_t n) {
+    return operator new(n);
+}
+void operator delete(void *p) noexcept {
+    free(p);
+}
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+void operator delete[](void *p, size_t) noexcept {
+    free(p);
+}
+/* }}} */
+/* benchalloc.cpp */
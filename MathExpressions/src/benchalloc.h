@@ -0,0 +1,14 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef BENCHALLOC_H
+#define BENCHALLOC_H
+#include <atomic>
+/*!\brief Allocation counters of the benchmark suite.
+ *
+ * The global operator new is replaced in benchalloc.cpp, which is kept in
+ * its own translation unit so that the compiler does not inline the
+ * replacement into the code it measures.
+ */
+extern std::atomic<unsigned long long> nalloc;  //!<\brief Allocations.
+extern std::atomic<unsigned long long> nbytes;  //!<\brief Allocated bytes.
+#endif //BENCHALLOC_H
+/* benchalloc.h */
@@ -0,0 +1,286 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef BINARYIO_H
+#define BINARYIO_H
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "myexceptions.h"
+#include "matrix.h"
+using std::string;
+/* Element types {{{ */
+/*!\brief Maps an element type to its code in the file header. */
+template <class T> struct TypeCode;
+template <> struct TypeCode<int> { enum { value=1 }; };
+template <> struct TypeCode<float> { enum { value=2 }; };
+template <> struct TypeCode<double> { enum { value=3 }; };
+template <> struct TypeCode<Complex<float> > { enum { value=4 }; };
+template <> struct TypeCode<Complex<double> > { enum { value=5 }; };
+/*!\brief Array kinds. */
+enum ArrayKind {
+    arrayMatrix,
+    arrayBra,
+    arrayKet,
+    arrayTiled
+};
+/* }}} */
+/* ArrayHeader {{{ */
+/*!\brief Binary array file header.
+ *
+ * The header is followed by padding up to offset, then by the n*m elements
+ * stored row by row in the writer byte order.
+ * Vectors are stored as 1 x n (Bra) or n x 1 (Ket) matrices.
+ * Tiled matrices are stored by tiles, see TiledMatrix.
+ */
+struct ArrayHeader {
+    char magic[4];              //!<\brief "MXAR".
+    unsigned int version;       //!<\brief Format version.
+    unsigned int endian;        //!<\brief 0x01020304, in the writer order.
+    unsigned int type;          //!<\brief Element type, see TypeCode.
+    unsigned int size;          //!<\brief Element size, in bytes.
+    unsigned int kind;          //!<\brief Array kind, see ArrayKind.
+    unsigned int alignment;     //!<\brief Alignment of the data, in bytes.
+    unsigned int tile;          //!<\brief Tile edge of tiled matrices.
+    long long n;                //!<\brief Number of rows.
+    long long m;                //!<\brief Number of columns.
+    unsigned long long offset;  //!<\brief Offset of the data.
+    unsigned long long reserved;    //!<\brief Unused.
+};
+/*!\brief Fills an array header for elements of type T. */
+template <class T> ArrayHeader arrayHeader(ArrayKind kind, long long n,
+        long long m, unsigned int alignment=64) {
+    ArrayHeader h;
+    memset(&h,0,sizeof(h));
+    memcpy(h.magic,"MXAR",4);
+    h.version=1;
+    h.endian=0x01020304;
+    h.type=TypeCode<T>::value;
+    h.size=sizeof(T);
+    h.kind=kind;
+    if(alignment<sizeof(ArrayHeader))
+        alignment=sizeof(ArrayHeader);
+    h.alignment=alignment;
+    h.n=n;
+    h.m=m;
+    h.offset=(sizeof(ArrayHeader)+alignment-1)/alignment*alignment;
+    return h;
+};
+/*!\brief Returns true if the header describes count elements, starting at
+ * offset, inside a file of length bytes. Products and sums are checked for
+ * overflow, count being the product of the given dimensions. */
+inline bool arrayFits(const ArrayHeader &h, unsigned long long length,
+        long long a, long long b, long long c=1, long long d=1) {
+    if(a<0 || b<0 || c<0 || d<0 || h.offset>length)
+        return false;
+    unsigned long long bytes=h.size;
+    const long long dims[4]={a,b,c,d};
+    for(int k=0;k<4;k++) {
+        if(dims[k]!=0 && bytes>ULLONG_MAX/dims[k])
+            return false;
+        bytes*=dims[k];
+    }
+    return bytes<=length-h.offset;
+};
+/* }}} */
+/* ArrayWriter {{{ */
+/*!\brief Streaming writer for binary array files.
+ *
+ * Rows of m elements are appended one after the other and the number of
+ * rows is written in the header on close, so that results can be saved as
+ * they are produced without holding the whole array in memory.
+ */
+template <class T> class ArrayWriter {
+    public:
+        /*!\brief Default constructor.
+         *
+         * \param file File name.
+         * \param m Number of columns (ie the size of the rows).
+         * \param kind Kind of the array (a Ket must have m=1).
+         */
+        ArrayWriter(const string &file, int m, ArrayKind kind=arrayMatrix) {
+            _file=fopen(file.c_str(),"wb");
+            if(_file==0)
+                throw badFormat;
+            _header=arrayHeader<T>(kind,0,m);
+            char *pad=new char[_header.offset];
+            memset(pad,0,_header.offset);
+            memcpy(pad,&_header,sizeof(ArrayHeader));
+            size_t res=fwrite(pad,1,_header.offset,_file);
+            delete[] pad;
+            if(res!=_header.offset) {
+                fclose(_file);
+                throw badFormat;
+            }
+        };
+        /*!\brief Destructor, closes the file. */
+        ~ArrayWriter(void) {
+            if(_file!=0)
+                close();
+        };
+        /*!\brief Appends n rows. */
+        void write(const T *data, int n=1) {
+            if(_file==0)
+                throw badFormat;
+            size_t c=(size_t)n*_header.m;
+            if(fwrite(data,sizeof(T),c,_file)!=c)
+                throw badFormat;
+            _header.n+=n;
+        };
+        /*!\brief Appends a row. */
+        void write(const Vector<T> &row) {
+            if(row.size()!=_header.m)
+                throw incompatibleSizes;
+            write(row.data());
+        };
+        /*!\brief Appends the rows of a matrix. */
+        void write(const Matrix<T> &rows) {
+            if(rows.m()!=_header.m)
+                throw incompatibleSizes;
+            write(rows.data(),rows.n());
+        };
+        /*!\brief Writes the final header and closes the file. */
+        void close(void) {
+            bool ok=(fseek(_file,0,SEEK_SET)==0
+                    && fwrite(&_header,sizeof(ArrayHeader),1,_file)==1);
+            ok=(fclose(_file)==0) && ok;
+            _file=0;
+            if(!ok)
+                throw badFormat;
+        };
+        /*!\brief Returns the number of rows written so far. */
+        long long rows(void) const { return _header.n; };
+    private:
+        ArrayWriter(const ArrayWriter &);
+        ArrayWriter &operator=(const ArrayWriter &);
+        FILE *_file;            //!<\brief Output file.
+        ArrayHeader _header;    //!<\brief Header, updated on write.
+};
+/* }}} */
+/* save {{{ */
+/*!\brief Saves a matrix in a binary array file. */
+template <class T> void save(const string &file, const Matrix<T> &a) {
+    ArrayWriter<T> w(file,a.m(),arrayMatrix);
+    w.write(a);
+    w.close();
+};
+/*!\brief Saves a bra in a binary array file. */
+template <class T> void save(const string &file, const Bra<T> &a) {
+    ArrayWriter<T> w(file,a.size(),arrayBra);
+    w.write(a);
+    w.close();
+};
+/*!\brief Saves a ket in a binary array file. */
+template <class T> void save(const string &file, const Ket<T> &a) {
+    ArrayWriter<T> w(file,1,arrayKet);
+    w.write(a.data(),a.size());
+    w.close();
+};
+/* }}} */
+/* MappedArray {{{ */
+/*!\brief Binary array file mapped in memory.
+ *
+ * The matrix(), bra() and ket() methods return views over the mapped
+ * elements: nothing is copied and pages are only read when accessed.
+ * Views must not outlive the MappedArray object.
+ * If the file is not opened for writing, it is mapped copy-on-write and
+ * modifications of the views are not saved.
+ */
+template <class T> class MappedArray {
+    public:
+        /*!\brief Default constructor.
+         *
+         * \param file File name.
+         * \param writable If true, modifications are written to the file.
+         */
+        MappedArray(const string &file, bool writable=false) {
+            int fd=open(file.c_str(),writable?O_RDWR:O_RDONLY);
+            if(fd<0)
+                throw badFormat;
+            struct stat st;
+            if(fstat(fd,&st)!=0
+                    || (unsigned long)st.st_size<sizeof(ArrayHeader)) {
+                ::close(fd);
+                throw badFormat;
+            }
+            _length=st.st_size;
+            _map=mmap(0,_length,PROT_READ|PROT_WRITE,
+                    writable?MAP_SHARED:MAP_PRIVATE,fd,0);
+            ::close(fd);
+            if(_map==MAP_FAILED)
+                throw badFormat;
+            const ArrayHeader *h=(const ArrayHeader*)_map;
+            if(memcmp(h->magic,"MXAR",4)!=0 || h->version!=1
+                    || h->endian!=0x01020304
+                    || h->type!=(unsigned int)TypeCode<T>::value
+                    || h->size!=sizeof(T) || h->kind==arrayTiled
+                    || h->offset%sizeof(T)!=0
+                    || !arrayFits(*h,_length,h->n,h->m)) {
+                munmap(_map,_length);
+                throw badFormat;
+            }
+            _header=*h;
+            _discarded=0;
+        };
+        /*!\brief Destructor, unmaps the file. */
+        ~MappedArray(void) {
+            munmap(_map,_length);
+        };
+        /*!\brief Returns the number of rows. */
+        long long n(void) const { return _header.n; };
+        /*!\brief Returns the number of columns. */
+        long long m(void) const { return _header.m; };
+        /*!\brief Returns the kind of the array. */
+        ArrayKind kind(void) const { return (ArrayKind)_header.kind; };
+        /*!\brief Returns a pointer to the elements. */
+        T *data(void) { return (T*)((char*)_map+_header.offset); };
+        /*!\brief Returns a matrix view, dimensions must fit in an int. */
+        Matrix<T> matrix(void) {
+            if(n()>INT_MAX || m()>INT_MAX)
+                throw incompatibleSizes;
+            return Matrix<T>(n(),m(),data());
+        };
+        /*!\brief Returns a bra view over all the elements. */
+        Bra<T> bra(void) { return Bra<T>(elements(),data()); };
+        /*!\brief Returns a ket view over all the elements. */
+        Ket<T> ket(void) { return Ket<T>(elements(),data()); };
+        /*!\brief Advises the kernel that the data will be read soon. */
+        void prefetch(void) {
+            madvise(_map,_length,MADV_WILLNEED);
+        };
+        /*!\brief Releases the pages holding the first count elements.
+         *
+         * This keeps the memory footprint of sequential reads constant.
+         * With a copy-on-write mapping, modifications of these elements are
+         * lost.
+         */
+        void discard(long long count) {
+            if(count<0 || count>n()*m())
+                count=n()*m();
+            unsigned long page=sysconf(_SC_PAGESIZE);
+            unsigned long end=(_header.offset+count*sizeof(T))/page*page;
+            if(end>_discarded) {
+                madvise((char*)_map+_discarded,end-_discarded,MADV_DONTNEED);
+                _discarded=end;
+            }
+        };
+    private:
+        MappedArray(const MappedArray &);
+        /*!\brief Returns the number of elements of a vector view. */
+        int elements(void) const {
+            if(n()*m()>INT_MAX)
+                throw incompatibleSizes;
+            return n()*m();
+        };
+        MappedArray &operator=(const MappedArray &);
+        void *_map;             //!<\brief Mapped file.
+        unsigned long _length;  //!<\brief Length of the mapping.
+        ArrayHeader _header;    //!<\brief File header.
+        unsigned long _discarded;   //!<\brief Length of released pages.
+};
+/* }}} */
+#endif //BINARYIO_H
+/* binaryio.h */
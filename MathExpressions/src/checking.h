@@ -0,0 +1,40 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef CHECKING_H
+#define CHECKING_H
+#include "myexceptions.h"
+/*!\brief Element access checking policies.
+ *
+ * Containers provide a get<Policy>() access method in addition to the
+ * always checked at() and operator[]:
+ *  - Checked throws outOfBounds when an index is out of range,
+ *  - Unchecked never checks, for hot loops whose bounds are known,
+ *  - DebugChecked checks unless NDEBUG is defined.
+ */
+/* Checked {{{ */
+/*!\brief Always checks indices. */
+struct Checked {
+    /*!\brief Throws outOfBounds if inside is false. */
+    static inline void check(bool inside) {
+        if(!inside)
+            throw outOfBounds;
+    };
+};
+/* }}} */
+/* Unchecked {{{ */
+/*!\brief Never checks indices. */
+struct Unchecked {
+    /*!\brief Does nothing. */
+    static inline void check(bool) {};
+};
+/* }}} */
+/* DebugChecked {{{ */
+#ifdef NDEBUG
+/*!\brief Checks indices in debug builds only. */
+struct DebugChecked : public Unchecked {};
+#else
+/*!\brief Checks indices in debug builds only. */
+struct DebugChecked : public Checked {};
+#endif
+/* }}} */
+#endif //CHECKING_H
+/* checking.h */
@@ -0,0 +1,259 @@
+/* This file is a part of MathExpression. {{{
+ * Copyright (C) 2012 Romain Dubessy
+ *
+ * MathExpression is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MathExpression is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MathExpression.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * }}} */
+#include <typeinfo>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cctype>
+#include <cstdlib>
+#include <cerrno>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "codegen.h"
+using std::ostringstream;
+using std::istringstream;
+using std::ofstream;
+/*!\brief Number of variables of a single point evaluation handled without
+ * allocation. */
+#define CODEGEN_VARS 16
+/* emit {{{ */
+/*!\brief Recursively writes the C++ translation of an expression. */
+static void emit(ostringstream &os, Expression *exp,
+        const vector<string> &vars) {
+    if(typeid(*exp)==typeid(Constant)) {
+        double c=((Constant*)exp)->value();
+        char buf[64];
+        if(c!=c)
+            snprintf(buf,64,"__builtin_nan(\"\")");
+        else if(c-c!=0)
+            snprintf(buf,64,"(%s__builtin_inf())",(c<0?"-":""));
+        else
+            snprintf(buf,64,"(%a)",c);
+        os << buf;
+    } else if(typeid(*exp)==typeid(Variable)) {
+        string name=((Variable*)exp)->name();
+        for(unsigned int k=0;k<vars.size();k++) {
+            if(vars[k]==name) {
+                os << "x" << k << "[i]";
+                return;
+            }
+        }
+        throw undefVar;
+    } else if(typeid(*exp)==typeid(BinaryOp)) {
+        BinaryOp *op=(BinaryOp*)exp;
+        if(op->op()=='^') {
+            os << "pow(";
+            emit(os,op->left(),vars);
+            os << ",";
+            emit(os,op->right(),vars);
+            os << ")";
+        } else {
+            os << "(";
+            emit(os,op->left(),vars);
+            os << op->op();
+            emit(os,op->right(),vars);
+            os << ")";
+        }
+    } else if(typeid(*exp)==typeid(SingleValFunction)) {
+        SingleValFunction *fun=(SingleValFunction*)exp;
+        //Registered functions have no C++ translation.
+        if(fun->i()>=Nfunc)
+            throw compilationError;
+        string name=funcNames[fun->i()];
+        for(unsigned int k=0;k<name.size();k++)
+            name[k]=tolower(name[k]);
+        os << name << "(";
+        emit(os,fun->arg(),vars);
+        os << ")";
+    } else {
+        //Vector and matrix constants have no scalar translation.
+        throw compilationError;
+    }
+}
+/* }}} */
+/* generateCode {{{ */
+string generateCode(Expression *exp, const vector<string> &vars) {
+    ostringstream os;
+    os << "#include <cmath>\n"
+        << "using namespace std;\n"
+        << "extern \"C\" void mathexpr_kernel(int n, "
+        << "const double *const *in, double *__restrict__ out) {\n";
+    for(unsigned int k=0;k<vars.size();k++)
+        os << "    const double *__restrict__ x" << k << "=in[" << k << "];\n";
+    os << "    for(int i=0;i<n;i++)\n"
+        << "        out[i]=";
+    emit(os,exp,vars);
+    os << ";\n}\n";
+    return os.str();
+}
+/* }}} */
+/* hashString {{{ */
+unsigned long long hashString(const string &s) {
+    unsigned long long h=14695981039346656037ULL;
+    for(unsigned int i=0;i<s.size();i++) {
+        h^=(unsigned char)s[i];
+        h*=1099511628211ULL;
+    }
+    return h;
+}
+/* }}} */
+/* getEnv {{{ */
+/*!\brief Returns an environment variable, or a default value. */
+static string getEnv(const char *name, const char *def) {
+    const char *v=getenv(name);
+    if(v==0 || v[0]==0)
+        return string(def);
+    return string(v);
+}
+/* }}} */
+/* cacheDir {{{ */
+/*!\brief Returns the cache directory, see CompiledExpression. */
+static string cacheDir(void) {
+    const char *v=getenv("MATHEXPR_CACHE");
+    if(v!=0 && v[0]!=0)
+        return string(v);
+    v=getenv("XDG_CACHE_HOME");
+    if(v!=0 && v[0]=='/')
+        return string(v)+"/mathexpr";
+    v=getenv("HOME");
+    if(v==0 || v[0]==0) {
+        struct passwd *pw=getpwuid(getuid());
+        if(pw==0 || pw->pw_dir==0 || pw->pw_dir[0]==0)
+            throw compilationError;
+        v=pw->pw_dir;
+    }
+    string cache=string(v)+"/.cache";
+    mkdir(cache.c_str(),0700);
+    return cache+"/mathexpr";
+}
+/* }}} */
+/* isPrivate {{{ */
+/*!\brief Returns true if path is owned by the user and cannot be modified
+ * by others, the type of the file being given by type. */
+static bool isPrivate(const string &path, mode_t type, mode_t forbidden) {
+    struct stat st;
+    if(lstat(path.c_str(),&st)!=0)
+        return false;
+    return (st.st_mode&S_IFMT)==type && st.st_uid==geteuid()
+        && (st.st_mode&forbidden)==0;
+}
+/* }}} */
+/* runCompiler {{{ */
+/*!\brief Runs the compiler without a shell, returns true on success. */
+static bool runCompiler(const vector<string> &args) {
+    vector<char *> argv(args.size()+1,(char *)0);
+    for(unsigned int k=0;k<args.size();k++)
+        argv[k]=const_cast<char *>(args[k].c_str());
+    pid_t pid=fork();
+    if(pid<0)
+        return false;
+    if(pid==0) {
+        int null=open("/dev/null",O_WRONLY);
+        if(null>=0)
+            dup2(null,2);
+        execvp(argv[0],&argv[0]);
+        _exit(127);
+    }
+    int status;
+    while(waitpid(pid,&status,0)<0)
+        if(errno!=EINTR)
+            return false;
+    return WIFEXITED(status) && WEXITSTATUS(status)==0;
+}
+/* }}} */
+/* CompiledExpression class implementation {{{ */
+CompiledExpression::CompiledExpression(Expression *exp,
+        const vector<string> &vars) {
+    _handle=0;
+    _kernel=0;
+    _nvars=vars.size();
+    _source=generateCode(exp,vars);
+    string dir=cacheDir();
+    vector<string> args(1,getEnv("MATHEXPR_CXX","g++"));
+    istringstream flags(getEnv("MATHEXPR_CXXFLAGS","-O3"));
+    string flag,cmd=args[0];
+    while(flags >> flag)
+        args.push_back(flag);
+    args.push_back("-fPIC");
+    args.push_back("-shared");
+    for(unsigned int k=1;k<args.size();k++)
+        cmd+=" "+args[k];
+    char key[32];
+    snprintf(key,32,"%016llx",hashString(cmd+"\n"+_source));
+    _path=dir+"/mexpr_"+key+".so";
+    //Only load objects from a directory the user alone can write to.
+    mkdir(dir.c_str(),0700);
+    if(!isPrivate(dir,S_IFDIR,S_IWGRP|S_IWOTH))
+        throw compilationError;
+    if(access(_path.c_str(),R_OK)!=0) {
+        //Cache miss: compile to a private name, then publish atomically.
+        ostringstream tmp;
+        tmp << dir << "/mexpr_" << key << "." << getpid();
+        string src=tmp.str()+".cpp";
+        string obj=tmp.str()+".so";
+        ofstream file(src.c_str(),std::ios::out);
+        file << _source;
+        file.close();
+        if(!file.good())
+            throw compilationError;
+        args.push_back(src);
+        args.push_back("-o");
+        args.push_back(obj);
+        bool res=runCompiler(args);
+        remove(src.c_str());
+        if(!res || chmod(obj.c_str(),0700)!=0
+                || rename(obj.c_str(),_path.c_str())!=0) {
+            remove(obj.c_str());
+            throw compilationError;
+        }
+    }
+    if(!isPrivate(_path,S_IFREG,S_IWGRP|S_IWOTH))
+        throw compilationError;
+    _handle=dlopen(_path.c_str(),RTLD_NOW|RTLD_LOCAL);
+    if(_handle==0)
+        throw compilationError;
+    _kernel=(Kernel)dlsym(_handle,"mathexpr_kernel");
+    if(_kernel==0) {
+        dlclose(_handle);
+        throw compilationError;
+    }
+}
+CompiledExpression::~CompiledExpression(void) {
+    if(_handle!=0)
+        dlclose(_handle);
+}
+double CompiledExpression::evaluate(const double *x) const {
+    const double *buf[CODEGEN_VARS];
+    vector<const double *> heap;
+    const double **in=buf;
+    if(_nvars>CODEGEN_VARS) {
+        heap.resize(_nvars);
+        in=&heap[0];
+    }
+    for(int k=0;k<_nvars;k++)
+        in[k]=x+k;
+    double res;
+    _kernel(1,in,&res);
+    return res;
+}
+/* }}} */
+/* codegen.cpp */
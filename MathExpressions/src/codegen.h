@@ -0,0 +1,67 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef CODEGEN_H
+#define CODEGEN_H
+#include <string>
+#include <vector>
+#include "expression.h"
+using std::string;
+using std::vector;
+/*!\brief Signature of a generated kernel.
+ *
+ * The kernel evaluates the expression on n points: in[k][i] is the value of
+ * the k-th variable at point i and the result is stored in out[i].
+ */
+typedef void (*Kernel)(int n, const double *const *in, double *out);
+/*!\brief Emits the C++ source of a kernel evaluating a scalar expression. */
+string generateCode(Expression *exp, const vector<string> &vars);
+/*!\brief Returns the FNV-1a hash of a string. */
+unsigned long long hashString(const string &s);
+/* CompiledExpression {{{ */
+/*!\brief Represents an expression compiled ahead of time to native code.
+ *
+ * The expression is translated to C++, compiled with the system compiler into
+ * a shared object and loaded with dlopen.
+ * Shared objects are cached on disk, keyed by the hash of the generated source
+ * and of the compiler command line, so that repeated runs skip the
+ * compilation.
+ * The cache directory is taken from the MATHEXPR_CACHE environment variable
+ * (default: $XDG_CACHE_HOME/mathexpr or ~/.cache/mathexpr), the compiler
+ * from MATHEXPR_CXX (default: g++) and the compiler flags, separated by
+ * spaces, from MATHEXPR_CXXFLAGS (default: -O3).
+ * The cache directory is created with mode 0700: objects are loaded only if
+ * the directory and the object are owned by the user and not writable by
+ * others. The compiler is run directly, without a shell.
+ */
+class CompiledExpression {
+    public:
+        /*!\brief Default constructor.
+         *
+         * \param exp Scalar expression to compile, simplified beforehand.
+         * \param vars Variable names, in the order of the kernel inputs.
+         */
+        CompiledExpression(Expression *exp, const vector<string> &vars);
+        ~CompiledExpression(void);
+        /*!\brief Evaluates the expression on n points. */
+        void evaluate(int n, const double *const *in, double *out) const {
+            _kernel(n,in,out);
+        };
+        /*!\brief Evaluates the expression on a single point. */
+        double evaluate(const double *x) const;
+        /*!\brief Returns the number of variables. */
+        int nvars(void) const { return _nvars; };
+        /*!\brief Returns the generated source. */
+        const string &source(void) const { return _source; };
+        /*!\brief Returns the path of the cached shared object. */
+        const string &path(void) const { return _path; };
+    private:
+        CompiledExpression(const CompiledExpression &);
+        CompiledExpression &operator=(const CompiledExpression &);
+        void *_handle;      //!<\brief Handle returned by dlopen.
+        Kernel _kernel;     //!<\brief Pointer to the loaded kernel.
+        int _nvars;         //!<\brief Number of variables.
+        string _source;     //!<\brief Generated C++ source.
+        string _path;       //!<\brief Path of the shared object.
+};
+/* }}} */
+#endif //CODEGEN_H
+/* codegen.h */
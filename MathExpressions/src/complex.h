@@ -252,7 +252,7 @@ template <class T> class Complex {
             T tmp=other.abs2();
             T re=_re;
             _re=(_re*other._re+_im*other._im)/tmp;
-            _im=(_im*other._re-_re*other._im)/tmp;
+            _im=(_im*other._re-re*other._im)/tmp;
             return *this;
         };
         /*!\brief Complex outer division.
@@ -270,9 +270,10 @@ template <class T> class Complex {
          * \param t .
          * \return .
          */
-        Complex<T> operator/=(const T t) const {
+        Complex<T> &operator/=(const T t) {
             _re/=t;
             _im/=t;
+            return *this;
         };
         /* }}} */
         /* }}} */
@@ -290,5 +291,29 @@ template <class T> class Complex {
         T _re;     /*!<\brief Real part. */
         T _im;     /*!<\brief Imaginary part. */
 };
+/* Magnitude {{{ */
+/*!\brief Returns the modulus of a real number. */
+inline double magnitude(const double x) { return fabs(x); };
+/*!\brief Returns the modulus of a real number. */
+inline float magnitude(const float x) { return fabsf(x); };
+/*!\brief Returns the modulus of a complex number. */
+template <class T> T magnitude(const Complex<T> &x) { return x.mod(); };
+/*!\brief Returns the squared modulus of a real number. */
+inline double magnitude2(const double x) { return x*x; };
+/*!\brief Returns the squared modulus of a real number. */
+inline float magnitude2(const float x) { return x*x; };
+/*!\brief Returns the squared modulus of a complex number. */
+template <class T> T magnitude2(const Complex<T> &x) { return x.abs2(); };
+/* }}} */
+/* Conjugate {{{ */
+/*!\brief Returns the conjugate of a real number, ie the number itself. */
+inline double conjugate(const double x) { return x; };
+/*!\brief Returns the conjugate of a real number, ie the number itself. */
+inline float conjugate(const float x) { return x; };
+/*!\brief Returns the conjugate of a complex number. */
+template <class T> Complex<T> conjugate(const Complex<T> &x) {
+    return x.conjugate();
+};
+/* }}} */
 #endif //COMPLEX_H
 /* complex.h */
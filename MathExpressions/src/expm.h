@@ -0,0 +1,277 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef EXPM_H
+#define EXPM_H
+#include <cmath>
+#include <vector>
+#include "myexceptions.h"
+#include "matrix.h"
+#include "complex.h"
+#include "kernels.h"
+#include "reductions.h"
+#include "solve.h"
+#include "operator.h"
+using std::vector;
+/* norm1 {{{ */
+/*!\brief Returns the 1-norm (maximal column sum) of a matrix. */
+template <class T> double norm1(const Matrix<T> &a) {
+    vector<double> col(a.m(),0.);
+    const T *d=a.data();
+    for(int i=0;i<a.n();i++)
+        for(int j=0;j<a.m();j++)
+            col[j]+=magnitude(d[i*a.m()+j]);
+    double res=0;
+    for(int j=0;j<a.m();j++)
+        res=(col[j]>res?col[j]:res);
+    return res;
+};
+/* }}} */
+/* expm {{{ */
+/*!\brief Adds alpha*b to a, in place. */
+template <class T> void expmAdd(Matrix<T> &a, const double alpha,
+        const Matrix<T> &b) {
+    kernelAxpy(a.n()*a.m(),(T)alpha,b.data(),a.data());
+};
+/*!\brief Returns the matrix exponential.
+ *
+ * Uses the scaling and squaring algorithm with Pade approximants of
+ * degree 3 to 13 (N.J. Higham, SIAM J. Matrix Anal. Appl. 26, 1179, 2005):
+ * the lowest degree accurate to double precision for the 1-norm of a is
+ * chosen, above the degree 13 range a is scaled by a power of 2 and the
+ * result is squared back.
+ */
+template <class T> Matrix<T> expm(const Matrix<T> &a) {
+    static const double theta[]={1.495585217958292e-2,2.539398330063230e-1,
+        9.504178996162932e-1,2.097847961257068e0,5.371920351148152e0};
+    static const double b[][14]={
+        {120.,60.,12.,1.},
+        {30240.,15120.,3360.,420.,30.,1.},
+        {17297280.,8648640.,1995840.,277200.,25200.,1512.,56.,1.},
+        {17643225600.,8821612800.,2075673600.,302702400.,30270240.,
+            2162160.,110880.,3960.,90.,1.},
+        {64764752532480000.,32382376266240000.,7771770303897600.,
+            1187353796428800.,129060195264000.,10559470521600.,
+            670442572800.,33522128640.,1323241920.,40840800.,960960.,
+            16380.,182.,1.}};
+    if(!a.isSquare())
+        throw notSquare;
+    const int n=a.n();
+    const double norm=norm1(a);
+    Matrix<T> id=identity<T>(n);
+    Matrix<T> u(n,n),v(n,n);
+    int s=0;
+    int d=0;
+    while(d<4 && norm>theta[d])
+        d++;
+    if(d<4) {
+        //Degree m=2d+3: u=a*sum b[2k+1]a^2k, v=sum b[2k]a^2k.
+        const int m=2*d+3;
+        Matrix<T> a2=a*a;
+        Matrix<T> p(id);
+        Matrix<T> w(n,n);
+        for(int k=0;2*k<=m;k++) {
+            expmAdd(w,b[d][2*k+1],p);
+            expmAdd(v,b[d][2*k],p);
+            if(2*k+2<=m)
+                p=p*a2;
+        }
+        u=a*w;
+    } else {
+        if(norm>theta[4])
+            s=(int)ceil(log2(norm/theta[4]));
+        Matrix<T> x=a*(T)ldexp(1.,-s);
+        Matrix<T> x2=x*x;
+        Matrix<T> x4=x2*x2;
+        Matrix<T> x6=x4*x2;
+        const double *c=b[4];
+        Matrix<T> w(n,n);
+        expmAdd(w,c[13],x6);
+        expmAdd(w,c[11],x4);
+        expmAdd(w,c[9],x2);
+        w=x6*w;
+        expmAdd(w,c[7],x6);
+        expmAdd(w,c[5],x4);
+        expmAdd(w,c[3],x2);
+        expmAdd(w,c[1],id);
+        u=x*w;
+        Matrix<T> z(n,n);
+        expmAdd(z,c[12],x6);
+        expmAdd(z,c[10],x4);
+        expmAdd(z,c[8],x2);
+        v=x6*z;
+        expmAdd(v,c[6],x6);
+        expmAdd(v,c[4],x4);
+        expmAdd(v,c[2],x2);
+        expmAdd(v,c[0],id);
+    }
+    //r=(v-u)^-1(v+u)
+    Matrix<T> q(v);
+    q-=u;
+    v+=u;
+    Matrix<T> r=solve(q,v);
+    for(int i=0;i<s;i++)
+        r=r*r;
+    return r;
+};
+/* }}} */
+/* Krylov helpers {{{ */
+/*!\brief Returns the hermitian scalar product sum conj(x_i)*y_i. */
+template <class T> T krylovDot(int n, const T *x, const T *y) {
+    return reduce<PlainSum,T>(n,
+            [&](long long i) { return conjugate(x[i])*y[i]; });
+};
+/*!\brief Returns the euclidian norm. */
+template <class T> double krylovNorm(int n, const T *x) {
+    return norm2(n,x);
+};
+/* }}} */
+/* Propagator {{{ */
+/*!\brief Computes exp(t*A)*psi with a Krylov subspace method.
+ *
+ * A Krylov basis of dimension m is built with the Arnoldi algorithm (or
+ * the Lanczos algorithm if A is hermitian, which only orthogonalizes
+ * against the last two vectors), and exp(t*A)*psi is approximated by
+ * beta*V*exp(t*H)*e1, where H is the small projected matrix.
+ * The time step is split in substeps when the a posteriori error estimate
+ * beta*h(m+1,m)*|exp(t*H)(m,1)| exceeds the tolerance, relative to the
+ * norm of psi; noConvergence is thrown if the substeps become negligible.
+ * The basis is allocated once and reused across steps, which makes the
+ * propagator suited to time evolution, eg with A=-iH.
+ */
+template <class T> class Propagator {
+    public:
+        /*!\brief Default constructor.
+         *
+         * \param a Operator, referenced.
+         * \param dt Time step of step().
+         * \param m Dimension of the Krylov space.
+         * \param tol Relative error tolerance per step.
+         * \param hermitian True if a is hermitian (or anti-hermitian).
+         */
+        Propagator(const LinearOperator<T> &a, T dt=1, int m=30,
+                double tol=1e-12, bool hermitian=false) : _a(a) {
+            _dt=dt;
+            _n=a.size();
+            _m=(m<1?1:(m>_n?_n:m));
+            _tol=tol;
+            _hermitian=hermitian;
+            _basis.resize((long)(_m+1)*_n);
+            _substeps=0;
+        };
+        /*!\brief Advances psi by one time step, psi=exp(dt*A)*psi. */
+        void step(Ket<T> &psi) { apply(_dt,psi); };
+        /*!\brief Sets psi=exp(t*A)*psi. */
+        void apply(T t, Ket<T> &psi) {
+            if(psi.size()!=_n)
+                throw incompatibleSizes;
+            apply(t,psi.data());
+        };
+        /*!\brief Sets psi=exp(t*A)*psi, psi has size() elements. */
+        void apply(T t, T *psi) {
+            double done=0;
+            double tau=1;
+            _substeps=0;
+            while(done<1) {
+                double beta=krylovNorm(_n,psi);
+                if(beta==0)
+                    return;
+                if(!(beta<HUGE_VAL))
+                    throw noConvergence;
+                int k=arnoldi(psi,beta);
+                bool exact=(k<_m || _h.at(k,k-1)==(T)0);
+                Matrix<T> hk(k,k);
+                for(int i=0;i<k;i++)
+                    for(int j=0;j<k;j++)
+                        hk.template get<Unchecked>(i,j)=_h.at(i,j);
+                Matrix<T> e;
+                for(;;) {
+                    if(tau>1-done)
+                        tau=1-done;
+                    e=expm(hk*(t*(T)tau));
+                    if(exact)
+                        break;
+                    double err=magnitude(_h.at(k,k-1))
+                        *magnitude(e.at(k-1,0));
+                    if(err<=_tol)
+                        break;
+                    if(tau<1e-12 || !(err==err))
+                        throw noConvergence;
+                    tau/=2;
+                }
+                //psi=beta*V*e(:,0)
+                for(int i=0;i<_n;i++)
+                    psi[i]=0;
+                for(int j=0;j<k;j++)
+                    kernelAxpy(_n,e.at(j,0)*(T)beta,&_basis[(long)j*_n],
+                            psi);
+                done+=tau;
+                _substeps++;
+                if(exact)
+                    tau=1;
+            }
+        };
+        /*!\brief Returns the dimension of the space. */
+        int size(void) const { return _n; };
+        /*!\brief Returns the number of substeps of the last step. */
+        int substeps(void) const { return _substeps; };
+    private:
+        Propagator(const Propagator &);
+        Propagator &operator=(const Propagator &);
+        /*!\brief Builds the Krylov basis of psi, returns its dimension. */
+        int arnoldi(const T *psi, double beta) {
+            _h=Matrix<T>(_m+1,_m);
+            T *v=&_basis[0];
+            for(int i=0;i<_n;i++)
+                v[i]=psi[i]*(T)(1./beta);
+            for(int j=0;j<_m;j++) {
+                T *w=&_basis[(long)(j+1)*_n];
+                _a.apply(&_basis[(long)j*_n],w);
+                double wnorm=krylovNorm(_n,w);
+                for(int i=(_hermitian && j>1?j-1:0);i<=j;i++) {
+                    const T *vi=&_basis[(long)i*_n];
+                    T h=krylovDot(_n,vi,w);
+                    _h.at(i,j)=h;
+                    kernelAxpy(_n,((T)0)-h,vi,w);
+                }
+                double h=krylovNorm(_n,w);
+                _h.at(j+1,j)=(T)h;
+                //Happy breakdown: the space is invariant.
+                if(h<=1e-13*wnorm || h==0) {
+                    _h.at(j+1,j)=0;
+                    return j+1;
+                }
+                T inv=(T)(1./h);
+                for(int i=0;i<_n;i++)
+                    w[i]*=inv;
+            }
+            return _m;
+        };
+        const LinearOperator<T> &_a;    //!<\brief Operator.
+        T _dt;                          //!<\brief Time step.
+        int _n;                         //!<\brief Dimension of the space.
+        int _m;                         //!<\brief Dimension of the basis.
+        double _tol;                    //!<\brief Error tolerance.
+        bool _hermitian;                //!<\brief Lanczos if true.
+        vector<T> _basis;               //!<\brief Krylov basis, by rows.
+        Matrix<T> _h;                   //!<\brief Projected matrix.
+        int _substeps;                  //!<\brief Substeps of last step.
+};
+/* }}} */
+/* expmv {{{ */
+/*!\brief Returns exp(t*A)*v without forming the exponential, see
+ * Propagator. */
+template <class T> Ket<T> expmv(const LinearOperator<T> &a, T t,
+        const Ket<T> &v, int m=30, double tol=1e-12, bool hermitian=false) {
+    Propagator<T> p(a,t,m,tol,hermitian);
+    Ket<T> res(v);
+    p.step(res);
+    return res;
+};
+/*!\brief Returns exp(t*A)*v without forming the exponential. */
+template <class T> Ket<T> expmv(const Matrix<T> &a, T t, const Ket<T> &v,
+        int m=30, double tol=1e-12) {
+    DenseOperator<T> op(a);
+    return expmv(op,t,v,m,tol);
+};
+/* }}} */
+#endif //EXPM_H
+/* expm.h */
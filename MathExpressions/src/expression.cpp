@@ -17,10 +17,55 @@
  * }}} */
 #include <typeinfo>
 #include "expression.h"
-#define Nfunc 10
+#include "registry.h"
 string funcNames[]={"Exp","Sqrt","Erf","Cos","Sin","Tan","Cosh","Sinh","Tanh",
     "Log"};
 double (*funcPointers[])(double)={exp,sqrt,erf,cos,sin,tan,cosh,sinh,tanh,log};
+/* funcApply {{{ */
+/*!\brief Computes y[i]=f(x[i]). */
+template <class F> static void funcLoop(long long n, F f, const double *x,
+        double *y) {
+    for(long long i=0;i<n;i++)
+        y[i]=f(x[i]);
+}
+void funcApply(int fun, long long n, const double *x, double *y) {
+    //Same order as funcNames.
+    switch(fun) {
+        case 0:
+            funcLoop(n,[](double a) { return exp(a); },x,y);
+            break;
+        case 1:
+            funcLoop(n,[](double a) { return sqrt(a); },x,y);
+            break;
+        case 2:
+            funcLoop(n,[](double a) { return erf(a); },x,y);
+            break;
+        case 3:
+            funcLoop(n,[](double a) { return cos(a); },x,y);
+            break;
+        case 4:
+            funcLoop(n,[](double a) { return sin(a); },x,y);
+            break;
+        case 5:
+            funcLoop(n,[](double a) { return tan(a); },x,y);
+            break;
+        case 6:
+            funcLoop(n,[](double a) { return cosh(a); },x,y);
+            break;
+        case 7:
+            funcLoop(n,[](double a) { return sinh(a); },x,y);
+            break;
+        case 8:
+            funcLoop(n,[](double a) { return tanh(a); },x,y);
+            break;
+        case 9:
+            funcLoop(n,[](double a) { return log(a); },x,y);
+            break;
+        default:
+            throw unknownFunction;
+    }
+}
+/* }}} */
 /* find {{{ */
 int find(const string &s, const char c) {
     int n=s.size()-1;
@@ -42,6 +87,7 @@ int find(const string &s, const char c) {
 /* }}} */
 /* parseString {{{ */
 Expression *parseString(const string &s) {
+    PROFILE_PHASE(phaseParse);
     int n=s.size();
     if(n!=0) {
         //Search for binary operator
@@ -62,10 +108,13 @@ Expression *parseString(const string &s) {
         //s=Fun[...] ?
         int bra,ket;
         bra=s.find('[');
-        ket=s.find(']');
+        ket=s.rfind(']');
         if(bra!=-1) {
             string sn=s.substr(0,bra);
             string sa=s.substr(bra+1,ket-bra-1);
+            int fun=functionRegistry().find(sn);
+            if(fun!=-1 && functionRegistry()[fun].nargs!=1)
+                return new MultiValFunction(sn,sa);
             return new SingleValFunction(sn,sa);
         }
         //s={{...}} MConstant ?
@@ -99,7 +148,13 @@ ostream &operator<<(ostream &os, Expression *exp) {
         os << '(' << op->left() << op->op() << op->right() << ')';
     } else if(typeid(*exp)==typeid(SingleValFunction)) {
         SingleValFunction *fun=(SingleValFunction*)exp;
-        os << funcNames[fun->i()] << '[' << fun->arg() << ']';
+        os << functionRegistry()[fun->i()].name << '[' << fun->arg() << ']';
+    } else if(typeid(*exp)==typeid(MultiValFunction)) {
+        MultiValFunction *fun=(MultiValFunction*)exp;
+        os << functionRegistry()[fun->i()].name << '[';
+        for(int k=0;k<fun->nargs();k++)
+            os << (k>0?",":"") << fun->arg(k);
+        os << ']';
     }
     return os;
 }
@@ -185,11 +240,18 @@ MConstant::MConstant(const string &s) {
 /* }}} */
 /* Variable class implementation {{{ */
 Expression *Variable::simplify(VarDef &vars) {
-    if(vars.find(_var)!=vars.end())
+    PROFILE_COUNT(nodes);
+    PROFILE_COUNT(simplify);
+    PROFILE_COUNT(lookups);
+    if(vars.find(_var)!=vars.end()) {
+        PROFILE_COUNT(lookups);
         return vars[_var]->simplify(vars);
+    }
     return this;
 }
 void *Variable::evaluate(VarDef &vars) {
+    PROFILE_COUNT(nodes);
+    PROFILE_ADD(lookups,2);
     if(vars.find(_var)==vars.end())
         throw undefVar;
     return vars[_var]->evaluate(vars);
@@ -200,6 +262,45 @@ bool Variable::find(const char *var) {
     return false;
 }
 /* }}} */
+/* Impure calls {{{ */
+/*!\brief Returns true if exp calls an impure function. */
+static bool impure(Expression *exp) {
+    if(typeid(*exp)==typeid(BinaryOp))
+        return impure(((BinaryOp*)exp)->left())
+            || impure(((BinaryOp*)exp)->right());
+    if(typeid(*exp)==typeid(SingleValFunction)) {
+        SingleValFunction *fun=(SingleValFunction*)exp;
+        return !(functionRegistry()[fun->i()].flags&functionPure)
+            || impure(fun->arg());
+    }
+    if(typeid(*exp)==typeid(MultiValFunction)) {
+        MultiValFunction *fun=(MultiValFunction*)exp;
+        if(!(functionRegistry()[fun->i()].flags&functionPure))
+            return true;
+        for(int k=0;k<fun->nargs();k++)
+            if(impure(fun->arg(k)))
+                return true;
+    }
+    return false;
+}
+/*!\brief Returns the value of a scalar expression, which may call impure
+ * functions. */
+static double scalarValue(Expression *exp, VarDef &vars) {
+    if(typeid(*exp)==typeid(BinaryOp)
+            || typeid(*exp)==typeid(SingleValFunction)
+            || typeid(*exp)==typeid(MultiValFunction)) {
+        //These nodes only evaluate to scalars.
+        double *d=(double*)exp->evaluate(vars);
+        double res=*d;
+        delete d;
+        return res;
+    }
+    Expression *tmp=exp->simplify(vars);
+    if(typeid(*tmp)!=typeid(Constant))
+        throw undefVar;
+    return ((Constant*)tmp)->value();
+}
+/* }}} */
 /* BinaryOp class implementation {{{ */
 /* BinaryOp {{{ */
 BinaryOp::BinaryOp(const char c, const string &sl, const string &sr) {
@@ -225,14 +326,17 @@ void BinaryOp::print(void) {
 /* }}} */
 /* simplify {{{ */
 Expression *BinaryOp::simplify(VarDef &vars) {
+    PROFILE_PHASE(phaseSimplify);
+    PROFILE_COUNT(nodes);
+    PROFILE_COUNT(simplify);
     Expression *left=_left->simplify(vars);
     Expression *right=_right->simplify(vars);
     if(typeid(*left)==typeid(Constant)) {
         /* scalar lhs. {{{ */
-        double lhs=*((double*)left->evaluate(vars));
+        double lhs=((Constant*)left)->value();
         if(typeid(*right)==typeid(Constant)) {
             /* scalar rhs. {{{ */
-            double rhs=*((double*)right->evaluate(vars));
+            double rhs=((Constant*)right)->value();
             switch(_c) {
                 case '+':
                     lhs+=rhs;
@@ -256,7 +360,7 @@ Expression *BinaryOp::simplify(VarDef &vars) {
             /* matrix rhs. {{{ */
             if(_c!='*')
                 throw incompatibleSizes;
-            Matrix<double> rhs=*((Matrix<double>*)right->evaluate(vars));
+            Matrix<double> rhs=((MConstant*)right)->value();
             rhs*=lhs;
             return new MConstant(rhs);
             /* }}} */
@@ -264,7 +368,7 @@ Expression *BinaryOp::simplify(VarDef &vars) {
             /* bra rhs. {{{ */
             if(_c!='*')
                 throw incompatibleSizes;
-            Bra<double> rhs=*((Bra<double>*)right->evaluate(vars));
+            Bra<double> rhs=((BConstant*)right)->value();
             rhs*=lhs;
             return new BConstant(rhs);
             /* }}} */
@@ -272,7 +376,7 @@ Expression *BinaryOp::simplify(VarDef &vars) {
             /* ket rhs. {{{ */
             if(_c!='*')
                 throw incompatibleSizes;
-            Ket<double> rhs=*((Ket<double>*)right->evaluate(vars));
+            Ket<double> rhs=((KConstant*)right)->value();
             rhs*=lhs;
             return new KConstant(rhs);
             /* }}} */
@@ -283,10 +387,10 @@ Expression *BinaryOp::simplify(VarDef &vars) {
         /* }}} */
     } else if(typeid(*left)==typeid(MConstant)) {
         /* matrix lhs. {{{ */
-        Matrix<double> lhs=*((Matrix<double>*)left->evaluate(vars));
+        Matrix<double> lhs=((MConstant*)left)->value();
         if(typeid(*right)==typeid(Constant)) {
             /* scalar rhs. {{{ */
-            double rhs=*((double*)right->evaluate(vars));
+            double rhs=((Constant*)right)->value();
             if(_c=='*')
                 lhs*=rhs;
             else if(_c=='/')
@@ -297,7 +401,7 @@ Expression *BinaryOp::simplify(VarDef &vars) {
             /* }}} */
         } else if(typeid(*right)==typeid(MConstant)) {
             /* matrix rhs. {{{ */
-            Matrix<double> rhs=*((Matrix<double>*)right->evaluate(vars));
+            const Matrix<double> &rhs=((MConstant*)right)->value();
             switch(_c) {
                 case '+':
                     lhs+=rhs;
@@ -319,7 +423,7 @@ Expression *BinaryOp::simplify(VarDef &vars) {
             /* }}} */
         } else if(typeid(*right)==typeid(KConstant)) {
             /* ket rhs. {{{ */
-            Ket<double> rhs=*((Ket<double>*)right->evaluate(vars));
+            const Ket<double> &rhs=((KConstant*)right)->value();
             if(_c!='*')
                 throw incompatibleSizes;
             return new KConstant(lhs*rhs);
@@ -328,10 +432,10 @@ Expression *BinaryOp::simplify(VarDef &vars) {
         /* }}} */
     } else if(typeid(*left)==typeid(BConstant)) {
         /* bra lhs. {{{ */
-        Bra<double> lhs=*((Bra<double>*)left->evaluate(vars));
+        Bra<double> lhs=((BConstant*)left)->value();
         if(typeid(*right)==typeid(Constant)) {
             /* scalar rhs. {{{ */
-            double rhs=*((double*)right->evaluate(vars));
+            double rhs=((Constant*)right)->value();
             if(_c=='*')
                 lhs*=rhs;
             else if(_c=='/')
@@ -342,7 +446,7 @@ Expression *BinaryOp::simplify(VarDef &vars) {
             /* }}} */
         } else if(typeid(*right)==typeid(MConstant)) {
             /* matrix rhs. {{{ */
-            Matrix<double> rhs=*((Matrix<double>*)right->evaluate(vars));
+            const Matrix<double> &rhs=((MConstant*)right)->value();
             if(_c!='*')
                 throw incompatibleSizes;
             return new BConstant(lhs*rhs);
@@ -353,7 +457,7 @@ Expression *BinaryOp::simplify(VarDef &vars) {
             /* }}} */
         } else if(typeid(*right)==typeid(KConstant)) {
             /* ket rhs. {{{ */
-            Ket<double> rhs=*((Ket<double>*)right->evaluate(vars));
+            const Ket<double> &rhs=((KConstant*)right)->value();
             if(_c!='*')
                 throw incompatibleSizes;
             return new Constant(lhs*rhs);
@@ -362,10 +466,10 @@ Expression *BinaryOp::simplify(VarDef &vars) {
         /* }}} */
     } else if(typeid(*left)==typeid(KConstant)) {
         /* ket lhs. {{{ */
-        Ket<double> lhs=*((Ket<double>*)left->evaluate(vars));
+        Ket<double> lhs=((KConstant*)left)->value();
         if(typeid(*right)==typeid(Constant)) {
             /* scalar rhs. {{{ */
-            double rhs=*((double*)right->evaluate(vars));
+            double rhs=((Constant*)right)->value();
             if(_c=='*')
                 lhs*=rhs;
             else if(_c=='/')
@@ -380,7 +484,7 @@ Expression *BinaryOp::simplify(VarDef &vars) {
             /* }}} */
         } else if(typeid(*right)==typeid(BConstant)) {
             /* bra rhs. {{{ */
-            Bra<double> rhs=*((Bra<double>*)right->evaluate(vars));
+            const Bra<double> &rhs=((BConstant*)right)->value();
             if(_c!='*')
                 throw incompatibleSizes;
             return new MConstant(lhs*rhs);
@@ -393,7 +497,7 @@ Expression *BinaryOp::simplify(VarDef &vars) {
         /* }}} */
     } else if(typeid(*left)==typeid(Variable)) {
         if(typeid(*right)==typeid(Constant)) {
-            double rhs=*((double*)right->evaluate(vars));
+            double rhs=((Constant*)right)->value();
             if((_c=='/' || _c=='*') && rhs==1)
                 return left;
         }
@@ -403,10 +507,28 @@ Expression *BinaryOp::simplify(VarDef &vars) {
 /* }}} */
 /* evaluate {{{ */
 void *BinaryOp::evaluate(VarDef &vars) {
+    PROFILE_PHASE(phaseEvaluate);
+    PROFILE_COUNT(nodes);
     Expression *tmp=simplify(vars);
-    if(typeid(*tmp)!=typeid(Constant))
+    if(typeid(*tmp)==typeid(Constant))
+        return tmp->evaluate(vars);
+    //Calls to impure functions are left by simplify.
+    if(!impure(tmp))
         throw undefVar;
-    return tmp->evaluate(vars);
+    double lhs=scalarValue(_left,vars);
+    double rhs=scalarValue(_right,vars);
+    switch(_c) {
+        case '+':
+            return new double(lhs+rhs);
+        case '-':
+            return new double(lhs-rhs);
+        case '*':
+            return new double(lhs*rhs);
+        case '/':
+            return new double(lhs/rhs);
+        default:
+            return new double(pow(lhs,rhs));
+    }
 }
 /* }}} */
 bool BinaryOp::find(const char *var) {
@@ -415,12 +537,11 @@ bool BinaryOp::find(const char *var) {
 /* }}} */
 /* SingleValFunction class implementation {{{ */
 SingleValFunction::SingleValFunction(const string &fun, const string &s) {
-    _fun=-1;
-    for(int i=0;i<Nfunc;i++)
-        if(fun.compare(funcNames[i])==0)
-            _fun=i;
+    _fun=functionRegistry().find(fun);
     if(_fun==-1)
         throw unknownFunction;
+    if(functionRegistry()[_fun].nargs!=1)
+        throw incorExpr;
     _arg=parseString(s);
 }
 SingleValFunction::SingleValFunction(const int fun, Expression *arg) {
@@ -428,26 +549,125 @@ SingleValFunction::SingleValFunction(const int fun, Expression *arg) {
     _arg=arg;
 }
 void SingleValFunction::print(void) {
-    cerr << funcNames[_fun] << "[";
+    cerr << functionRegistry()[_fun].name << "[";
     _arg->print();
     cerr << "]";
     return;
 }
 Expression *SingleValFunction::simplify(VarDef &vars) {
+    PROFILE_PHASE(phaseSimplify);
+    PROFILE_COUNT(nodes);
+    PROFILE_COUNT(simplify);
     Expression *tmp=_arg->simplify(vars);
-    if(typeid(*tmp)==typeid(Constant))
-        return new Constant(funcPointers[_fun](
-                    *((double*)tmp->evaluate(vars))));
+    const FunctionRegistry &reg=functionRegistry();
+    if(!(reg[_fun].flags&functionPure))
+        return new SingleValFunction(_fun,tmp);
+    if(typeid(*tmp)==typeid(Constant)) {
+        PROFILE_CALL(_fun,1);
+        const double x=((Constant*)tmp)->value();
+        return new Constant(reg.call(_fun,&x));
+    } else if(typeid(*tmp)==typeid(MConstant)) {
+        Matrix<double> res=((MConstant*)tmp)->value();
+        const double *x=res.data();
+        reg.apply(_fun,(long long)res.n()*res.m(),&x,res.data());
+        return new MConstant(res);
+    } else if(typeid(*tmp)==typeid(BConstant)) {
+        Bra<double> res=((BConstant*)tmp)->value();
+        const double *x=res.data();
+        reg.apply(_fun,res.size(),&x,res.data());
+        return new BConstant(res);
+    } else if(typeid(*tmp)==typeid(KConstant)) {
+        Ket<double> res=((KConstant*)tmp)->value();
+        const double *x=res.data();
+        reg.apply(_fun,res.size(),&x,res.data());
+        return new KConstant(res);
+    }
     return new SingleValFunction(_fun,tmp);
 }
 void *SingleValFunction::evaluate(VarDef &vars) {
-    Expression *tmp=_arg->simplify(vars);
-    if(typeid(*tmp)!=typeid(Constant))
-        throw undefVar;
-    return new double(funcPointers[_fun](*((double*)tmp->evaluate(vars))));
+    PROFILE_PHASE(phaseEvaluate);
+    PROFILE_COUNT(nodes);
+    const double x=scalarValue(_arg,vars);
+    PROFILE_CALL(_fun,1);
+    PROFILE_COUNT(allocations);
+    return new double(functionRegistry().call(_fun,&x));
 }
 bool SingleValFunction::find(const char *var) {
     return _arg->find(var);
 }
 /* }}} */
+/* MultiValFunction class implementation {{{ */
+MultiValFunction::MultiValFunction(const string &fun, const string &s) {
+    _fun=functionRegistry().find(fun);
+    if(_fun==-1)
+        throw unknownFunction;
+    //Split the arguments on the commas outside brackets and braces.
+    string rest=s;
+    int index;
+    while((index=::find(rest,','))!=-1) {
+        _args.insert(_args.begin(),parseString(rest.substr(index+1)));
+        rest=rest.substr(0,index);
+    }
+    if(!rest.empty() || !_args.empty())
+        _args.insert(_args.begin(),parseString(rest));
+    if((int)_args.size()!=functionRegistry()[_fun].nargs)
+        throw incorExpr;
+}
+MultiValFunction::MultiValFunction(const int fun,
+        const vector<Expression *> &args) {
+    _fun=fun;
+    _args=args;
+}
+void MultiValFunction::print(void) {
+    cerr << functionRegistry()[_fun].name << "[";
+    for(unsigned int k=0;k<_args.size();k++) {
+        if(k>0)
+            cerr << ",";
+        _args[k]->print();
+    }
+    cerr << "]";
+    return;
+}
+Expression *MultiValFunction::simplify(VarDef &vars) {
+    PROFILE_PHASE(phaseSimplify);
+    PROFILE_COUNT(nodes);
+    PROFILE_COUNT(simplify);
+    const int n=_args.size();
+    vector<Expression *> args(n);
+    vector<double> x(n>0?n:1);
+    bool constant=(functionRegistry()[_fun].flags&functionPure)!=0;
+    for(int k=0;k<n;k++) {
+        args[k]=_args[k]->simplify(vars);
+        if(typeid(*args[k])==typeid(Constant))
+            x[k]=((Constant*)args[k])->value();
+        else if(typeid(*args[k])==typeid(MConstant)
+                || typeid(*args[k])==typeid(BConstant)
+                || typeid(*args[k])==typeid(KConstant))
+            throw incompatibleSizes;
+        else
+            constant=false;
+    }
+    if(constant) {
+        PROFILE_CALL(_fun,1);
+        return new Constant(functionRegistry().call(_fun,&x[0]));
+    }
+    return new MultiValFunction(_fun,args);
+}
+void *MultiValFunction::evaluate(VarDef &vars) {
+    PROFILE_PHASE(phaseEvaluate);
+    PROFILE_COUNT(nodes);
+    vector<double> x(_args.size()>0?_args.size():1);
+    for(unsigned int k=0;k<_args.size();k++)
+        x[k]=scalarValue(_args[k],vars);
+    PROFILE_CALL(_fun,1);
+    PROFILE_COUNT(allocations);
+    return new double(functionRegistry().call(_fun,&x[0]));
+}
+bool MultiValFunction::find(const char *var) {
+    for(unsigned int k=0;k<_args.size();k++)
+        if(_args[k]->find(var))
+            return true;
+    return false;
+}
+/* }}} */
 /* expression.cpp */
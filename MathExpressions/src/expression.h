@@ -4,17 +4,32 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <vector>
 #include <cmath>
 #include <stdlib.h>
 #include "myexceptions.h"
 #include "matrix.h"
+#include "profiler.h"
 using std::map;
+using std::vector;
 using std::string;
 using std::cerr;
 using std::endl;
 using std::ostream;
 class Expression;
+#define Nfunc 10
 typedef map<string,Expression *> VarDef;
+/*!\brief Built-in functions, other functions are added with
+ * functionRegistry(). */
+extern string funcNames[];
+extern double (*funcPointers[])(double);
+/*!\brief Applies funcPointers[fun] to the n elements of x, y may be x.
+ *
+ * Each function gets its own loop calling it directly instead of through
+ * funcPointers, so that it is inlined when possible, and vectorized with
+ * the SIMD variants of the C library when built with -ffast-math.
+ */
+void funcApply(int fun, long long n, const double *x, double *y);
 int find(const string &s, const char c);
 Expression *parseString(const string &s);
 /* Expression {{{ */
@@ -24,7 +39,9 @@ Expression *parseString(const string &s);
 class Expression {
     public:
         /*!\brief Default constructor. */
-        Expression(void) {};
+        Expression(void) { PROFILE_COUNT(allocations); };
+        /*!\brief Destructor, does not delete the sub-expressions. */
+        virtual ~Expression(void) {};
         /*!\brief Print method. */
         virtual void print(void) =0;
         /*!\brief Set data value method. */
@@ -50,8 +67,16 @@ class Constant : public Expression {
         ~Constant(void) {};
         void print(void) { cerr << _c; };
         void set(void *d) { _c=*((double*)d); };
-        Expression *simplify(VarDef &) { return this; };
-        void *evaluate(VarDef &) { return new double(_c); };
+        Expression *simplify(VarDef &) {
+            PROFILE_COUNT(nodes);
+            PROFILE_COUNT(simplify);
+            return this;
+        };
+        void *evaluate(VarDef &) {
+            PROFILE_COUNT(nodes);
+            PROFILE_COUNT(allocations);
+            return new double(_c);
+        };
         Constant &operator=(const Constant &other);
         double value(void) const { return _c; };
         bool find(const char *var) { return false; };
@@ -71,8 +96,17 @@ class BConstant : public Expression {
         ~BConstant(void) {};
         void print(void) { cerr << _b; };
         void set(void *other) { _b=*((Bra<double>*)other); };
-        Expression *simplify(VarDef &) { return this; };
-        void *evaluate(VarDef &) { return new Bra<double>(_b); };
+        Expression *simplify(VarDef &) {
+            PROFILE_COUNT(nodes);
+            PROFILE_COUNT(simplify);
+            return this;
+        };
+        void *evaluate(VarDef &) {
+            PROFILE_COUNT(nodes);
+            PROFILE_COUNT(allocations);
+            return new Bra<double>(_b);
+        };
+        const Bra<double> &value(void) const { return _b; };
         bool find(const char *var) { return false; };
     private:
         Bra<double> _b; //!<\brief Bra constant value, stored as a vector.
@@ -90,8 +124,17 @@ class KConstant : public Expression {
         ~KConstant(void) {};
         void print(void) { cerr << _k; };
         void set(void *other) { _k=*((Ket<double>*)other); };
-        Expression *simplify(VarDef &) { return this; };
-        void *evaluate(VarDef &) { return new Ket<double>(_k); };
+        Expression *simplify(VarDef &) {
+            PROFILE_COUNT(nodes);
+            PROFILE_COUNT(simplify);
+            return this;
+        };
+        void *evaluate(VarDef &) {
+            PROFILE_COUNT(nodes);
+            PROFILE_COUNT(allocations);
+            return new Ket<double>(_k);
+        };
+        const Ket<double> &value(void) const { return _k; };
         bool find(const char *var) { return false; };
     private:
         Ket<double> _k; //!<\brief Ket constant value, stored as a vector.
@@ -109,8 +152,17 @@ class MConstant : public Expression {
         ~MConstant(void) {};
         void print(void) { cerr << _m; };
         void set(void *other) { _m=*((Matrix<double>*)other); };
-        Expression *simplify(VarDef &) { return this; };
-        void *evaluate(VarDef &) { return new Matrix<double>(_m); };
+        Expression *simplify(VarDef &) {
+            PROFILE_COUNT(nodes);
+            PROFILE_COUNT(simplify);
+            return this;
+        };
+        void *evaluate(VarDef &) {
+            PROFILE_COUNT(nodes);
+            PROFILE_COUNT(allocations);
+            return new Matrix<double>(_m);
+        };
+        const Matrix<double> &value(void) const { return _m; };
         bool find(const char *var) { return false; };
     private:
         Matrix<double> _m; //!<\brief Matrix constant value, stored as a matrix.
@@ -159,7 +211,10 @@ class BinaryOp : public Expression {
 };
 /* }}} */
 /* SingleValFunction {{{ */
-/*!\brief Represents a single value fonction, whith a scalar argument.
+/*!\brief Represents a registered function of one argument.
+ *
+ * Applied to a bra, a ket or a matrix, the function is applied to each
+ * element, and large arrays are split across the threads of the pool.
  */
 class SingleValFunction : public Expression {
     public:
@@ -180,5 +235,29 @@ class SingleValFunction : public Expression {
         Expression *_arg;   //!<\brief Argument, stored as an expression.
 };
 /* }}} */
+/* MultiValFunction {{{ */
+/*!\brief Represents a registered function of zero or several scalar
+ * arguments, such as F[X,Y].
+ */
+class MultiValFunction : public Expression {
+    public:
+        /*!\brief Default constructor, s holds the arguments. */
+        MultiValFunction(const string &fun, const string &s);
+        /*!\brief Almost a copy constructor. */
+        MultiValFunction(const int, const vector<Expression *> &);
+        ~MultiValFunction(void) {};
+        void print(void);
+        void set(void *) {};
+        Expression *simplify(VarDef &);
+        void *evaluate(VarDef &);
+        int i() { return _fun; };
+        int nargs() { return _args.size(); };
+        Expression *arg(int k) { return _args[k]; };
+        bool find(const char *var);
+    protected:
+        int _fun;                   //!<\brief Function unique identifier.
+        vector<Expression *> _args; //!<\brief Arguments.
+};
+/* }}} */
 #endif //EXPRESSION_H
 /* expression.h */
@@ -0,0 +1,531 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef FIXEDMATRIX_H
+#define FIXEDMATRIX_H
+#include <iostream>
+#include "myexceptions.h"
+#include "matrix.h"
+#include "complex.h"
+using std::ostream;
+/*!\brief Fixed size containers.
+ *
+ * FixedMatrix, FixedBra and FixedKet have compile-time dimensions and store
+ * their elements inline: they never allocate, and all the loops below are
+ * unrolled by the Unroll helper, so that small matrices (spin operators,
+ * rotations...) stay in registers.
+ * They convert to and from the dynamic Matrix, Bra and Ket classes.
+ */
+template <class T, int N, int M> class FixedMatrix;
+template <class T, int N> class FixedBra;
+template <class T, int N> class FixedKet;
+/* Unroll {{{ */
+/*!\brief Calls f(i) for i in [I,N), unrolled at compile time. */
+template <int I, int N> struct Unroll {
+    template <class F> static inline void apply(const F &f) {
+        f(I);
+        Unroll<I+1,N>::apply(f);
+    };
+};
+template <int N> struct Unroll<N,N> {
+    template <class F> static inline void apply(const F &) {};
+};
+/* }}} */
+/* FixedMatrix {{{ */
+/*!\brief This class implements a fixed size template matrix container. */
+template <class T, int N, int M> class FixedMatrix {
+    public:
+        /* Constructors {{{ */
+        /*!\brief Default constructor, elements are set to zero. */
+        FixedMatrix(void) {
+            Unroll<0,N*M>::apply([&](int i) { _data[i]=0; });
+        };
+        /*!\brief Conversion from a dynamic matrix. */
+        explicit FixedMatrix(const Matrix<T> &other) {
+            if(other.n()!=N || other.m()!=M)
+                throw incompatibleSizes;
+            const T *d=other.data();
+            Unroll<0,N*M>::apply([&](int i) { _data[i]=d[i]; });
+        };
+        /*!\brief Conversion to a dynamic matrix. */
+        Matrix<T> matrix(void) const {
+            Matrix<T> tmp(N,M);
+            T *d=tmp.data();
+            Unroll<0,N*M>::apply([&](int i) { d[i]=_data[i]; });
+            return tmp;
+        };
+        /* }}} */
+        /* Access member method {{{ */
+        /*!\brief Unchecked access member method. */
+        T &operator()(int i, int j) { return _data[i*M+j]; };
+        /*!\brief Unchecked access member method. */
+        T operator()(int i, int j) const { return _data[i*M+j]; };
+        /*!\brief Access member method. */
+        T &at(int i, int j) {
+            if(i<0 || i>=N || j<0 || j>=M)
+                throw outOfBounds;
+            return _data[i*M+j];
+        };
+        /*!\brief Access member method. */
+        T at(int i, int j) const {
+            if(i<0 || i>=N || j<0 || j>=M)
+                throw outOfBounds;
+            return _data[i*M+j];
+        };
+        /*!\brief Returns a pointer to the elements, stored row by row. */
+        T *data(void) { return _data; };
+        /*!\brief Returns a pointer to the elements, stored row by row. */
+        const T *data(void) const { return _data; };
+        /*!\brief Returns an iterator to the first element. */
+        T *begin(void) { return _data; };
+        /*!\brief Returns an iterator past the last element. */
+        T *end(void) { return _data+N*M; };
+        /*!\brief Returns an iterator to the first element. */
+        const T *begin(void) const { return _data; };
+        /*!\brief Returns an iterator past the last element. */
+        const T *end(void) const { return _data+N*M; };
+        /*!\brief Returns the number of rows. */
+        int n(void) const { return N; };
+        /*!\brief Returns the number of columns. */
+        int m(void) const { return M; };
+        /* }}} */
+        /* Print {{{ */
+        /*!\brief Friend standard output operator. */
+        friend ostream &operator<<(ostream &os, const FixedMatrix &other) {
+            for(int i=0;i<N*M;i++)
+                os << other._data[i] << " ";
+            return os;
+        };
+        /* }}} */
+        /* Transpose {{{ */
+        /*!\brief Returns the transposed matrix. */
+        FixedMatrix<T,M,N> transpose(void) const {
+            FixedMatrix<T,M,N> tmp;
+            Unroll<0,N>::apply([&](int i) {
+                Unroll<0,M>::apply([&](int j) {
+                    tmp(j,i)=_data[i*M+j];
+                });
+            });
+            return tmp;
+        };
+        /* }}} */
+        /* Trace {{{ */
+        /*!\brief Returns the matrix trace. */
+        T trace(void) const {
+            static_assert(N==M,"Matrix not square!");
+            T res=0;
+            Unroll<0,N>::apply([&](int i) { res+=_data[i*M+i]; });
+            return res;
+        };
+        /* }}} */
+        /* Determinant and inverse {{{ */
+        /*!\brief Returns the determinant. */
+        T det(void) const;
+        /*!\brief Returns the inverse, throws singular if it does not exist. */
+        FixedMatrix<T,N,N> inverse(void) const;
+        /* }}} */
+        /* Algebraic operators {{{ */
+        /*!\brief Addition operator. */
+        FixedMatrix &operator+=(const FixedMatrix &other) {
+            Unroll<0,N*M>::apply([&](int i) { _data[i]+=other._data[i]; });
+            return *this;
+        };
+        /*!\brief Addition operator. */
+        FixedMatrix operator+(const FixedMatrix &other) const {
+            FixedMatrix tmp(*this);
+            return tmp+=other;
+        };
+        /*!\brief Substraction operator. */
+        FixedMatrix &operator-=(const FixedMatrix &other) {
+            Unroll<0,N*M>::apply([&](int i) { _data[i]-=other._data[i]; });
+            return *this;
+        };
+        /*!\brief Substraction operator. */
+        FixedMatrix operator-(const FixedMatrix &other) const {
+            FixedMatrix tmp(*this);
+            return tmp-=other;
+        };
+        /*!\brief Outer product. */
+        FixedMatrix &operator*=(const T t) {
+            Unroll<0,N*M>::apply([&](int i) { _data[i]*=t; });
+            return *this;
+        };
+        /*!\brief Outer product. */
+        FixedMatrix operator*(const T t) const {
+            FixedMatrix tmp(*this);
+            return tmp*=t;
+        };
+        /*!\brief Outer product. */
+        friend FixedMatrix operator*(const T t, const FixedMatrix &other) {
+            FixedMatrix tmp(other);
+            return tmp*=t;
+        };
+        /*!\brief Outer division. */
+        FixedMatrix &operator/=(const T t) {
+            T tmp=((T)1)/t;
+            return (*this)*=tmp;
+        };
+        /*!\brief Outer division. */
+        FixedMatrix operator/(const T t) const {
+            FixedMatrix tmp(*this);
+            return tmp/=t;
+        };
+        /*!\brief Inner product operator. */
+        template <int P> FixedMatrix<T,N,P> operator*(
+                const FixedMatrix<T,M,P> &other) const {
+            FixedMatrix<T,N,P> tmp;
+            Unroll<0,N>::apply([&](int i) {
+                Unroll<0,P>::apply([&](int j) {
+                    T res=0;
+                    Unroll<0,M>::apply([&](int k) {
+                        res+=_data[i*M+k]*other(k,j);
+                    });
+                    tmp(i,j)=res;
+                });
+            });
+            return tmp;
+        };
+        /*!\brief Ket reduction. */
+        FixedKet<T,N> operator*(const FixedKet<T,M> &k) const {
+            FixedKet<T,N> tmp;
+            Unroll<0,N>::apply([&](int i) {
+                T res=0;
+                Unroll<0,M>::apply([&](int j) {
+                    res+=_data[i*M+j]*k[j];
+                });
+                tmp[i]=res;
+            });
+            return tmp;
+        };
+        /* }}} */
+        /* Comparison {{{ */
+        /*!\brief Comparison operator. */
+        bool operator==(const FixedMatrix &other) const {
+            for(int i=0;i<N*M;i++)
+                if(_data[i]!=other._data[i])
+                    return false;
+            return true;
+        };
+        /*!\brief Comparison operator. */
+        bool operator!=(const FixedMatrix &other) const {
+            return !((*this)==other);
+        };
+        /* }}} */
+    private:
+        T _data[N*M];   //!<\brief Matrix data, stored row by row.
+};
+/* }}} */
+/* FixedVector {{{ */
+/*!\brief This class implements a fixed size template vector container.
+ *
+ * Use the FixedBra and FixedKet derived classes.
+ */
+template <class T, int N> class FixedVector {
+    public:
+        /*!\brief Default constructor, elements are set to zero. */
+        FixedVector(void) {
+            Unroll<0,N>::apply([&](int i) { _data[i]=0; });
+        };
+        /*!\brief Conversion from a dynamic vector. */
+        explicit FixedVector(const Vector<T> &other) {
+            if(other.size()!=N)
+                throw incompatibleSizes;
+            const T *d=other.data();
+            Unroll<0,N>::apply([&](int i) { _data[i]=d[i]; });
+        };
+        /*!\brief Returns the vector size. */
+        int size(void) const { return N; };
+        /*!\brief Unchecked access member method. */
+        T &operator[](int i) { return _data[i]; };
+        /*!\brief Unchecked access member method. */
+        T operator[](int i) const { return _data[i]; };
+        /*!\brief Returns a pointer to the elements. */
+        T *data(void) { return _data; };
+        /*!\brief Returns a pointer to the elements. */
+        const T *data(void) const { return _data; };
+        /*!\brief Returns an iterator to the first element. */
+        T *begin(void) { return _data; };
+        /*!\brief Returns an iterator past the last element. */
+        T *end(void) { return _data+N; };
+        /*!\brief Returns an iterator to the first element. */
+        const T *begin(void) const { return _data; };
+        /*!\brief Returns an iterator past the last element. */
+        const T *end(void) const { return _data+N; };
+        /*!\brief Friend standard output operator. */
+        friend ostream &operator<<(ostream &os, const FixedVector &other) {
+            for(int i=0;i<N;i++)
+                os << other._data[i] << " ";
+            return os;
+        };
+    protected:
+        T _data[N];     //!<\brief Vector elements.
+};
+/*!\brief Elementwise operators shared by FixedBra and FixedKet. */
+#define FIXED_VECTOR_OPERATORS(V) \
+        V &operator+=(const V &other) { \
+            Unroll<0,N>::apply([&](int i) { _data[i]+=other._data[i]; }); \
+            return *this; \
+        }; \
+        V operator+(const V &other) const { V tmp(*this); return tmp+=other; }; \
+        V &operator-=(const V &other) { \
+            Unroll<0,N>::apply([&](int i) { _data[i]-=other._data[i]; }); \
+            return *this; \
+        }; \
+        V operator-(const V &other) const { V tmp(*this); return tmp-=other; }; \
+        V &operator*=(const T t) { \
+            Unroll<0,N>::apply([&](int i) { _data[i]*=t; }); \
+            return *this; \
+        }; \
+        V operator*(const T t) const { V tmp(*this); return tmp*=t; }; \
+        friend V operator*(const T t, const V &other) { \
+            V tmp(other); \
+            return tmp*=t; \
+        }; \
+        V &operator/=(const T t) { return (*this)*=((T)1)/t; }; \
+        V operator/(const T t) const { V tmp(*this); return tmp/=t; };
+/*!\brief This class implements an "horizontal" fixed size vector. */
+template <class T, int N> class FixedBra : public FixedVector<T,N> {
+    using FixedVector<T,N>::_data;
+    public:
+        /*!\brief Default constructor. */
+        FixedBra(void) : FixedVector<T,N>() {};
+        /*!\brief Conversion from a dynamic vector. */
+        explicit FixedBra(const Vector<T> &other) : FixedVector<T,N>(other) {};
+        /*!\brief Conversion to a dynamic vector. */
+        Bra<T> bra(void) const {
+            Bra<T> tmp(N);
+            T *d=tmp.data();
+            Unroll<0,N>::apply([&](int i) { d[i]=_data[i]; });
+            return tmp;
+        };
+        /*!\brief Scalar product. */
+        T operator*(const FixedKet<T,N> &other) const {
+            T res=0;
+            Unroll<0,N>::apply([&](int i) { res+=_data[i]*other[i]; });
+            return res;
+        };
+        /*!\brief Right hand side multiplication by a matrix. */
+        template <int M> FixedBra<T,M> operator*(
+                const FixedMatrix<T,N,M> &other) const {
+            FixedBra<T,M> tmp;
+            Unroll<0,M>::apply([&](int j) {
+                T res=0;
+                Unroll<0,N>::apply([&](int i) {
+                    res+=_data[i]*other(i,j);
+                });
+                tmp[j]=res;
+            });
+            return tmp;
+        };
+        /*!\brief Transposition method. */
+        FixedKet<T,N> transpose(void) const {
+            FixedKet<T,N> tmp;
+            Unroll<0,N>::apply([&](int i) { tmp[i]=_data[i]; });
+            return tmp;
+        };
+        FIXED_VECTOR_OPERATORS(FixedBra)
+};
+/*!\brief This class implements a "vertical" fixed size vector. */
+template <class T, int N> class FixedKet : public FixedVector<T,N> {
+    using FixedVector<T,N>::_data;
+    public:
+        /*!\brief Default constructor. */
+        FixedKet(void) : FixedVector<T,N>() {};
+        /*!\brief Conversion from a dynamic vector. */
+        explicit FixedKet(const Vector<T> &other) : FixedVector<T,N>(other) {};
+        /*!\brief Conversion to a dynamic vector. */
+        Ket<T> ket(void) const {
+            Ket<T> tmp(N);
+            T *d=tmp.data();
+            Unroll<0,N>::apply([&](int i) { d[i]=_data[i]; });
+            return tmp;
+        };
+        /*!\brief Cross product. */
+        template <int M> FixedMatrix<T,N,M> operator*(
+                const FixedBra<T,M> &other) const {
+            FixedMatrix<T,N,M> tmp;
+            Unroll<0,N>::apply([&](int i) {
+                Unroll<0,M>::apply([&](int j) {
+                    tmp(i,j)=_data[i]*other[j];
+                });
+            });
+            return tmp;
+        };
+        /*!\brief Transposition method. */
+        FixedBra<T,N> transpose(void) const {
+            FixedBra<T,N> tmp;
+            Unroll<0,N>::apply([&](int i) { tmp[i]=_data[i]; });
+            return tmp;
+        };
+        FIXED_VECTOR_OPERATORS(FixedKet)
+};
+#undef FIXED_VECTOR_OPERATORS
+/* }}} */
+/* Determinant {{{ */
+/*!\brief Determinant kernels, closed forms up to 4x4 and LU above. */
+template <class T, int N> struct FixedDet {
+    static T det(const FixedMatrix<T,N,N> &a) {
+        FixedMatrix<T,N,N> lu(a);
+        T res=1;
+        for(int k=0;k<N;k++) {
+            int p=k;
+            for(int i=k+1;i<N;i++)
+                if(magnitude(lu(i,k))>magnitude(lu(p,k)))
+                    p=i;
+            if(lu(p,k)==(T)0)
+                return 0;
+            if(p!=k) {
+                for(int j=0;j<N;j++) {
+                    T tmp=lu(k,j);
+                    lu(k,j)=lu(p,j);
+                    lu(p,j)=tmp;
+                }
+                res=((T)0)-res;
+            }
+            res*=lu(k,k);
+            T inv=((T)1)/lu(k,k);
+            for(int i=k+1;i<N;i++) {
+                T f=lu(i,k)*inv;
+                for(int j=k+1;j<N;j++)
+                    lu(i,j)-=f*lu(k,j);
+            }
+        }
+        return res;
+    };
+};
+template <class T> struct FixedDet<T,1> {
+    static T det(const FixedMatrix<T,1,1> &a) { return a(0,0); };
+};
+template <class T> struct FixedDet<T,2> {
+    static T det(const FixedMatrix<T,2,2> &a) {
+        return a(0,0)*a(1,1)-a(0,1)*a(1,0);
+    };
+};
+template <class T> struct FixedDet<T,3> {
+    static T det(const FixedMatrix<T,3,3> &a) {
+        return a(0,0)*(a(1,1)*a(2,2)-a(1,2)*a(2,1))
+            -a(0,1)*(a(1,0)*a(2,2)-a(1,2)*a(2,0))
+            +a(0,2)*(a(1,0)*a(2,1)-a(1,1)*a(2,0));
+    };
+};
+template <class T> struct FixedDet<T,4> {
+    static T det(const FixedMatrix<T,4,4> &a) {
+        //Laplace expansion along the first two rows.
+        T s0=a(0,0)*a(1,1)-a(1,0)*a(0,1);
+        T s1=a(0,0)*a(1,2)-a(1,0)*a(0,2);
+        T s2=a(0,0)*a(1,3)-a(1,0)*a(0,3);
+        T s3=a(0,1)*a(1,2)-a(1,1)*a(0,2);
+        T s4=a(0,1)*a(1,3)-a(1,1)*a(0,3);
+        T s5=a(0,2)*a(1,3)-a(1,2)*a(0,3);
+        T c5=a(2,2)*a(3,3)-a(3,2)*a(2,3);
+        T c4=a(2,1)*a(3,3)-a(3,1)*a(2,3);
+        T c3=a(2,1)*a(3,2)-a(3,1)*a(2,2);
+        T c2=a(2,0)*a(3,3)-a(3,0)*a(2,3);
+        T c1=a(2,0)*a(3,2)-a(3,0)*a(2,2);
+        T c0=a(2,0)*a(3,1)-a(3,0)*a(2,1);
+        return s0*c5-s1*c4+s2*c3+s3*c2-s4*c1+s5*c0;
+    };
+};
+template <class T, int N, int M> T FixedMatrix<T,N,M>::det(void) const {
+    static_assert(N==M,"Matrix not square!");
+    return FixedDet<T,N>::det(*this);
+};
+/* }}} */
+/* Inverse {{{ */
+/*!\brief Inverse kernels, closed forms up to 3x3 and Gauss-Jordan above. */
+template <class T, int N> struct FixedInverse {
+    static FixedMatrix<T,N,N> inverse(const FixedMatrix<T,N,N> &a) {
+        FixedMatrix<T,N,N> lu(a);
+        FixedMatrix<T,N,N> res;
+        Unroll<0,N>::apply([&](int i) { res(i,i)=1; });
+        for(int k=0;k<N;k++) {
+            int p=k;
+            for(int i=k+1;i<N;i++)
+                if(magnitude(lu(i,k))>magnitude(lu(p,k)))
+                    p=i;
+            if(lu(p,k)==(T)0)
+                throw singular;
+            if(p!=k) {
+                Unroll<0,N>::apply([&](int j) {
+                    T tmp=lu(k,j);
+                    lu(k,j)=lu(p,j);
+                    lu(p,j)=tmp;
+                    tmp=res(k,j);
+                    res(k,j)=res(p,j);
+                    res(p,j)=tmp;
+                });
+            }
+            T inv=((T)1)/lu(k,k);
+            Unroll<0,N>::apply([&](int j) {
+                lu(k,j)*=inv;
+                res(k,j)*=inv;
+            });
+            for(int i=0;i<N;i++) {
+                if(i==k)
+                    continue;
+                T f=lu(i,k);
+                Unroll<0,N>::apply([&](int j) {
+                    lu(i,j)-=f*lu(k,j);
+                    res(i,j)-=f*res(k,j);
+                });
+            }
+        }
+        return res;
+    };
+};
+template <class T> struct FixedInverse<T,1> {
+    static FixedMatrix<T,1,1> inverse(const FixedMatrix<T,1,1> &a) {
+        if(a(0,0)==(T)0)
+            throw singular;
+        FixedMatrix<T,1,1> res;
+        res(0,0)=((T)1)/a(0,0);
+        return res;
+    };
+};
+template <class T> struct FixedInverse<T,2> {
+    static FixedMatrix<T,2,2> inverse(const FixedMatrix<T,2,2> &a) {
+        T d=FixedDet<T,2>::det(a);
+        if(d==(T)0)
+            throw singular;
+        T inv=((T)1)/d;
+        FixedMatrix<T,2,2> res;
+        res(0,0)=a(1,1)*inv;
+        res(0,1)=((T)0)-a(0,1)*inv;
+        res(1,0)=((T)0)-a(1,0)*inv;
+        res(1,1)=a(0,0)*inv;
+        return res;
+    };
+};
+template <class T> struct FixedInverse<T,3> {
+    static FixedMatrix<T,3,3> inverse(const FixedMatrix<T,3,3> &a) {
+        T d=FixedDet<T,3>::det(a);
+        if(d==(T)0)
+            throw singular;
+        T inv=((T)1)/d;
+        FixedMatrix<T,3,3> res;
+        res(0,0)=(a(1,1)*a(2,2)-a(1,2)*a(2,1))*inv;
+        res(0,1)=(a(0,2)*a(2,1)-a(0,1)*a(2,2))*inv;
+        res(0,2)=(a(0,1)*a(1,2)-a(0,2)*a(1,1))*inv;
+        res(1,0)=(a(1,2)*a(2,0)-a(1,0)*a(2,2))*inv;
+        res(1,1)=(a(0,0)*a(2,2)-a(0,2)*a(2,0))*inv;
+        res(1,2)=(a(0,2)*a(1,0)-a(0,0)*a(1,2))*inv;
+        res(2,0)=(a(1,0)*a(2,1)-a(1,1)*a(2,0))*inv;
+        res(2,1)=(a(0,1)*a(2,0)-a(0,0)*a(2,1))*inv;
+        res(2,2)=(a(0,0)*a(1,1)-a(0,1)*a(1,0))*inv;
+        return res;
+    };
+};
+template <class T, int N, int M>
+FixedMatrix<T,N,N> FixedMatrix<T,N,M>::inverse(void) const {
+    static_assert(N==M,"Matrix not square!");
+    return FixedInverse<T,N>::inverse(*this);
+};
+/* }}} */
+/* fixedIdentity {{{ */
+/*! Return a fixed size identity matrix*/
+template <class T, int N> FixedMatrix<T,N,N> fixedIdentity(void) {
+    FixedMatrix<T,N,N> tmp;
+    Unroll<0,N>::apply([&](int i) { tmp(i,i)=1; });
+    return tmp;
+};
+/* }}} */
+#endif //FIXEDMATRIX_H
+/* fixedmatrix.h */
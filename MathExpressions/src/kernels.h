@@ -0,0 +1,213 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef KERNELS_H
+#define KERNELS_H
+#include <vector>
+#include "threadpool.h"
+/*!\brief Dense linear algebra kernels.
+ *
+ * Matrices are stored row by row, given by a pointer to element (0,0) and
+ * a row stride lda. Inner loops run over contiguous memory with unchecked
+ * access, so that the compiler vectorizes them, and large problems are
+ * split across the threads of the library pool.
+ */
+/*!\brief Minimal number of multiply-adds processed by a thread. */
+#define KERNEL_GRAIN 32768
+/* kernelDot {{{ */
+/*!\brief Returns the scalar product of two contiguous arrays.
+ *
+ * Four independent partial sums break the dependency chain of the
+ * accumulation.
+ */
+template <class T> inline T kernelDot(int n, const T *__restrict__ x,
+        const T *__restrict__ y) {
+    T s0=0,s1=0,s2=0,s3=0;
+    int i=0;
+    for(;i+4<=n;i+=4) {
+        s0+=x[i]*y[i];
+        s1+=x[i+1]*y[i+1];
+        s2+=x[i+2]*y[i+2];
+        s3+=x[i+3]*y[i+3];
+    }
+    for(;i<n;i++)
+        s0+=x[i]*y[i];
+    return (s0+s1)+(s2+s3);
+};
+/* }}} */
+/* kernelAxpy {{{ */
+/*!\brief Computes y+=alpha*x on contiguous arrays. */
+template <class T> inline void kernelAxpy(int n, const T alpha,
+        const T *__restrict__ x, T *__restrict__ y) {
+    for(int i=0;i<n;i++)
+        y[i]+=alpha*x[i];
+};
+/* }}} */
+/*!\brief Returns the number of rows per chunk for rows of m elements. */
+inline long long kernelRows(long long m) {
+    return (m>=KERNEL_GRAIN?1:KERNEL_GRAIN/(m>0?m:1));
+};
+/* Elementwise kernels {{{ */
+/*!\brief Sets the n elements of x to a.
+ *
+ * The elementwise kernels split arrays with parallelForLocal, so that the
+ * thread which first touches a part of a new array with kernelFill or
+ * kernelCopy is the one processing it in the following calls.
+ */
+template <class T> void kernelFill(long long n, T *x, const T a) {
+    parallelForLocal(n,KERNEL_GRAIN,[&](long long i0, long long i1) {
+        for(long long i=i0;i<i1;i++)
+            x[i]=a;
+    });
+};
+/*!\brief Copies the n elements of x to y, x and y are identical or
+ * disjoint. */
+template <class T> void kernelCopy(long long n, const T *x, T *y) {
+    parallelForLocal(n,KERNEL_GRAIN,[&](long long i0, long long i1) {
+        for(long long i=i0;i<i1;i++)
+            y[i]=x[i];
+    });
+};
+/*!\brief Computes y+=x, x and y are identical or disjoint. */
+template <class T> void kernelAdd(long long n, const T *x, T *y) {
+    parallelForLocal(n,KERNEL_GRAIN,[&](long long i0, long long i1) {
+        for(long long i=i0;i<i1;i++)
+            y[i]+=x[i];
+    });
+};
+/*!\brief Computes y-=x, x and y are identical or disjoint. */
+template <class T> void kernelSub(long long n, const T *x, T *y) {
+    parallelForLocal(n,KERNEL_GRAIN,[&](long long i0, long long i1) {
+        for(long long i=i0;i<i1;i++)
+            y[i]-=x[i];
+    });
+};
+/*!\brief Computes x*=a. */
+template <class T> void kernelScale(long long n, const T a, T *x) {
+    parallelForLocal(n,KERNEL_GRAIN,[&](long long i0, long long i1) {
+        for(long long i=i0;i<i1;i++)
+            x[i]*=a;
+    });
+};
+/* }}} */
+/* gemv {{{ */
+/*!\brief Computes y=A*x, A is n x m.
+ *
+ * The rows are split with parallelForLocal: each thread reads the rows it
+ * initialized if A was built by the elementwise kernels.
+ */
+template <class T> void gemv(int n, int m, const T *a, long lda,
+        const T *x, T *y) {
+    parallelForLocal(n,kernelRows(m),[&](long long i0, long long i1) {
+        for(long long i=i0;i<i1;i++)
+            y[i]=kernelDot(m,a+i*lda,x);
+    });
+};
+/* }}} */
+/* gemvT {{{ */
+/*!\brief Computes y=x*A, A is n x m.
+ *
+ * A is read row by row: each row adds x[i] times itself to y, and the
+ * threads share the columns, so that they never write to the same
+ * element.
+ */
+template <class T> void gemvT(int n, int m, const T *a, long lda,
+        const T *x, T *y) {
+    long long cols=KERNEL_GRAIN/(n>0?n:1);
+    //Keep whole cache lines per thread.
+    cols=(cols<64?64:cols);
+    parallelFor(m,cols,[&](long long j0, long long j1) {
+        T *__restrict__ r=y+j0;
+        int w=j1-j0;
+        for(int j=0;j<w;j++)
+            r[j]=0;
+        for(int i=0;i<n;i++)
+            kernelAxpy(w,x[i],a+i*lda+j0,r);
+    });
+};
+/* }}} */
+/* gemm {{{ */
+/*!\brief Computes C+=A*B, A is n x m and B is m x p.
+ *
+ * Rows of C are shared by the threads, each row is accumulated as a sum of
+ * rows of B, over blocks of B small enough to stay in cache.
+ */
+template <class T> void gemm(int n, int m, int p, const T *a, long lda,
+        const T *b, long ldb, T *c, long ldc) {
+    const int bk=128,bj=256;
+    long long rows=kernelRows((long long)m*p);
+    parallelFor(n,rows,[&](long long i0, long long i1) {
+        for(int j0=0;j0<p;j0+=bj) {
+            int w=(p-j0<bj?p-j0:bj);
+            for(int k0=0;k0<m;k0+=bk) {
+                int k1=(m-k0<bk?m:k0+bk);
+                for(long long i=i0;i<i1;i++)
+                    for(int k=k0;k<k1;k++)
+                        kernelAxpy(w,a[i*lda+k],b+k*ldb+j0,c+i*ldc+j0);
+            }
+        }
+    });
+};
+/* }}} */
+/* ger {{{ */
+/*!\brief Rank-1 update A+=alpha*x*y, A is n x m. */
+template <class T> void ger(int n, int m, const T alpha, const T *x,
+        const T *y, T *a, long lda) {
+    parallelFor(n,kernelRows(m),[&](long long i0, long long i1) {
+        for(long long i=i0;i<i1;i++)
+            kernelAxpy(m,alpha*x[i],y,a+i*lda);
+    });
+};
+/* }}} */
+/* syrk {{{ */
+/*!\brief Symmetric rank-k update C=alpha*A*A^T+beta*C, A is n x k.
+ *
+ * Only the lower triangle is computed, it is then mirrored.
+ */
+template <class T> void syrk(int n, int k, const T alpha, const T *a,
+        long lda, const T beta, T *c, long ldc) {
+    //Rows are unbalanced, use small chunks.
+    long long rows=kernelRows((long long)k*n/2)/4;
+    parallelFor(n,(rows<1?1:rows),[&](long long i0, long long i1) {
+        for(long long i=i0;i<i1;i++) {
+            const T *ai=a+i*lda;
+            T *ci=c+i*ldc;
+            for(long long j=0;j<=i;j++)
+                ci[j]=alpha*kernelDot(k,ai,a+j*lda)
+                    +(beta==(T)0?(T)0:beta*ci[j]);
+        }
+    });
+    parallelFor(n,kernelRows(n),[&](long long i0, long long i1) {
+        for(long long i=i0;i<i1;i++)
+            for(long long j=i+1;j<n;j++)
+                c[i*ldc+j]=c[j*ldc+i];
+    });
+};
+/* }}} */
+/* bilinear {{{ */
+/*!\brief Returns x*A*y, A is n x m, without temporary vector.
+ *
+ * The rows are cut in blocks which do not depend on the number of threads,
+ * and the partial sums of the blocks are added in order, so that the result
+ * is reproducible, as for the reductions.
+ */
+template <class T> T bilinear(int n, int m, const T *x, const T *a,
+        long lda, const T *y) {
+    const long long rows=kernelRows(m);
+    const long long nb=(n+rows-1)/rows;
+    std::vector<T> partial(nb);
+    parallelFor(nb,1,[&](long long b0, long long b1) {
+        for(long long b=b0;b<b1;b++) {
+            const long long i1=((b+1)*rows<n?(b+1)*rows:n);
+            T s=0;
+            for(long long i=b*rows;i<i1;i++)
+                s+=x[i]*kernelDot(m,a+i*lda,y);
+            partial[b]=s;
+        }
+    });
+    T res=0;
+    for(long long b=0;b<nb;b++)
+        res+=partial[b];
+    return res;
+};
+/* }}} */
+#endif //KERNELS_H
+/* kernels.h */
@@ -0,0 +1,194 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef KRON_H
+#define KRON_H
+#include <vector>
+#include "myexceptions.h"
+#include "matrix.h"
+#include "kernels.h"
+#include "threadpool.h"
+#include "operator.h"
+using std::vector;
+/*!\brief Number of columns of a block in KroneckerOperator::apply. */
+#define KRON_COLUMNS 256
+/* kron {{{ */
+/*!\brief Returns the Kronecker product of two matrices.
+ *
+ * Element (i*b.n()+k,j*b.m()+l) of the result is a(i,j)*b(k,l), so that the
+ * index of the right factor runs fastest.
+ */
+template <class T> Matrix<T> kron(const Matrix<T> &a, const Matrix<T> &b) {
+    const int n=a.n()*b.n();
+    const int m=a.m()*b.m();
+    Matrix<T> res(n,m);
+    const T *pa=a.data();
+    const T *pb=b.data();
+    T *pc=res.data();
+    parallelFor(n,kernelRows(m),[&](long long r0, long long r1) {
+        for(long long r=r0;r<r1;r++) {
+            const int i=r/b.n();
+            const int k=r%b.n();
+            for(int j=0;j<a.m();j++) {
+                const T aij=pa[i*a.m()+j];
+                T *c=pc+r*m+j*b.m();
+                for(int l=0;l<b.m();l++)
+                    c[l]=aij*pb[k*b.m()+l];
+            }
+        }
+    });
+    return res;
+};
+/*!\brief Returns the Kronecker product of two vectors. */
+template <class T> Ket<T> kron(const Ket<T> &a, const Ket<T> &b) {
+    Ket<T> res(a.size()*b.size());
+    for(int i=0;i<a.size();i++)
+        for(int k=0;k<b.size();k++)
+            res.template get<Unchecked>(i*b.size()+k)=
+                a.template get<Unchecked>(i)*b.template get<Unchecked>(k);
+    return res;
+};
+/* }}} */
+/* KroneckerOperator {{{ */
+/*!\brief Lazy Kronecker product of square matrices, A1 x A2 x ... x Ak.
+ *
+ * The product is never formed: a vector of the product space is seen as
+ * a tensor with one index per factor, and each factor is applied along its
+ * own index with the matrix kernels, which is the reshaping identity
+ * (A x B)v=vec(A V B^T) generalized to k factors.
+ * A product of factors of dimension n costs O(N*sum n) operations instead
+ * of O(N^2), N being the product of the dimensions, and identity factors
+ * are skipped. The factors are copied.
+ */
+template <class T> class KroneckerOperator : public LinearOperator<T> {
+    public:
+        /* Default constructor {{{ */
+        /*!\brief Default constructor, the empty product acts on a space of
+         * dimension 1. */
+        KroneckerOperator(void) {
+            _n=1;
+        };
+        /*!\brief Constructs A x B. */
+        KroneckerOperator(const Matrix<T> &a, const Matrix<T> &b) {
+            _n=1;
+            append(a);
+            append(b);
+        };
+        /* }}} */
+        /* Factors {{{ */
+        /*!\brief Appends a factor on the right, the operator becomes
+         * (*this) x a. */
+        KroneckerOperator<T> &append(const Matrix<T> &a) {
+            if(!a.isSquare())
+                throw notSquare;
+            _factors.push_back(a);
+            _transposed.push_back(a.transpose());
+            _identity.push_back(a==identity<T>(a.n()));
+            _n*=a.n();
+            return *this;
+        };
+        /*!\brief Returns the number of factors. */
+        int factors(void) const { return _factors.size(); };
+        /*!\brief Returns factor i. */
+        const Matrix<T> &factor(int i) const {
+            if(i<0 || i>=factors())
+                throw outOfBounds;
+            return _factors[i];
+        };
+        /*!\brief Returns the dense product matrix. */
+        Matrix<T> matrix(void) const {
+            Matrix<T> res=identity<T>(1);
+            for(int f=0;f<factors();f++)
+                res=kron(res,_factors[f]);
+            return res;
+        };
+        /* }}} */
+        /* Algebraic operators {{{ */
+        int size(void) const { return _n; };
+        /*!\brief Computes y=A*x.
+         *
+         * The factors are applied one after the other, alternating between
+         * y and a temporary array so that the last one writes into y.
+         */
+        void apply(const T *x, T *y) const {
+            int active=0;
+            for(int f=0;f<factors();f++)
+                active+=!_identity[f];
+            if(active==0) {
+                for(int i=0;i<_n;i++)
+                    y[i]=x[i];
+                return;
+            }
+            vector<T> tmp(active>1?_n:0);
+            const T *src=x;
+            long long left=1;
+            for(int f=0;f<factors();f++) {
+                const int nf=_factors[f].n();
+                const long long right=_n/(left*nf);
+                if(!_identity[f]) {
+                    active--;
+                    T *dst=(active%2==0?y:&tmp[0]);
+                    if(right==1)
+                        applyLast(_transposed[f],left,src,dst);
+                    else
+                        applyFactor(_factors[f],left,right,src,dst);
+                    src=dst;
+                }
+                left*=nf;
+            }
+        };
+        /*!\brief Operator-vector product. */
+        Ket<T> operator*(const Ket<T> &x) const {
+            return LinearOperator<T>::operator*(x);
+        };
+        /* }}} */
+    private:
+        /*!\brief Computes dst(l,:,r)=a*src(l,:,r) for all l<left and
+         * r<right.
+         *
+         * For each l, src(l,:,:) is a row-major matrix with right columns,
+         * multiplied by a with gemm; the work is split across threads over
+         * l and over blocks of columns.
+         */
+        static void applyFactor(const Matrix<T> &a, long long left,
+                long long right, const T *src, T *dst) {
+            const int nf=a.n();
+            const long long slab=nf*right;
+            const long long nc=(right+KRON_COLUMNS-1)/KRON_COLUMNS;
+            const long long work=(long long)nf*nf*KRON_COLUMNS;
+            parallelFor(left*nc,(work>=KERNEL_GRAIN?1:KERNEL_GRAIN/work),
+                    [&](long long t0, long long t1) {
+                for(long long t=t0;t<t1;t++) {
+                    const long long l=t/nc;
+                    const long long c0=(t%nc)*KRON_COLUMNS;
+                    const int w=(right-c0<KRON_COLUMNS?right-c0:KRON_COLUMNS);
+                    T *d=dst+l*slab+c0;
+                    for(int i=0;i<nf;i++)
+                        for(int j=0;j<w;j++)
+                            d[i*right+j]=0;
+                    gemm(nf,nf,w,a.data(),nf,src+l*slab+c0,right,d,right);
+                }
+            });
+        };
+        /*!\brief Computes dst(l,:)=a*src(l,:) for all l<left, given the
+         * transpose at of a.
+         *
+         * The rows of the last index are too short for the column blocks of
+         * applyFactor, the product is computed as dst=src*a^T instead.
+         */
+        static void applyLast(const Matrix<T> &at, long long left,
+                const T *src, T *dst) {
+            const int nf=at.n();
+            parallelFor(left,kernelRows((long long)nf*nf),
+                    [&](long long l0, long long l1) {
+                for(long long i=l0*nf;i<l1*nf;i++)
+                    dst[i]=0;
+                gemm(l1-l0,nf,nf,src+l0*nf,nf,at.data(),nf,dst+l0*nf,nf);
+            });
+        };
+        int _n;                         //!<\brief Dimension of the space.
+        vector<Matrix<T> > _factors;    //!<\brief Factors, left to right.
+        vector<Matrix<T> > _transposed; //!<\brief Transposed factors.
+        vector<bool> _identity;         //!<\brief True for identity factors.
+};
+/* }}} */
+#endif //KRON_H
+/* kron.h */
@@ -16,8 +16,528 @@
  *
  * }}} */
 #include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
 #include <expression.h>
+#include <codegen.h>
+#include <staticexpression.h>
+#include <matrix.h>
+#include <binaryio.h>
+#include <program.h>
+#include <pipeline.h>
+#include <fixedmatrix.h>
+#include <batch.h>
+#include <expm.h>
+#include <reductions.h>
+#include <banded.h>
+#include <kron.h>
+#include <tensor.h>
+#include <tiled.h>
+#include <registry.h>
 using namespace std;
+static int failures=0;
+/*!\brief Reports a failed check. */
+static void check(bool ok, const string &what) {
+    if(!ok) {
+        cerr << "[E] Check failed : " << what << endl;
+        failures++;
+    }
+}
+/*!\brief Returns the largest difference between two matrices. */
+static double distance(const Matrix<double> &a, const Matrix<double> &b) {
+    if(a.n()!=b.n() || a.m()!=b.m())
+        return HUGE_VAL;
+    double d=0;
+    for(int i=0;i<a.n();i++)
+        for(int j=0;j<a.m();j++)
+            d=fmax(d,fabs(a.at(i,j)-b.at(i,j)));
+    return d;
+}
+/*!\brief Fills a matrix with distinct values. */
+static Matrix<double> sample(int n, int m, double shift=0) {
+    Matrix<double> a(n,m);
+    for(int i=0;i<n;i++)
+        for(int j=0;j<m;j++)
+            a.at(i,j)=sin(1.+shift+i*m+j);
+    return a;
+}
+/*!\brief Creates an empty temporary file and returns its name. */
+static string temporary(void) {
+    char file[]="/tmp/mathexpr-testXXXXXX";
+    int fd=mkstemp(file);
+    check(fd>=0,"temporary file");
+    if(fd<0)
+        return "";
+    close(fd);
+    return file;
+}
+/* Code generation {{{ */
+static void checkCodegen(void) {
+    char dir[]="/tmp/mathexpr-cacheXXXXXX";
+    check(mkdtemp(dir)!=0,"temporary cache directory");
+    setenv("MATHEXPR_CACHE",dir,1);
+    vector<string> names;
+    names.push_back("X");
+    names.push_back("Y");
+    names.push_back("Z");
+    VarDef none;
+    Expression *f=parseString("X+Exp[Y*Z]/(1+X^2)")->simplify(none);
+    try {
+        CompiledExpression c(f,names);
+        const int n=100;
+        vector<double> x(n),y(n),z(n),out(n);
+        for(int i=0;i<n;i++) {
+            x[i]=sin(1.+i);
+            y[i]=cos(1.+i);
+            z[i]=0.01*i;
+        }
+        const double *in[3]={&x[0],&y[0],&z[0]};
+        c.evaluate(n,in,&out[0]);
+        double d=0;
+        for(int i=0;i<n;i++)
+            d=fmax(d,fabs(out[i]-(x[i]+exp(y[i]*z[i])/(1+x[i]*x[i]))));
+        check(d<1e-12,"compiled kernel");
+        double p[3]={0.5,2,-1};
+        check(fabs(c.evaluate(p)-(0.5+exp(-2.)/1.25))<1e-12,
+                "compiled single point");
+        unlink(c.path().c_str());
+    } catch (CompilationError &) {
+        check(false,"expression compilation");
+    }
+    rmdir(dir);
+}
+/* }}} */
+/* Static expressions {{{ */
+static constexpr char staticFormula[]="X-2*Y^2+Sin[Z]/(1+Exp[-X])";
+static constexpr char staticVars[]="X,Y,Z";
+static void checkStatic(void) {
+    Expression *f=parseString(staticFormula);
+    double d=0;
+    for(int i=0;i<10;i++) {
+        double x[3]={sin(1.+i),cos(1.+i),0.3*i};
+        VarDef vars;
+        vars["X"]=new Constant(x[0]);
+        vars["Y"]=new Constant(x[1]);
+        vars["Z"]=new Constant(x[2]);
+        Expression *r=f->simplify(vars);
+        if(typeid(*r)!=typeid(Constant)) {
+            d=HUGE_VAL;
+            break;
+        }
+        double s=StaticExpression<staticFormula,staticVars>::evaluate(x);
+        d=fmax(d,fabs(s-((Constant*)r)->value()));
+    }
+    check(d<1e-14,"static expression");
+}
+/* }}} */
+/* Binary files {{{ */
+static void checkBinary(void) {
+    string file=temporary();
+    if(file.empty())
+        return;
+    Matrix<double> a=sample(7,5);
+    save(file,a);
+    {
+        MappedArray<double> map(file);
+        check(map.n()==7 && map.m()==5 && map.kind()==arrayMatrix,
+                "mapped matrix shape");
+        check(distance(map.matrix(),a)==0,"mapped matrix round trip");
+    }
+    {
+        ArrayWriter<double> writer(file,1,arrayKet);
+        for(int i=0;i<a.n();i++)
+            writer.write(&a.at(i,0),1);
+    }
+    {
+        MappedArray<double> map(file);
+        Ket<double> k=map.ket();
+        bool ok=(map.kind()==arrayKet && k.size()==7);
+        for(int i=0;ok && i<7;i++)
+            ok=(k[i]==a.at(i,0));
+        check(ok,"streamed ket round trip");
+    }
+    unlink(file.c_str());
+}
+/* }}} */
+/* Pipelines {{{ */
+static void checkPipeline(void) {
+    const char *fields[]={"0","-12","3.25","+0.5e3","1e-300","2.5E+10",
+        "123456789012345678901234567890","0.0000000000000000000000001",
+        "1.7976931348623157e308","4.9e-324",
+        "0.0000000000000000000000000000000000000000000000000000000000000"
+            "00000000012",
+        "1234567890123456789012345678901234567890123456789012345678901"
+            "23456789.5"};
+    bool ok=true;
+    for(unsigned int i=0;i<sizeof(fields)/sizeof(fields[0]);i++) {
+        string f=string(fields[i])+",7";
+        const char *p=f.c_str();
+        double v=parseNumber(p,f.c_str()+f.size());
+        ok=ok && v==strtod(fields[i],0) && *p==',';
+    }
+    check(ok,"parseNumber against strtod");
+    string in=temporary(),out=temporary();
+    if(in.empty() || out.empty())
+        return;
+    const int n=1000;
+    FILE *file=fopen(in.c_str(),"w");
+    fprintf(file,"X;Y\n");
+    for(int i=0;i<n;i++)
+        fprintf(file,"%.17g;%d\n",sin(1.+i),i);
+    fclose(file);
+    VarDef none;
+    vector<Program *> programs;
+    programs.push_back(new Program(parseString("X*Y+1"),none));
+    long long rows=0;
+    {
+        CsvReader reader(in,';');
+        vector<string> names;
+        names.push_back("Z");
+        CsvWriter writer(out,names);
+        Pipeline pipeline(programs,64,2);
+        rows=pipeline.run(reader,writer);
+    }
+    delete programs[0];
+    CsvReader result(out);
+    vector<double> z(n+1);
+    ok=(rows==n && result.read(&z[0],n+1)==n);
+    for(int i=0;ok && i<n;i++)
+        ok=(fabs(z[i]-(sin(1.+i)*i+1))<=1e-12*(1+i));
+    check(ok,"csv pipeline");
+    unlink(in.c_str());
+    unlink(out.c_str());
+}
+/* }}} */
+/* Fixed size matrices {{{ */
+static void checkFixed(void) {
+    Matrix<double> a=sample(3,4),b=sample(4,2,1.);
+    FixedMatrix<double,3,4> fa(a);
+    FixedMatrix<double,4,2> fb(b);
+    check(distance((fa*fb).matrix(),a*b)<1e-12,"fixed matrix product");
+    Ket<double> k(4);
+    for(int i=0;i<4;i++)
+        k[i]=cos(1.+i);
+    Ket<double> r=a*k,fr=(fa*FixedKet<double,4>(k)).ket();
+    double d=0;
+    for(int i=0;i<3;i++)
+        d=fmax(d,fabs(r[i]-fr[i]));
+    check(d<1e-12,"fixed matrix ket product");
+    check(distance((fa+fa*2.).matrix(),a*3.)<1e-12,"fixed matrix sum");
+}
+/* }}} */
+/* Matrix batches {{{ */
+static void checkBatch(void) {
+    const int count=100,n=3;
+    MatrixBatch<double> a(count,n,n),b(count,n,n);
+    for(int k=0;k<count;k++) {
+        Matrix<double> x=sample(n,n,k);
+        for(int i=0;i<n;i++)
+            x.at(i,i)+=4;
+        a.set(k,x);
+        b.set(k,sample(n,n,0.5*k));
+    }
+    MatrixBatch<double> c=a*b,inv=a.inverse();
+    Matrix<double> id(n,n);
+    for(int i=0;i<n;i++)
+        id.at(i,i)=1;
+    double dc=0,di=0;
+    for(int k=0;k<count;k++) {
+        dc=fmax(dc,distance(c.matrix(k),a.matrix(k)*b.matrix(k)));
+        di=fmax(di,distance(inv.matrix(k)*a.matrix(k),id));
+    }
+    check(dc<1e-12,"batched product");
+    check(di<1e-12,"batched inverse");
+}
+/* }}} */
+/* Views {{{ */
+static void checkViews(void) {
+    const int n=37;
+    Matrix<double> a=sample(n,n),b(a);
+    a=a.transposeView();
+    bool ok=true;
+    for(int i=0;i<n;i++)
+        for(int j=0;j<n;j++)
+            ok=ok && a.at(i,j)==b.at(j,i);
+    check(ok,"matrix self transpose");
+    a=b;
+    a.block(1,1,n-1,n-1)=a.block(0,0,n-1,n-1);
+    ok=true;
+    for(int i=1;i<n;i++)
+        for(int j=1;j<n;j++)
+            ok=ok && a.at(i,j)==b.at(i-1,j-1);
+    check(ok,"overlapping block shift");
+    Ket<double> k(n);
+    for(int i=0;i<n;i++)
+        k[i]=i;
+    k.view().segment(0,n-1)=k.view().segment(1,n-1);
+    ok=true;
+    for(int i=0;i<n-1;i++)
+        ok=ok && k[i]==i+1;
+    check(ok,"overlapping segment shift");
+}
+/* }}} */
+/* Matrix exponential {{{ */
+static void checkExpm(void) {
+    const double t=10;
+    Matrix<double> r(2,2),er(2,2);
+    r.at(0,1)=-t;
+    r.at(1,0)=t;
+    er.at(0,0)=er.at(1,1)=cos(t);
+    er.at(0,1)=-sin(t);
+    er.at(1,0)=sin(t);
+    check(distance(expm(r),er)<1e-12,"expm rotation");
+    //Taylor series of a matrix of small norm.
+    const int n=6;
+    Matrix<double> a=sample(n,n)*0.3,sum(n,n),term(n,n);
+    for(int i=0;i<n;i++)
+        term.at(i,i)=1;
+    for(int k=1;k<40;k++) {
+        sum=sum+term;
+        term=term*a*(1./k);
+    }
+    check(distance(expm(a),sum)<1e-12,"expm series");
+    //Krylov propagation of a larger matrix, with and without symmetry.
+    const int m=60;
+    Matrix<double> b=sample(m,m)*0.2,c(m,m);
+    for(int i=0;i<m;i++)
+        for(int j=0;j<m;j++)
+            c.at(i,j)=b.at(i,j)+b.at(j,i);
+    Ket<double> v(m);
+    for(int i=0;i<m;i++)
+        v[i]=cos(1.+i);
+    Ket<double> x=expm(b)*v,y=expmv(b,1.,v,10);
+    double d=0;
+    for(int i=0;i<m;i++)
+        d=fmax(d,fabs(x[i]-y[i]));
+    check(d<1e-9,"Krylov propagator");
+    DenseOperator<double> op(c);
+    Propagator<double> p(op,0.5,10,1e-12,true);
+    y=v;
+    p.step(y);
+    p.step(y);
+    x=expm(c)*v;
+    d=0;
+    for(int i=0;i<m;i++)
+        d=fmax(d,fabs(x[i]-y[i]));
+    check(d<1e-9,"Lanczos propagator");
+}
+/* }}} */
+/* Reductions {{{ */
+static void checkReductions(void) {
+    const int n=100003;
+    Ket<double> x(n),y(n);
+    long double s=0,s2=0,sxy=0;
+    for(int i=0;i<n;i++) {
+        x[i]=sin(1.+i);
+        y[i]=0.1;
+        s+=x[i];
+        s2+=(long double)x[i]*x[i];
+        sxy+=(long double)x[i]*y[i];
+    }
+    x[n/3]=-2;
+    s+=-2-sin(1.+n/3);
+    s2+=4-(long double)sin(1.+n/3)*sin(1.+n/3);
+    sxy+=-0.2-0.1L*sin(1.+n/3);
+    check(fabs(sum(x)-(double)s)<1e-9,"plain sum");
+    check(fabs(sum<PairwiseSum>(x)-(double)s)<1e-11,"pairwise sum");
+    check(fabs(sum<KahanSum>(x)-(double)s)<1e-13,"compensated sum");
+    check(fabs(norm2(x)-sqrt((double)s2))<1e-9,"norm");
+    check(fabs(dot(n,x.data(),y.data())-(double)sxy)<1e-9,"dot product");
+    check(sum<KahanSum>(y)==(double)((long double)y[0]*n),
+            "compensated sum of a constant");
+    check(argmax(x)==n/3 && maxAbs(x)==2,"argmax");
+}
+/* }}} */
+/* Banded solve {{{ */
+static void checkBanded(void) {
+    const int n=50;
+    Matrix<double> a(n,n);
+    for(int i=0;i<n;i++)
+        for(int j=(i>2?i-2:0);j<n && j<=i+1;j++)
+            a.at(i,j)=(i==j?4.:sin(1.+i+2*j));
+    Ket<double> x(n);
+    for(int i=0;i<n;i++)
+        x[i]=cos(1.+i);
+    Ket<double> b=a*x;
+    BandedMatrix<double> band(a,2,1);
+    Ket<double> y=band.solve(b);
+    double d=0;
+    for(int i=0;i<n;i++)
+        d=fmax(d,fabs(y[i]-x[i]));
+    check(d<1e-12,"banded solve");
+}
+/* }}} */
+/* Kronecker products {{{ */
+static void checkKron(void) {
+    Matrix<double> x=sample(2,3),y=sample(3,2,1.);
+    Matrix<double> z=kron(x,y);
+    bool ok=(z.n()==6 && z.m()==6);
+    for(int i=0;ok && i<6;i++)
+        for(int j=0;j<6;j++)
+            ok=ok && z.at(i,j)==x.at(i/3,j/2)*y.at(i%3,j%2);
+    check(ok,"kron");
+    Matrix<double> a=sample(3,3),b=sample(4,4,1.),c=sample(2,2,2.);
+    KroneckerOperator<double> op(a,b);
+    op.append(c);
+    Ket<double> v(24);
+    for(int i=0;i<24;i++)
+        v[i]=cos(1.+i);
+    Ket<double> r=kron(kron(a,b),c)*v,l=op*v;
+    double d=0;
+    for(int i=0;i<24;i++)
+        d=fmax(d,fabs(r[i]-l[i]));
+    check(d<1e-12,"lazy Kronecker product");
+}
+/* }}} */
+/* Tensors {{{ */
+static void checkTensors(void) {
+    Matrix<double> a=sample(3,4),b=sample(4,5,1.),c=sample(5,2,2.);
+    Tensor<double> ta(a),tb(b),tc(c);
+    Tensor<double> r=einsum<double>("ij,jk,kl->il",{ta,tb,tc});
+    check(distance(r.matrix(),a*b*c)<1e-12,"einsum chain");
+    Tensor<double> tr=einsum("ij->ji",ta.view());
+    check(distance(tr.matrix(),Matrix<double>(a.transposeView()))==0,
+            "einsum transpose");
+    const int n=37;
+    Tensor<double> t({n,n});
+    for(int i=0;i<n;i++)
+        for(int j=0;j<n;j++)
+            t.at({i,j})=i*n+j;
+    TensorView<double> v(t);
+    v=t.permute({1,0});
+    bool ok=true;
+    for(int i=0;i<n;i++)
+        for(int j=0;j<n;j++)
+            ok=ok && t.at({i,j})==j*n+i;
+    check(ok,"tensor self permute");
+}
+/* }}} */
+/* Tiled matrices {{{ */
+static void checkTiled(void) {
+    string fa=temporary(),fb=temporary(),fc=temporary(),ft=temporary();
+    if(fa.empty() || fb.empty() || fc.empty() || ft.empty())
+        return;
+    Matrix<double> a=sample(37,29),b=sample(29,23,1.);
+    {
+        TiledMatrix<double> ta(fa,37,29,16),tb(fb,29,23,16);
+        TiledMatrix<double> tc(fc,37,23,16),tt(ft,29,37,16);
+        ta.load(a);
+        tb.load(b);
+        check(distance(ta.matrix(),a)==0,"tiled load");
+        gemm(ta,tb,tc);
+        check(distance(tc.matrix(),a*b)<1e-12,"tiled product");
+        transpose(ta,tt);
+        check(distance(tt.matrix(),Matrix<double>(a.transposeView()))==0,
+                "tiled transpose");
+        Ket<double> x(29),y(37);
+        for(int i=0;i<29;i++)
+            x[i]=cos(1.+i);
+        gemv(ta,x.data(),y.data());
+        Ket<double> r=a*x;
+        double d=0;
+        for(int i=0;i<37;i++)
+            d=fmax(d,fabs(r[i]-y[i]));
+        check(d<1e-12,"tiled matrix vector product");
+    }
+    TiledMatrix<double> tc(fc);
+    check(distance(tc.matrix(),a*b)<1e-12,"tiled file round trip");
+    unlink(fa.c_str());
+    unlink(fb.c_str());
+    unlink(fc.c_str());
+    unlink(ft.c_str());
+}
+/* }}} */
+/* Matrix programs {{{ */
+static void checkMatrixPrograms(void) {
+    const int n=6;
+    Matrix<double> a=sample(n,n),b=sample(n,n,1.),c=sample(n,n,2.);
+    Ket<double> k(n);
+    for(int i=0;i<n;i++)
+        k[i]=i+1;
+    Ket<double> ref=a*(b*(c*k));
+    Expression *exp=parseString("A*B*C*k");
+    ShapeDef shapes;
+    Shape sm={valueMatrix,n,n},sk={valueKet,n,1};
+    shapes["A"]=shapes["B"]=shapes["C"]=sm;
+    shapes["k"]=sk;
+    VarDef none;
+    Program p(exp,none,shapes);
+    const double *in[4];
+    in[p.symbol("A")]=a.data();
+    in[p.symbol("B")]=b.data();
+    in[p.symbol("C")]=c.data();
+    in[p.symbol("k")]=k.data();
+    vector<double> out(n);
+    p.evaluate(in,&out[0]);
+    double d=0;
+    for(int i=0;i<n;i++)
+        d=fmax(d,fabs(out[i]-ref[i]));
+    check(d<1e-9,"matrix program");
+    bool thrown=false;
+    try {
+        Shape bad={valueKet,n+1,1};
+        shapes["k"]=bad;
+        Program q(exp,none,shapes);
+    } catch (IncompatibleSizes &) {
+        thrown=true;
+    }
+    check(thrown,"program shape mismatch");
+}
+/* }}} */
+/* Product chains {{{ */
+static void checkChains(void) {
+    const int n=6;
+    Matrix<double> a=sample(n,n),b=sample(n,n,1.),c=sample(n,n,2.);
+    Ket<double> k(n);
+    for(int i=0;i<n;i++)
+        k[i]=i+1;
+    VarDef vars;
+    vars["A"]=new MConstant(a);
+    vars["B"]=new MConstant(b);
+    vars["C"]=new MConstant(c);
+    vars["k"]=new KConstant(k);
+    Ket<double> ref=a*(b*(c*k));
+    Expression *best=reorderProducts(parseString("A*B*C*k"),vars);
+    Expression *res=best->simplify(vars);
+    check(typeid(*res)==typeid(KConstant),"reordered chain shape");
+    if(typeid(*res)==typeid(KConstant)) {
+        const Ket<double> &r=((KConstant*)res)->value();
+        double d=0;
+        for(int i=0;i<n;i++)
+            d=fmax(d,fabs(r[i]-ref[i]));
+        check(d<1e-9,"reordered chain value");
+    }
+}
+/* }}} */
+/* Function registry {{{ */
+/*!\brief Second argument function, registered to check save and load. */
+static double hypot2(const double *x) { return x[0]*x[0]+x[1]*x[1]; }
+static void checkRegistry(void) {
+    FunctionInfo f;
+    f.name="Hypot2";
+    f.nargs=2;
+    f.scalar=hypot2;
+    f.flags=functionPure|functionThreadSafe;
+    if(functionRegistry().find(f.name)<0)
+        functionRegistry().add(f);
+    string file=temporary();
+    if(file.empty())
+        return;
+    VarDef none;
+    {
+        Program s(parseString("Hypot2[X,Y]+1"),none);
+        s.save(file);
+    }
+    Program l(file);
+    double xy[2];
+    xy[l.symbol("X")]=3;
+    xy[l.symbol("Y")]=4;
+    check(l.evaluate(xy)==26,"registered function save and load");
+    unlink(file.c_str());
+}
+/* }}} */
 int main() {
     string s="X+Exp[Y*Z]";
     Expression *exp=parseString(s);
@@ -30,6 +550,26 @@ int main() {
         cerr << "Z found" << endl;
     if(!(exp->find("R")))
         cerr << "R not found" << endl;
-    return 0;
+    checkCodegen();
+    checkStatic();
+    checkBinary();
+    checkPipeline();
+    checkFixed();
+    checkBatch();
+    checkViews();
+    checkExpm();
+    checkBanded();
+    checkReductions();
+    checkKron();
+    checkTensors();
+    checkTiled();
+    checkMatrixPrograms();
+    checkChains();
+    checkRegistry();
+    if(failures>0)
+        cerr << "[E] " << failures << " check(s) failed" << endl;
+    else
+        cerr << "[I] All checks passed" << endl;
+    return (failures>0?1:0);
 }
 /* main.cpp */
@@ -3,7 +3,11 @@
 #define MATRIX_H
 #include <iostream>
 #include "myexceptions.h"
+#include "checking.h"
 #include "vector.h"
+#include "view.h"
+#include "transpose.h"
+#include "kernels.h"
 #include "complex.h"
 using std::endl;
 using std::cerr;
@@ -22,10 +26,36 @@ template <class T> class Matrix {
             _m=m;
             _nm=n*m;
             _data=0;
+            _own=true;
             if(_nm!=0) {
                 _data=new T[_nm];
-                for(int i=0;i<_nm;i++)
-                    _data[i]=0;
+                kernelFill(_nm,_data,(T)0);
+            }
+        };
+        /*!\brief External storage constructor.
+         *
+         * The matrix is a view over data, stored row by row, which is neither
+         * copied nor freed.
+         * Assignment writes into data and cannot resize the matrix, but a
+         * copy constructed matrix owns a copy of the elements.
+         */
+        Matrix(int n, int m, T *data) {
+            _n=n;
+            _m=m;
+            _nm=n*m;
+            _data=data;
+            _own=false;
+        };
+        /*!\brief Copies the elements of a view. */
+        explicit Matrix(const MatrixView<T> &other) {
+            _n=other.n();
+            _m=other.m();
+            _nm=_n*_m;
+            _data=0;
+            _own=true;
+            if(_nm!=0) {
+                _data=new T[_nm];
+                view()=other;
             }
         };
         /* }}} */
@@ -33,7 +63,7 @@ template <class T> class Matrix {
         /*!\brief Destructor. */
         ~Matrix(void) {
             _n=_m=0;
-            if(_nm!=0)
+            if(_nm!=0 && _own)
                 delete[] _data;
             _nm=0;
         };
@@ -45,10 +75,10 @@ template <class T> class Matrix {
             _m=other._m;
             _nm=_n*_m;
             _data=0;
+            _own=true;
             if(_nm!=0) {
                 _data=new T[_nm];
-                for(int i=0;i<_nm;i++)
-                    _data[i]=other._data[i];
+                kernelCopy(_nm,other._data,_data);
             }
         };
         /* }}} */
@@ -73,24 +103,31 @@ template <class T> class Matrix {
         /* }}} */
         /* Access member method {{{ */
         /*!\brief Access member method. */
-        T &at(int i, int j) {
-            if(i<0 || i>=_n || j<0 || j>=_m)
-                throw outOfBounds;
+        T &at(int i, int j) { return get<Checked>(i,j); };
+        /*!\brief Access member method. */
+        T at(int i, int j) const { return get<Checked>(i,j); };
+        /*!\brief Access member method, with checking policy P. */
+        template <class P> T &get(int i, int j) {
+            P::check(i>=0 && i<_n && j>=0 && j<_m);
             return _data[i*_m+j];
         };
-        /*!\brief Access member method. */
-        T at(int i, int j) const {
-            if(i<0 || i>=_n || j<0 || j>=_m)
-                throw outOfBounds;
+        /*!\brief Access member method, with checking policy P. */
+        template <class P> T get(int i, int j) const {
+            P::check(i>=0 && i<_n && j>=0 && j<_m);
             return _data[i*_m+j];
         };
+        /*!\brief Returns a pointer to the elements, stored row by row. */
+        T *data(void) { return _data; };
+        /*!\brief Returns a pointer to the elements, stored row by row. */
+        const T *data(void) const { return _data; };
         /*!\brief Row access method. */
         Bra<T> row(int i) const {
             if(i<0 || i>=_n)
                 throw outOfBounds;
             Bra<T> tmp(_m);
+            T *d=tmp.data();
             for(int j=0;j<_m;j++)
-                tmp[j]=_data[i*_m+j];
+                d[j]=_data[i*_m+j];
             return tmp;
         };
         /*!\brief Column access method. */
@@ -98,20 +135,67 @@ template <class T> class Matrix {
             if(j<0 || j>=_m)
                 throw outOfBounds;
             Ket<T> tmp(_n);
+            T *d=tmp.data();
             for(int i=0;i<_n;i++)
-                tmp[i]=_data[i*_m+j];
+                d[i]=_data[i*_m+j];
             return tmp;
         };
         /* }}} */
+        /* Iterators {{{ */
+        typedef T *iterator;                //!<\brief Contiguous iterator.
+        typedef const T *const_iterator;    //!<\brief Contiguous iterator.
+        /*!\brief Returns an iterator to the first element, the elements
+         * are traversed row by row. */
+        iterator begin(void) { return _data; };
+        /*!\brief Returns an iterator past the last element. */
+        iterator end(void) { return _data+_nm; };
+        /*!\brief Returns an iterator to the first element. */
+        const_iterator begin(void) const { return _data; };
+        /*!\brief Returns an iterator past the last element. */
+        const_iterator end(void) const { return _data+_nm; };
+        /* }}} */
+        /* Views {{{ */
+        /*!\brief Returns a view of the whole matrix. */
+        MatrixView<T> view(void) const { return MatrixView<T>(*this); };
+        /*!\brief Returns a view of row i. */
+        VectorView<T> rowView(int i) const { return view().row(i); };
+        /*!\brief Returns a view of column j. */
+        VectorView<T> colView(int j) const { return view().col(j); };
+        /*!\brief Returns a view of the diagonal. */
+        VectorView<T> diag(void) const { return view().diag(); };
+        /*!\brief Returns a view of the n x m block starting at (i,j). */
+        MatrixView<T> block(int i, int j, int n, int m) const {
+            return view().block(i,j,n,m);
+        };
+        /*!\brief Returns a view of the transposed matrix. */
+        MatrixView<T> transposeView(void) const {
+            return view().transpose();
+        };
+        /* }}} */
         /* Transpose {{{ */
         /*!\brief Returns the transposed matrix. */
         Matrix<T> transpose(void) const {
             Matrix<T> tmp(_m,_n);
-            for(int i=0;i<_n;i++)
-                for(int j=0;j<_m;j++)
-                    tmp._data[j*_n+i]=_data[i*_m+j];
+            transposeCopy(_data,_m,tmp._data,_n,_n,_m);
             return tmp;
         };
+        /*!\brief Transposes the matrix in place, without allocating a
+         * second matrix.
+         *
+         * Square matrices are transposed tile by tile, rectangular ones by
+         * following the cycles of the permutation, which is much slower.
+         */
+        Matrix<T> &transposeInPlace(void) {
+            if(_n==_m) {
+                transposeSquare(_data,_m,_n);
+            } else {
+                transposeCycles(_data,_n,_m);
+                int tmp=_n;
+                _n=_m;
+                _m=tmp;
+            }
+            return *this;
+        };
         /* }}} */
         /* Trace {{{ */
         /*!\brief Returns the matrix trace. */
@@ -163,8 +247,12 @@ template <class T> class Matrix {
         Matrix<T> &operator+=(const Matrix<T> &other) {
             if(_n!=other._n || _m!=other._m)
                 throw incompatibleSizes;
-            for(int i=0;i<_nm;i++)
-                _data[i]+=other._data[i];
+            kernelAdd(_nm,other._data,_data);
+            return *this;
+        };
+        /*!\brief Addition operator. */
+        Matrix<T> &operator+=(const MatrixView<T> &other) {
+            view()+=other;
             return *this;
         };
         /* }}} */
@@ -179,8 +267,12 @@ template <class T> class Matrix {
         Matrix<T> &operator-=(const Matrix<T> &other) {
             if(_n!=other._n || _m!=other._m)
                 throw incompatibleSizes;
-            for(int i=0;i<_nm;i++)
-                _data[i]-=other._data[i];
+            kernelSub(_nm,other._data,_data);
+            return *this;
+        };
+        /*!\brief Substraction operator. */
+        Matrix<T> &operator-=(const MatrixView<T> &other) {
+            view()-=other;
             return *this;
         };
         /* }}} */
@@ -190,13 +282,8 @@ template <class T> class Matrix {
             if(_m!=other._n)
                 throw incompatibleSizes;
             Matrix<T> tmp(_n,other._m);
-            for(int i=0;i<_n;i++) {
-                for(int j=0;j<other._m;j++) {
-                    for(int k=0;k<_n;k++)
-                        tmp._data[i*other._m+j]
-                            +=_data[i*_m+k]*other._data[k*other._m+j];
-                }
-            }
+            gemm(_n,_m,other._m,_data,_m,other._data,other._m,tmp._data,
+                    other._m);
             return tmp;
         };
         /* }}} */
@@ -205,18 +292,27 @@ template <class T> class Matrix {
         Matrix<T> &operator=(const Matrix<T> &other) {
             if(&other!=this) {
                 if(_n!=other._n || _m!=other._m) {
+                    if(!_own)
+                        throw incompatibleSizes;
                     _n=other._n;
                     _m=other._m;
                     _nm=_n*_m;
                     delete[] _data;
                     _data=0;
+                    if(_nm!=0)
+                        _data=new T[_nm];
                 }
-                if(_nm!=0) {
-                    _data=new T[_nm];
-                    for(int i=0;i<_nm;i++)
-                        _data[i]=other._data[i];
-                }
+                kernelCopy(_nm,other._data,_data);
+            }
+            return *this;
+        };
+        /*!\brief Assignement operator, copies the elements of a view. */
+        Matrix<T> &operator=(const MatrixView<T> &other) {
+            if(_n!=other.n() || _m!=other.m()) {
+                Matrix<T> tmp(other);
+                return (*this)=tmp;
             }
+            view()=other;
             return *this;
         };
         /* }}} */
@@ -229,10 +325,8 @@ template <class T> class Matrix {
         };
         /*!\brief Outer product. */
         Matrix<T> &operator*=(const T t) {
-            if(t!=(T)1) {
-                for(int i=0;i<_nm;i++)
-                    _data[i]*=t;
-            }
+            if(t!=(T)1)
+                kernelScale(_nm,t,_data);
             return *this;
         };
         /*!\brief Outer product. */
@@ -251,11 +345,8 @@ template <class T> class Matrix {
         };
         /*!\brief Outer division. */
         Matrix<T> &operator/=(const T t) {
-            if(t!=(T)1) {
-                T tmp=((T)1)/t;
-                for(int i=0;i<_nm;i++)
-                    _data[i]*=tmp;
-            }
+            if(t!=(T)1)
+                kernelScale(_nm,((T)1)/t,_data);
             return *this;
         };
         /* }}} */
@@ -264,12 +355,27 @@ template <class T> class Matrix {
             if(_m!=k.size())
                 throw incompatibleSizes;
             Ket<T> tmp(_n);
-            for(int i=0;i<_n;i++)
-                for(int j=0;j<_m;j++)
-                    tmp[i]+=_data[i*_m+j]*k[j];
+            gemv(_n,_m,_data,_m,k.data(),tmp.data());
             return tmp;
         };
         /* }}} */
+        /* Rank updates {{{ */
+        /*!\brief Rank-1 update, adds alpha*k*b to the matrix. */
+        Matrix<T> &ger(const T alpha, const Ket<T> &k, const Bra<T> &b) {
+            if(_n!=k.size() || _m!=b.size())
+                throw incompatibleSizes;
+            ::ger(_n,_m,alpha,k.data(),b.data(),_data,_m);
+            return *this;
+        };
+        /*!\brief Symmetric rank-k update, sets the matrix to
+         * alpha*a*a^T+beta*this. */
+        Matrix<T> &syrk(const T alpha, const Matrix<T> &a, const T beta=0) {
+            if(_n!=_m || _n!=a._n || &a==this)
+                throw incompatibleSizes;
+            ::syrk(_n,a._m,alpha,a._data,a._m,beta,_data,_m);
+            return *this;
+        };
+        /* }}} */
         /* Comparison {{{ */
         /*!\brief Comparison operator. */
         bool operator==(const Matrix<T> &other) const {
@@ -308,19 +414,23 @@ template <class T> class Matrix {
         int _n;     //!<\brief Number of matrix rows.
         int _m;     //!<\brief Number of matrix columns.
         int _nm;    //!<\brief Size of the array.
+        bool _own;  //!<\brief False if the elements are not owned.
+};
+/* bilinear {{{ */
+/*!\brief Returns b*a*k, without building the intermediate vector. */
+template <class T> T bilinear(const Bra<T> &b, const Matrix<T> &a,
+        const Ket<T> &k) {
+    if(b.size()!=a.n() || a.m()!=k.size())
+        throw incompatibleSizes;
+    return bilinear(a.n(),a.m(),b.data(),a.data(),a.m(),k.data());
 };
+/* }}} */
 /* identity {{{ */
 /*! Return an identity matrix*/
 template <class T> Matrix<T> identity(int n) {
     Matrix<T> tmp(n,n);
-    for(int i=0;i<n;i++) {
-        try {
-            tmp.at(i,i)=(T)1;
-        }
-        catch (exception &e) {
-            cerr << e.what() << endl;
-        }
-    }
+    for(int i=0;i<n;i++)
+        tmp.template get<Unchecked>(i,i)=(T)1;
     return tmp;
 };
 /* }}} */
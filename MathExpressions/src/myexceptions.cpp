@@ -19,7 +19,12 @@
 OutOfBounds outOfBounds;
 IncompatibleSizes incompatibleSizes;
 NotSquare notSquare;
+Singular singular;
+NoConvergence noConvergence;
 UndefVar undefVar;
 IncorExpr incorExpr;
 UnknownFunction unknownFunction;
+CompilationError compilationError;
+BadFormat badFormat;
+AlreadyDefined alreadyDefined;
 /* myexceptions.cpp */
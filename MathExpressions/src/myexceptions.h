@@ -24,6 +24,20 @@ class NotSquare : public exception {
         return "[E] Matrix not square!";
     };
 };
+/*!\brief Singular matrix exception. */
+class Singular : public exception {
+    /*!\brief Print exception error message method. */
+    virtual const char * what() const throw() {
+        return "[E] Singular matrix!";
+    };
+};
+/*!\brief Convergence failure exception. */
+class NoConvergence : public exception {
+    /*!\brief Print exception error message method. */
+    virtual const char * what() const throw() {
+        return "[E] Iterative method did not converge!";
+    };
+};
 /*!\brief Undefinite variable exception. */
 class UndefVar : public exception {
     /*!\brief Print exception error message method. */
@@ -45,11 +59,37 @@ class UnknownFunction : public exception {
         return "[E] Unknown function!";
     };
 };
+/*!\brief Expression compilation failure. */
+class CompilationError : public exception {
+    /*!\brief Print exception error message method. */
+    virtual const char * what() const throw() {
+        return "[E] Expression compilation failed!";
+    };
+};
+/*!\brief Invalid or incompatible binary file. */
+class BadFormat : public exception {
+    /*!\brief Print exception error message method. */
+    virtual const char * what() const throw() {
+        return "[E] Invalid or incompatible file format!";
+    };
+};
+/*!\brief Function already defined. */
+class AlreadyDefined : public exception {
+    /*!\brief Print exception error message method. */
+    virtual const char * what() const throw() {
+        return "[E] Function already defined!";
+    };
+};
 extern OutOfBounds outOfBounds;
 extern IncompatibleSizes incompatibleSizes;
 extern NotSquare notSquare;
+extern Singular singular;
+extern NoConvergence noConvergence;
 extern UndefVar undefVar;
 extern IncorExpr incorExpr;
 extern UnknownFunction unknownFunction;
+extern CompilationError compilationError;
+extern BadFormat badFormat;
+extern AlreadyDefined alreadyDefined;
 #endif //MYEXCEPTIONS_H
 /* myexceptions.h */
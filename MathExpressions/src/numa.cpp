@@ -0,0 +1,172 @@
+/* This file is a part of MathExpression. {{{
+ * Copyright (C) 2012 Romain Dubessy
+ *
+ * MathExpression is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MathExpression is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MathExpression.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * }}} */
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <thread>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#include "myexceptions.h"
+#include "numa.h"
+using std::ifstream;
+/* Cpu lists {{{ */
+vector<int> parseCpuList(const string &list) {
+    vector<int> res;
+    size_t i=0;
+    while(i<list.size() && isspace(list[i]))
+        i++;
+    while(i<list.size() && !isspace(list[i])) {
+        char *end;
+        long first=strtol(list.c_str()+i,&end,10);
+        if(end==list.c_str()+i || first<0)
+            throw badFormat;
+        long last=first;
+        i=end-list.c_str();
+        if(i<list.size() && list[i]=='-') {
+            last=strtol(list.c_str()+i+1,&end,10);
+            if(end==list.c_str()+i+1 || last<first)
+                throw badFormat;
+            i=end-list.c_str();
+        }
+        for(long c=first;c<=last;c++)
+            res.push_back(c);
+        if(i<list.size() && list[i]==',')
+            i++;
+        else if(i<list.size() && !isspace(list[i]))
+            throw badFormat;
+    }
+    return res;
+}
+/*!\brief Reads a cpu list file, returns an empty list on failure. */
+static vector<int> readCpuList(const string &file) {
+    ifstream in(file.c_str());
+    string line;
+    if(!std::getline(in,line))
+        return vector<int>();
+    try {
+        return parseCpuList(line);
+    } catch (exception &) {
+        return vector<int>();
+    }
+}
+/* }}} */
+/* NumaTopology class implementation {{{ */
+NumaTopology::NumaTopology(const string &root) {
+    //Cpus the process may run on.
+    vector<int> allowed;
+    cpu_set_t set;
+    if(sched_getaffinity(0,sizeof(set),&set)==0) {
+        for(int c=0;c<CPU_SETSIZE;c++)
+            if(CPU_ISSET(c,&set))
+                allowed.push_back(c);
+    }
+    if(allowed.empty())
+        allowed=readCpuList(root+"/cpu/online");
+    if(allowed.empty()) {
+        int n=std::thread::hardware_concurrency();
+        for(int c=0;c<(n>0?n:1);c++)
+            allowed.push_back(c);
+    }
+    //Nodes, in increasing order.
+    vector<int> ids;
+    DIR *dir=opendir((root+"/node").c_str());
+    if(dir!=0) {
+        struct dirent *e;
+        while((e=readdir(dir))!=0) {
+            string name=e->d_name;
+            if(name.compare(0,4,"node")==0 && name.size()>4
+                    && isdigit(name[4]))
+                ids.push_back(atoi(name.c_str()+4));
+        }
+        closedir(dir);
+    }
+    std::sort(ids.begin(),ids.end());
+    for(unsigned int k=0;k<ids.size();k++) {
+        char buf[64];
+        snprintf(buf,64,"/node/node%d/cpulist",ids[k]);
+        vector<int> list=readCpuList(root+buf);
+        vector<int> usable;
+        for(unsigned int i=0;i<list.size();i++)
+            if(std::binary_search(allowed.begin(),allowed.end(),list[i]))
+                usable.push_back(list[i]);
+        //Memory only nodes and nodes out of our cpuset are skipped.
+        if(!usable.empty())
+            _cpus.push_back(usable);
+    }
+    if(_cpus.empty())
+        _cpus.push_back(allowed);
+    for(unsigned int k=0;k<_cpus.size();k++)
+        for(unsigned int i=0;i<_cpus[k].size();i++) {
+            const int c=_cpus[k][i];
+            if(c>=(int)_node.size())
+                _node.resize(c+1,-1);
+            _node[c]=k;
+        }
+}
+const vector<int> &NumaTopology::cpus(int node) const {
+    if(node<0 || node>=nodes())
+        throw outOfBounds;
+    return _cpus[node];
+}
+int NumaTopology::node(int cpu) const {
+    return (cpu>=0 && cpu<(int)_node.size()?_node[cpu]:-1);
+}
+vector<int> NumaTopology::affinity(const string &policy,
+        int nthreads) const {
+    vector<int> res;
+    if(policy.empty() || policy=="none" || nthreads<=0)
+        return res;
+    if(policy=="compact") {
+        vector<int> all;
+        for(int k=0;k<nodes();k++)
+            all.insert(all.end(),_cpus[k].begin(),_cpus[k].end());
+        for(int t=0;t<nthreads;t++)
+            res.push_back(all[t%all.size()]);
+    } else if(policy=="scatter") {
+        for(int t=0;t<nthreads;t++) {
+            const vector<int> &c=_cpus[t%nodes()];
+            res.push_back(c[(t/nodes())%c.size()]);
+        }
+    } else {
+        vector<int> list=parseCpuList(policy);
+        if(list.empty())
+            throw badFormat;
+        for(int t=0;t<nthreads;t++)
+            res.push_back(list[t%list.size()]);
+    }
+    return res;
+}
+const NumaTopology &numaTopology(void) {
+    static NumaTopology topology;
+    return topology;
+}
+/* }}} */
+/* pinThread {{{ */
+bool pinThread(int cpu) {
+    if(cpu<0 || cpu>=CPU_SETSIZE)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu,&set);
+    return pthread_setaffinity_np(pthread_self(),sizeof(set),&set)==0;
+}
+/* }}} */
+/* numa.cpp */
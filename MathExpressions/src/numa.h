@@ -0,0 +1,50 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef NUMA_H
+#define NUMA_H
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+/* NumaTopology {{{ */
+/*!\brief NUMA topology of the machine.
+ *
+ * The nodes and their cpus are read from the node directories of sysfs,
+ * keeping only the cpus the process is allowed to run on.
+ * Without NUMA support, all these cpus form a single node.
+ */
+class NumaTopology {
+    public:
+        /*!\brief Default constructor, reads the topology below root. */
+        NumaTopology(const string &root="/sys/devices/system");
+        /*!\brief Returns the number of nodes with usable cpus. */
+        int nodes(void) const { return _cpus.size(); };
+        /*!\brief Returns the cpus of a node, in increasing order. */
+        const vector<int> &cpus(int node) const;
+        /*!\brief Returns the node of a cpu, or -1 if it is not usable. */
+        int node(int cpu) const;
+        /*!\brief Returns the cpu of each of nthreads threads.
+         *
+         * The policy is one of:
+         *  - "compact": fill the cpus of a node before using the next one,
+         *  - "scatter": spread consecutive threads over the nodes,
+         *  - a cpu list, such as "0-3,8", assigned in order,
+         *  - "none" or "": no pinning, the result is empty.
+         * Cpus are reused cyclically if there are more threads than cpus.
+         */
+        vector<int> affinity(const string &policy, int nthreads) const;
+    private:
+        vector<vector<int> > _cpus;     //!<\brief Cpus of each node.
+        vector<int> _node;              //!<\brief Node of each cpu.
+};
+/*!\brief Returns the topology of the machine, read on first use. */
+const NumaTopology &numaTopology(void);
+/*!\brief Parses a cpu list in the sysfs format, like "0-3,8,10-11".
+ *
+ * Throws badFormat if the list is malformed.
+ */
+vector<int> parseCpuList(const string &list);
+/*!\brief Pins the calling thread on a cpu, returns false on failure. */
+bool pinThread(int cpu);
+/* }}} */
+#endif //NUMA_H
+/* numa.h */
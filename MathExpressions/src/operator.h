@@ -0,0 +1,53 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef OPERATOR_H
+#define OPERATOR_H
+#include "myexceptions.h"
+#include "matrix.h"
+#include "kernels.h"
+/* LinearOperator {{{ */
+/*!\brief Pure virtual class that represents a square linear operator.
+ *
+ * Iterative algorithms only need the action of the operator on a vector,
+ * which lets them work on matrix-free operators (sparse, structured or
+ * computed on the fly) as well as on dense matrices.
+ */
+template <class T> class LinearOperator {
+    public:
+        virtual ~LinearOperator(void) {};
+        /*!\brief Returns the dimension of the space. */
+        virtual int size(void) const =0;
+        /*!\brief Computes y=A*x, x and y have size() elements and do not
+         * overlap. */
+        virtual void apply(const T *x, T *y) const =0;
+        /*!\brief Returns A*x. */
+        Ket<T> operator*(const Ket<T> &x) const {
+            if(x.size()!=size())
+                throw incompatibleSizes;
+            Ket<T> y(size());
+            apply(x.data(),y.data());
+            return y;
+        };
+};
+/* }}} */
+/* DenseOperator {{{ */
+/*!\brief Linear operator defined by a dense square matrix.
+ *
+ * The matrix is referenced, not copied.
+ */
+template <class T> class DenseOperator : public LinearOperator<T> {
+    public:
+        /*!\brief Default constructor. */
+        DenseOperator(const Matrix<T> &a) : _a(a) {
+            if(!a.isSquare())
+                throw notSquare;
+        };
+        int size(void) const { return _a.n(); };
+        void apply(const T *x, T *y) const {
+            gemv(_a.n(),_a.m(),_a.data(),_a.m(),x,y);
+        };
+    private:
+        const Matrix<T> &_a;    //!<\brief Matrix.
+};
+/* }}} */
+#endif //OPERATOR_H
+/* operator.h */
@@ -0,0 +1,433 @@
+/* This file is a part of MathExpression. {{{
+ * Copyright (C) 2012 Romain Dubessy
+ *
+ * MathExpression is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MathExpression is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MathExpression.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * }}} */
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <thread>
+#include <exception>
+#include "pipeline.h"
+/* parseNumber {{{ */
+/*!\brief Largest mantissa to which a digit can be appended. */
+#define PARSE_MAX ((~0ULL-9)/10)
+/*!\brief Largest mantissa to which eight digits can be appended. */
+#define PARSE_MAX8 ((~0ULL-99999999ULL)/100000000ULL)
+/*!\brief Returns true if the eight bytes of w are decimal digits. */
+static inline bool eightDigits(unsigned long long w) {
+    return ((w&0xF0F0F0F0F0F0F0F0ULL)
+            |(((w+0x0606060606060606ULL)&0xF0F0F0F0F0F0F0F0ULL)>>4))
+        ==0x3333333333333333ULL;
+}
+/*!\brief Returns the value of eight decimal digits loaded in w, the first
+ * digit being in the lowest byte. */
+static inline unsigned long long eightDigitsValue(unsigned long long w) {
+    w=((w&0x0F0F0F0F0F0F0F0FULL)*2561)>>8;
+    w=((w&0x00FF00FF00FF00FFULL)*6553601)>>16;
+    return ((w&0x0000FFFF0000FFFFULL)*42949672960001ULL)>>32;
+}
+/*!\brief Appends the digits at p to the mantissa m, moving p past them.
+ *
+ * Digits are tested and converted eight at a time in a 64 bit word on
+ * little endian targets. big is set once m cannot hold more digits.
+ * Returns the number of digits read.
+ */
+static int scanDigits(const char *&p, const char *end,
+        unsigned long long &m, bool &big) {
+    const char *b=p;
+#if __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+    while(end-p>=8) {
+        unsigned long long w;
+        memcpy(&w,p,8);
+        if(!eightDigits(w))
+            break;
+        if(m>PARSE_MAX8)
+            big=true;
+        else
+            m=m*100000000ULL+eightDigitsValue(w);
+        p+=8;
+    }
+#endif
+    for(;p<end && *p>='0' && *p<='9';p++) {
+        if(m>PARSE_MAX)
+            big=true;
+        else
+            m=m*10+(*p-'0');
+    }
+    return p-b;
+}
+double parseNumber(const char *&p, const char *end, char delim) {
+    static const double p10[]={1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,
+        1e10,1e11,1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22};
+    while(p<end && (*p==' ' || *p=='\t') && *p!=delim)
+        p++;
+    const char *b=p;
+    bool neg=false;
+    if(p<end && (*p=='-' || *p=='+')) {
+        neg=(*p=='-');
+        p++;
+    }
+    unsigned long long m=0;
+    int exp10=0;
+    bool big=false;
+    bool any=(scanDigits(p,end,m,big)>0);
+    if(p<end && *p=='.') {
+        p++;
+        const int n=scanDigits(p,end,m,big);
+        exp10-=n;
+        any=any || n>0;
+    }
+    if(any && p<end && (*p=='e' || *p=='E')) {
+        const char *q=p+1;
+        bool eneg=false;
+        if(q<end && (*q=='-' || *q=='+')) {
+            eneg=(*q=='-');
+            q++;
+        }
+        if(q<end && *q>='0' && *q<='9') {
+            int e=0;
+            for(;q<end && *q>='0' && *q<='9';q++)
+                if(e<10000)
+                    e=10*e+(*q-'0');
+            exp10+=(eneg?-e:e);
+            p=q;
+        }
+    }
+    if(any && !big && m<=(1ULL<<53) && exp10>=-22 && exp10<=22) {
+        double v=(double)m;
+        v=(exp10<0?v/p10[-exp10]:v*p10[exp10]);
+        return (neg?-v:v);
+    }
+    //Slow path: let strtod handle the whole field.
+    const char *last=b;
+    while(last<end && *last!=delim && *last!='\t' && *last!=' '
+            && *last!='\n' && *last!='\r')
+        last++;
+    string field(b,last);
+    char *stop;
+    double v=strtod(field.c_str(),&stop);
+    if(stop==field.c_str())
+        return nan("");
+    p=b+(stop-field.c_str());
+    return v;
+}
+/* }}} */
+/* CsvReader class implementation {{{ */
+CsvReader::CsvReader(const string &file, char delim, bool header) {
+    _file=fopen(file.c_str(),"rb");
+    if(_file==0)
+        throw badFormat;
+    _delim=delim;
+    _size=1<<20;
+    _buffer=new char[_size];
+    _begin=_end=0;
+    _eof=false;
+    const char *b,*e;
+    if(!line(b,e)) {
+        fclose(_file);
+        delete[] _buffer;
+        throw badFormat;
+    }
+    int k=0;
+    const char *p=b;
+    while(true) {
+        const char *q=p;
+        while(q<e && *q!=_delim)
+            q++;
+        if(header) {
+            const char *l=p;
+            const char *r=q;
+            while(l<r && (*l==' ' || *l=='"'))
+                l++;
+            while(r>l && (r[-1]==' ' || r[-1]=='"'))
+                r--;
+            _names.push_back(string(l,r-l));
+        } else {
+            char name[32];
+            snprintf(name,32,"c%d",k);
+            _names.push_back(string(name));
+        }
+        k++;
+        if(q==e)
+            break;
+        p=q+1;
+    }
+    if(!header)
+        _begin=b-_buffer;
+}
+CsvReader::~CsvReader(void) {
+    fclose(_file);
+    delete[] _buffer;
+}
+/*!\brief Returns the next line in [b,e), false at the end of the file. */
+bool CsvReader::line(const char *&b, const char *&e) {
+    int scanned=_begin;
+    while(true) {
+        const char *nl=(const char*)memchr(_buffer+scanned,'\n',
+                _end-scanned);
+        if(nl!=0 || (_eof && _end>_begin)) {
+            b=_buffer+_begin;
+            e=(nl!=0?nl:_buffer+_end);
+            _begin=e-_buffer+(nl!=0?1:0);
+            if(e>b && e[-1]=='\r')
+                e--;
+            return true;
+        }
+        if(_eof)
+            return false;
+        //Move the partial line to the front, grow for very long lines.
+        scanned=_end-_begin;
+        memmove(_buffer,_buffer+_begin,_end-_begin);
+        _end-=_begin;
+        _begin=0;
+        if(_end==_size) {
+            char *tmp=new char[2*_size];
+            memcpy(tmp,_buffer,_size);
+            delete[] _buffer;
+            _buffer=tmp;
+            _size*=2;
+        }
+        size_t r=fread(_buffer+_end,1,_size-_end,_file);
+        if(r==0)
+            _eof=true;
+        _end+=r;
+    }
+}
+int CsvReader::read(double *cols, int n) {
+    int ncols=_names.size();
+    int rows=0;
+    const char *b,*e;
+    while(rows<n && line(b,e)) {
+        if(b==e)
+            continue;
+        const char *p=b;
+        for(int k=0;k<ncols;k++) {
+            cols[k*n+rows]=parseNumber(p,e,_delim);
+            while(p<e && *p!=_delim)
+                p++;
+            if(p<e)
+                p++;
+        }
+        rows++;
+    }
+    return rows;
+}
+/* }}} */
+/* BinaryReader class implementation {{{ */
+BinaryReader::BinaryReader(const vector<string> &files,
+        const vector<string> &names) {
+    if(files.size()!=names.size() || files.size()==0)
+        throw incompatibleSizes;
+    _names=names;
+    _rows=-1;
+    _row=0;
+    try {
+        for(unsigned int k=0;k<files.size();k++) {
+            _files.push_back(new MappedArray<double>(files[k]));
+            long long rows=(long long)_files[k]->n()*_files[k]->m();
+            if(_rows>=0 && rows!=_rows)
+                throw incompatibleSizes;
+            _rows=rows;
+        }
+    }
+    catch (...) {
+        for(unsigned int k=0;k<_files.size();k++)
+            delete _files[k];
+        throw;
+    }
+}
+BinaryReader::~BinaryReader(void) {
+    for(unsigned int k=0;k<_files.size();k++)
+        delete _files[k];
+}
+int BinaryReader::read(double *cols, int n) {
+    long long rows=_rows-_row;
+    if(rows>n)
+        rows=n;
+    for(unsigned int k=0;k<_files.size();k++) {
+        memcpy(cols+k*n,_files[k]->data()+_row,rows*sizeof(double));
+        _files[k]->discard(_row+rows);
+    }
+    _row+=rows;
+    return rows;
+}
+/* }}} */
+/* CsvWriter class implementation {{{ */
+CsvWriter::CsvWriter(const string &file, const vector<string> &names,
+        char delim) {
+    _file=fopen(file.c_str(),"wb");
+    if(_file==0)
+        throw badFormat;
+    _delim=delim;
+    _ncols=names.size();
+    for(int k=0;k<_ncols;k++)
+        fprintf(_file,"%s%c",names[k].c_str(),(k+1<_ncols?_delim:'\n'));
+}
+CsvWriter::~CsvWriter(void) {
+    if(_file!=0)
+        fclose(_file);
+}
+void CsvWriter::write(const double *cols, int n) {
+    for(int i=0;i<n;i++)
+        for(int k=0;k<_ncols;k++)
+            fprintf(_file,"%.17g%c",cols[k*n+i],(k+1<_ncols?_delim:'\n'));
+    if(ferror(_file))
+        throw badFormat;
+}
+void CsvWriter::close(void) {
+    int res=fclose(_file);
+    _file=0;
+    if(res!=0)
+        throw badFormat;
+}
+/* }}} */
+/* BinaryWriter class implementation {{{ */
+BinaryWriter::BinaryWriter(const vector<string> &files) {
+    try {
+        for(unsigned int k=0;k<files.size();k++)
+            _files.push_back(new ArrayWriter<double>(files[k],1,arrayKet));
+    }
+    catch (...) {
+        for(unsigned int k=0;k<_files.size();k++)
+            delete _files[k];
+        throw;
+    }
+}
+BinaryWriter::~BinaryWriter(void) {
+    for(unsigned int k=0;k<_files.size();k++)
+        delete _files[k];
+}
+void BinaryWriter::write(const double *cols, int n) {
+    for(unsigned int k=0;k<_files.size();k++)
+        _files[k]->write(cols+k*n,n);
+}
+void BinaryWriter::close(void) {
+    for(unsigned int k=0;k<_files.size();k++)
+        _files[k]->close();
+}
+/* }}} */
+/* Pipeline class implementation {{{ */
+/*!\brief Block of rows travelling through the pipeline. */
+struct Chunk {
+    double *in;     //!<\brief Input columns, stride is the chunk size.
+    double *out;    //!<\brief Output columns, stride is the row count.
+    int rows;       //!<\brief Number of rows.
+};
+Pipeline::Pipeline(const vector<Program *> &programs, int chunk, int depth) {
+    if(chunk<=0 || depth<=0)
+        throw outOfBounds;
+    _programs=programs;
+    _chunk=chunk;
+    _depth=depth;
+}
+long long Pipeline::run(ColumnReader &in, ColumnWriter &out) {
+    const vector<string> &names=in.names();
+    int np=_programs.size();
+    int chunk=_chunk;
+    //Bind the program symbols to the input columns.
+    vector<vector<int> > bind(np);
+    for(int p=0;p<np;p++) {
+        if(!_programs[p]->isScalar())
+            throw incompatibleSizes;
+        for(int k=0;k<_programs[p]->nsymbols();k++) {
+            string s=_programs[p]->symbol(k);
+            unsigned int c=0;
+            while(c<names.size() && names[c]!=s)
+                c++;
+            if(c==names.size())
+                throw undefVar;
+            bind[p].push_back(c);
+        }
+    }
+    vector<Chunk> chunks(_depth);
+    BoundedQueue<Chunk *> idle(_depth),full(_depth),done(_depth);
+    for(int i=0;i<_depth;i++) {
+        chunks[i].in=new double[names.size()*chunk];
+        chunks[i].out=new double[np*chunk];
+        idle.push(&chunks[i]);
+    }
+    std::exception_ptr error[3];
+    long long total=0;
+    std::thread reader([&]() {
+        try {
+            Chunk *c;
+            while(idle.pop(c)) {
+                c->rows=in.read(c->in,chunk);
+                if(c->rows==0)
+                    break;
+                full.push(c);
+            }
+        }
+        catch (...) {
+            error[0]=std::current_exception();
+            idle.close();
+            done.close();
+        }
+        full.close();
+    });
+    std::thread evaluator([&]() {
+        try {
+            vector<const double *> x;
+            Chunk *c;
+            while(full.pop(c)) {
+                for(int p=0;p<np;p++) {
+                    x.resize(bind[p].size()+1);
+                    for(unsigned int k=0;k<bind[p].size();k++)
+                        x[k]=c->in+bind[p][k]*chunk;
+                    _programs[p]->evaluate(c->rows,&x[0],
+                            c->out+p*c->rows);
+                }
+                done.push(c);
+            }
+        }
+        catch (...) {
+            error[1]=std::current_exception();
+            idle.close();
+            full.close();
+        }
+        done.close();
+    });
+    std::thread writer([&]() {
+        try {
+            Chunk *c;
+            while(done.pop(c)) {
+                out.write(c->out,c->rows);
+                total+=c->rows;
+                idle.push(c);
+            }
+        }
+        catch (...) {
+            error[2]=std::current_exception();
+            idle.close();
+            full.close();
+            done.close();
+        }
+    });
+    reader.join();
+    evaluator.join();
+    writer.join();
+    for(int i=0;i<_depth;i++) {
+        delete[] chunks[i].in;
+        delete[] chunks[i].out;
+    }
+    for(int i=0;i<3;i++)
+        if(error[i])
+            std::rethrow_exception(error[i]);
+    out.close();
+    return total;
+}
+/* }}} */
+/* pipeline.cpp */
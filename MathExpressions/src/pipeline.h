@@ -0,0 +1,198 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef PIPELINE_H
+#define PIPELINE_H
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdio>
+#include <mutex>
+#include <condition_variable>
+#include "program.h"
+#include "binaryio.h"
+using std::string;
+using std::vector;
+/*!\brief Parses a decimal number, moving p past it.
+ *
+ * Plain decimal numbers with a mantissa up to 2^53 and a power of ten up to
+ * 22 are converted without calling strtod, the digits being scanned eight
+ * at a time. Other inputs (nan, inf, long mantissas, large exponents) fall
+ * back to strtod on the field, which ends at delim, a blank or the end of
+ * the line.
+ * An empty field gives a NaN.
+ */
+double parseNumber(const char *&p, const char *end, char delim=',');
+/* BoundedQueue {{{ */
+/*!\brief Blocking FIFO queue of bounded capacity. */
+template <class T> class BoundedQueue {
+    public:
+        /*!\brief Default constructor. */
+        BoundedQueue(int capacity) { _capacity=capacity; _closed=false; };
+        /*!\brief Pushes an element, waits while the queue is full. */
+        void push(const T &t) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while((int)_queue.size()>=_capacity && !_closed)
+                _full.wait(lock);
+            _queue.push_back(t);
+            _empty.notify_one();
+        };
+        /*!\brief Pops an element, returns false if the queue is closed and
+         * empty. */
+        bool pop(T &t) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while(_queue.empty() && !_closed)
+                _empty.wait(lock);
+            if(_queue.empty())
+                return false;
+            t=_queue.front();
+            _queue.pop_front();
+            _full.notify_one();
+            return true;
+        };
+        /*!\brief Closes the queue, waking up all waiting threads. */
+        void close(void) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _closed=true;
+            _empty.notify_all();
+            _full.notify_all();
+        };
+    private:
+        std::deque<T> _queue;           //!<\brief Queued elements.
+        int _capacity;                  //!<\brief Maximal size.
+        bool _closed;                   //!<\brief True once closed.
+        std::mutex _mutex;              //!<\brief Queue lock.
+        std::condition_variable _empty; //!<\brief Signaled on push.
+        std::condition_variable _full;  //!<\brief Signaled on pop.
+};
+/* }}} */
+/* ColumnReader {{{ */
+/*!\brief Pure virtual class that represents a source of numeric columns. */
+class ColumnReader {
+    public:
+        virtual ~ColumnReader(void) {};
+        /*!\brief Returns the column names. */
+        virtual const vector<string> &names(void) const =0;
+        /*!\brief Reads at most n rows.
+         *
+         * Column k is stored in cols[k*n], the method returns the number of
+         * rows read, 0 at the end of the input.
+         */
+        virtual int read(double *cols, int n) =0;
+};
+/*!\brief Reads numeric columns from a delimited text file.
+ *
+ * The file is read by blocks of fixed size, so that memory use does not
+ * depend on the file size.
+ * If there is no header line, columns are named c0, c1...
+ */
+class CsvReader : public ColumnReader {
+    public:
+        /*!\brief Default constructor. */
+        CsvReader(const string &file, char delim=',', bool header=true);
+        ~CsvReader(void);
+        const vector<string> &names(void) const { return _names; };
+        int read(double *cols, int n);
+    private:
+        CsvReader(const CsvReader &);
+        CsvReader &operator=(const CsvReader &);
+        bool line(const char *&b, const char *&e);
+        FILE *_file;            //!<\brief Input file.
+        char _delim;            //!<\brief Field delimiter.
+        vector<string> _names;  //!<\brief Column names.
+        char *_buffer;          //!<\brief Read buffer.
+        int _size;              //!<\brief Buffer capacity.
+        int _begin;             //!<\brief First unread byte.
+        int _end;               //!<\brief End of the buffered bytes.
+        bool _eof;              //!<\brief True once the file is read.
+};
+/*!\brief Reads numeric columns from binary Ket files, one per column.
+ *
+ * The files are mapped in memory (see MappedArray) and read sequentially.
+ */
+class BinaryReader : public ColumnReader {
+    public:
+        /*!\brief Default constructor. */
+        BinaryReader(const vector<string> &files, const vector<string> &names);
+        ~BinaryReader(void);
+        const vector<string> &names(void) const { return _names; };
+        int read(double *cols, int n);
+    private:
+        BinaryReader(const BinaryReader &);
+        BinaryReader &operator=(const BinaryReader &);
+        vector<MappedArray<double> *> _files;   //!<\brief Input files.
+        vector<string> _names;  //!<\brief Column names.
+        long long _rows;        //!<\brief Number of rows.
+        long long _row;         //!<\brief Next row to read.
+};
+/* }}} */
+/* ColumnWriter {{{ */
+/*!\brief Pure virtual class that represents a sink of numeric columns. */
+class ColumnWriter {
+    public:
+        virtual ~ColumnWriter(void) {};
+        /*!\brief Writes n rows, column k is stored in cols[k*n]. */
+        virtual void write(const double *cols, int n) =0;
+        /*!\brief Flushes and closes the output. */
+        virtual void close(void) =0;
+};
+/*!\brief Writes numeric columns to a delimited text file. */
+class CsvWriter : public ColumnWriter {
+    public:
+        /*!\brief Default constructor, writes a header line with the names. */
+        CsvWriter(const string &file, const vector<string> &names,
+                char delim=',');
+        ~CsvWriter(void);
+        void write(const double *cols, int n);
+        void close(void);
+    private:
+        CsvWriter(const CsvWriter &);
+        CsvWriter &operator=(const CsvWriter &);
+        FILE *_file;    //!<\brief Output file.
+        char _delim;    //!<\brief Field delimiter.
+        int _ncols;     //!<\brief Number of columns.
+};
+/*!\brief Writes numeric columns to binary Ket files, one per column. */
+class BinaryWriter : public ColumnWriter {
+    public:
+        /*!\brief Default constructor. */
+        BinaryWriter(const vector<string> &files);
+        ~BinaryWriter(void);
+        void write(const double *cols, int n);
+        void close(void);
+    private:
+        BinaryWriter(const BinaryWriter &);
+        BinaryWriter &operator=(const BinaryWriter &);
+        vector<ArrayWriter<double> *> _files;   //!<\brief Output files.
+};
+/* }}} */
+/* Pipeline {{{ */
+/*!\brief Streaming evaluation of programs over columnar data.
+ *
+ * Input columns are bound to program symbols by name.
+ * Reading, evaluation and writing run on three threads exchanging a fixed
+ * number of chunks through bounded queues, so that memory use only depends
+ * on the chunk size and the queue depth.
+ */
+class Pipeline {
+    public:
+        /*!\brief Default constructor.
+         *
+         * \param programs Programs evaluated, one per output column.
+         * \param chunk Number of rows per chunk.
+         * \param depth Number of chunks in flight.
+         */
+        Pipeline(const vector<Program *> &programs, int chunk=65536,
+                int depth=4);
+        /*!\brief Evaluates the programs over the whole input.
+         *
+         * Exceptions raised by any of the threads are rethrown.
+         * \return The number of rows processed.
+         */
+        long long run(ColumnReader &in, ColumnWriter &out);
+    private:
+        vector<Program *> _programs;    //!<\brief Output programs.
+        int _chunk;                     //!<\brief Rows per chunk.
+        int _depth;                     //!<\brief Chunks in flight.
+};
+/* }}} */
+#endif //PIPELINE_H
+/* pipeline.h */
@@ -0,0 +1,232 @@
+/* This file is a part of MathExpression. {{{
+ * Copyright (C) 2012 Romain Dubessy
+ *
+ * MathExpression is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MathExpression is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MathExpression.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * }}} */
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "expression.h"
+#include "registry.h"
+Profiler profiler;
+/* now {{{ */
+/*!\brief Returns a monotonic time, in seconds. */
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC,&t);
+    return t.tv_sec+1e-9*t.tv_nsec;
+}
+/* }}} */
+/* ProfileCounters implementation {{{ */
+ProfileCounters::ProfileCounters(void) {
+    nodes=simplify=allocations=lookups=0;
+    for(int i=0;i<PROFILE_NFUNC;i++)
+        calls[i]=0;
+    for(int i=0;i<nPhases;i++)
+        time[i]=0;
+}
+ProfileCounters ProfileCounters::operator-(
+        const ProfileCounters &other) const {
+    ProfileCounters tmp(*this);
+    tmp.nodes-=other.nodes;
+    tmp.simplify-=other.simplify;
+    tmp.allocations-=other.allocations;
+    tmp.lookups-=other.lookups;
+    for(int i=0;i<PROFILE_NFUNC;i++)
+        tmp.calls[i]-=other.calls[i];
+    for(int i=0;i<nPhases;i++)
+        tmp.time[i]-=other.time[i];
+    return tmp;
+}
+ProfileCounters &ProfileCounters::operator+=(const ProfileCounters &other) {
+    nodes+=other.nodes;
+    simplify+=other.simplify;
+    allocations+=other.allocations;
+    lookups+=other.lookups;
+    for(int i=0;i<PROFILE_NFUNC;i++)
+        calls[i]+=other.calls[i];
+    for(int i=0;i<nPhases;i++)
+        time[i]+=other.time[i];
+    return *this;
+}
+ostream &operator<<(ostream &os, const ProfileCounters &c) {
+    const char *phases[]={"parse","simplify","evaluate"};
+    os << "nodes visited     : " << c.nodes << "\n"
+        << "simplify calls    : " << c.simplify << "\n"
+        << "allocations       : " << c.allocations << "\n"
+        << "variable lookups  : " << c.lookups << "\n";
+    const FunctionRegistry &reg=functionRegistry();
+    for(int i=0;i<reg.size() && i<PROFILE_NFUNC;i++)
+        if(c.calls[i]>0)
+            os << "calls to " << reg[i].name
+                << string(reg[i].name.size()<9?9-reg[i].name.size():0,' ')
+                << ": " << c.calls[i] << "\n";
+    for(int i=0;i<nPhases;i++)
+        os << "time in " << phases[i] << string(10-strlen(phases[i]),' ')
+            << ": " << c.time[i] << " s\n";
+    return os;
+}
+/* }}} */
+/* Profiler class implementation {{{ */
+thread_local Profiler::Slot *Profiler::_local=0;
+/*!\brief Releases the profiler slot of a thread when it exits. */
+struct ProfileRelease {
+    ~ProfileRelease(void) {
+        if(Profiler::_local!=0)
+            profiler.release(Profiler::_local);
+        Profiler::_local=0;
+    };
+};
+static thread_local ProfileRelease profileRelease;
+Profiler::Profiler(void) {
+}
+void Profiler::start(Phase p) {
+    if(_local==0)
+        _local=attach();
+    if(_local->depth[p]++==0)
+        _local->start[p]=now();
+}
+void Profiler::stop(Phase p) {
+    if(--_local->depth[p]==0)
+        _local->counters.time[p]+=now()-_local->start[p];
+}
+void Profiler::reset(void) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for(unsigned int k=0;k<_slots.size();k++)
+        _slots[k].counters=ProfileCounters();
+}
+ProfileCounters Profiler::counters(void) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ProfileCounters c;
+    for(unsigned int k=0;k<_slots.size();k++)
+        c+=_slots[k].counters;
+    return c;
+}
+Profiler::Slot *Profiler::attach(void) {
+    (void)profileRelease;
+    std::lock_guard<std::mutex> lock(_mutex);
+    unsigned int k=0;
+    while(k<_slots.size() && _slots[k].used)
+        k++;
+    if(k==_slots.size())
+        _slots.push_back(Slot());
+    Slot &s=_slots[k];
+    s.used=true;
+    for(int i=0;i<nPhases;i++) {
+        s.depth[i]=0;
+        s.start[i]=0;
+    }
+    return &s;
+}
+void Profiler::release(Slot *s) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    s->used=false;
+}
+/* }}} */
+/* PerfCounters class implementation {{{ */
+PerfCounters::PerfCounters(void) {
+    const unsigned long long config[]={PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,PERF_COUNT_HW_CACHE_REFERENCES,
+        PERF_COUNT_HW_CACHE_MISSES,PERF_COUNT_HW_BRANCH_MISSES};
+    for(int i=0;i<nEvents;i++) {
+        _fd[i]=-1;
+        _value[i]=0;
+    }
+    for(int i=0;i<nEvents;i++) {
+        struct perf_event_attr attr;
+        memset(&attr,0,sizeof(attr));
+        attr.size=sizeof(attr);
+        attr.type=PERF_TYPE_HARDWARE;
+        attr.config=config[i];
+        attr.disabled=(i==0);
+        attr.exclude_kernel=1;
+        attr.exclude_hv=1;
+        //The first event leads the group, the others follow it.
+        _fd[i]=syscall(__NR_perf_event_open,&attr,0,-1,
+                (i==0?-1:_fd[0]),0);
+        if(_fd[i]<0 && i==0)
+            return;
+    }
+}
+PerfCounters::~PerfCounters(void) {
+    for(int i=0;i<nEvents;i++)
+        if(_fd[i]>=0)
+            close(_fd[i]);
+}
+void PerfCounters::start(void) {
+    if(!available())
+        return;
+    ioctl(_fd[0],PERF_EVENT_IOC_RESET,PERF_IOC_FLAG_GROUP);
+    ioctl(_fd[0],PERF_EVENT_IOC_ENABLE,PERF_IOC_FLAG_GROUP);
+}
+void PerfCounters::stop(void) {
+    if(!available())
+        return;
+    ioctl(_fd[0],PERF_EVENT_IOC_DISABLE,PERF_IOC_FLAG_GROUP);
+    for(int i=0;i<nEvents;i++) {
+        unsigned long long v=0;
+        if(_fd[i]>=0 && read(_fd[i],&v,sizeof(v))!=sizeof(v))
+            v=0;
+        _value[i]=v;
+    }
+}
+ostream &operator<<(ostream &os, const PerfCounters &c) {
+    const char *names[]={"cycles","instructions","cache references",
+        "cache misses","branch misses"};
+    if(!c.available())
+        return os << "hardware counters unavailable\n";
+    for(int i=0;i<PerfCounters::nEvents;i++)
+        os << names[i] << string(18-strlen(names[i]),' ') << ": "
+            << c._value[i] << "\n";
+    return os;
+}
+/* }}} */
+/* profile {{{ */
+ExpressionProfile profile(Expression *exp, VarDef &vars, int repeat) {
+    ExpressionProfile p;
+    PerfCounters perf;
+    ProfileCounters before=profiler.counters();
+    double t0=now();
+    perf.start();
+    for(int i=0;i<repeat;i++)
+        delete (double*)exp->evaluate(vars);
+    perf.stop();
+    p.time=(now()-t0)/(repeat>0?repeat:1);
+    p.counters=profiler.counters()-before;
+    p.repeat=repeat;
+    p.hasPerf=perf.available();
+    for(int i=0;i<PerfCounters::nEvents;i++)
+        p.perf[i]=perf.value((PerfCounters::Event)i);
+    return p;
+}
+ostream &operator<<(ostream &os, const ExpressionProfile &p) {
+    const char *names[]={"cycles","instructions","cache references",
+        "cache misses","branch misses"};
+    os << "evaluations       : " << p.repeat << "\n"
+        << "time/evaluation   : " << p.time << " s\n" << p.counters;
+    if(p.hasPerf) {
+        for(int i=0;i<PerfCounters::nEvents;i++)
+            os << names[i] << string(18-strlen(names[i]),' ') << ": "
+                << p.perf[i] << "\n";
+    } else {
+        os << "hardware counters unavailable\n";
+    }
+    return os;
+}
+/* }}} */
+/* profiler.cpp */
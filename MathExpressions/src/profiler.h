@@ -0,0 +1,173 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef PROFILER_H
+#define PROFILER_H
+#include <iostream>
+#include <string>
+#include <map>
+#include <deque>
+#include <mutex>
+using std::ostream;
+using std::string;
+using std::map;
+class Expression;
+typedef map<string,Expression *> VarDef;
+/*!\brief Profiled phases. */
+enum Phase {
+    phaseParse,
+    phaseSimplify,
+    phaseEvaluate,
+    nPhases
+};
+/*!\brief Maximal number of profiled functions. */
+#define PROFILE_NFUNC 64
+/* ProfileCounters {{{ */
+/*!\brief Hot path counters. */
+struct ProfileCounters {
+    unsigned long long nodes;       //!<\brief Nodes visited.
+    unsigned long long simplify;    //!<\brief Calls to simplify.
+    unsigned long long allocations; //!<\brief Nodes and values allocated.
+    unsigned long long lookups;     //!<\brief VarDef lookups.
+    unsigned long long calls[PROFILE_NFUNC];    //!<\brief Function calls.
+    double time[nPhases];           //!<\brief Time spent in each phase.
+    /*!\brief Default constructor, all counters are zero. */
+    ProfileCounters(void);
+    /*!\brief Difference of two snapshots. */
+    ProfileCounters operator-(const ProfileCounters &other) const;
+    /*!\brief Adds the counters of another thread. */
+    ProfileCounters &operator+=(const ProfileCounters &other);
+    /*!\brief Writes a human readable report. */
+    friend ostream &operator<<(ostream &os, const ProfileCounters &c);
+};
+/* }}} */
+/* Profiler {{{ */
+/*!\brief Global hot path instrumentation.
+ *
+ * The library is instrumented with the PROFILE_* macros, which are empty
+ * unless MATHEXPR_PROFILE is defined (ie 'make PROFILE=1'), so that the
+ * instrumentation costs nothing in production builds.
+ * Each thread updates its own counters and phase depths, without
+ * synchronization; counters() sums the counters of all the threads and
+ * should be read, like reset() called, while no other thread is
+ * evaluating. Phase times are summed over the threads as well.
+ */
+class Profiler {
+    public:
+        /*!\brief Default constructor. */
+        Profiler(void);
+        /*!\brief Enters a phase, nested entries are not timed twice. */
+        void start(Phase p);
+        /*!\brief Leaves a phase. */
+        void stop(Phase p);
+        /*!\brief Resets the counters of all the threads. */
+        void reset(void);
+        /*!\brief Returns the counters of the calling thread. */
+        ProfileCounters &local(void) {
+            if(_local==0)
+                _local=attach();
+            return _local->counters;
+        };
+        /*!\brief Returns the sum of the counters of all the threads. */
+        ProfileCounters counters(void) const;
+        /*!\brief Writes a human readable report. */
+        void report(ostream &os) const { os << counters(); };
+    private:
+        Profiler(const Profiler &);
+        Profiler &operator=(const Profiler &);
+        /*!\brief Counters and phases of a thread. */
+        struct Slot {
+            ProfileCounters counters;   //!<\brief Counters.
+            int depth[nPhases];         //!<\brief Nesting depth of phases.
+            double start[nPhases];      //!<\brief Entry time of phases.
+            bool used;                  //!<\brief Owned by a thread.
+        };
+        friend struct ProfileRelease;
+        /*!\brief Returns a slot for the calling thread. */
+        Slot *attach(void);
+        /*!\brief Gives back the slot of an exiting thread, its counters are
+         * kept. */
+        void release(Slot *s);
+        static thread_local Slot *_local;   //!<\brief Calling thread slot.
+        std::deque<Slot> _slots;            //!<\brief Slots, reused.
+        mutable std::mutex _mutex;          //!<\brief Protects _slots.
+};
+extern Profiler profiler;
+/*!\brief Enters a phase for the lifetime of the object. */
+class PhaseTimer {
+    public:
+        /*!\brief Default constructor. */
+        PhaseTimer(Phase p) { _p=p; profiler.start(p); };
+        ~PhaseTimer(void) { profiler.stop(_p); };
+    private:
+        Phase _p;   //!<\brief Timed phase.
+};
+#ifdef MATHEXPR_PROFILE
+#define PROFILE_COUNT(c) (profiler.local().c++)
+#define PROFILE_ADD(c,n) (profiler.local().c+=(n))
+#define PROFILE_CALL(i,n) (profiler.local().calls[(i)%PROFILE_NFUNC]+=(n))
+#define PROFILE_PHASE(p) PhaseTimer phaseTimer(p)
+#else
+#define PROFILE_COUNT(c)
+#define PROFILE_ADD(c,n)
+#define PROFILE_CALL(i,n)
+#define PROFILE_PHASE(p)
+#endif
+/* }}} */
+/* PerfCounters {{{ */
+/*!\brief Hardware performance counters of the calling thread.
+ *
+ * Counters are read with the Linux perf_event_open system call.
+ * If it is not available (kernel.perf_event_paranoid, containers...),
+ * available() returns false and all values are zero.
+ */
+class PerfCounters {
+    public:
+        /*!\brief Hardware events. */
+        enum Event {
+            cycles,
+            instructions,
+            cacheReferences,
+            cacheMisses,
+            branchMisses,
+            nEvents
+        };
+        /*!\brief Default constructor, opens the counters. */
+        PerfCounters(void);
+        ~PerfCounters(void);
+        /*!\brief Returns true if the counters could be opened. */
+        bool available(void) const { return _fd[0]>=0; };
+        /*!\brief Resets and starts counting. */
+        void start(void);
+        /*!\brief Stops counting and reads the values. */
+        void stop(void);
+        /*!\brief Returns the value of an event. */
+        unsigned long long value(Event e) const { return _value[e]; };
+        /*!\brief Writes a human readable report. */
+        friend ostream &operator<<(ostream &os, const PerfCounters &c);
+    private:
+        PerfCounters(const PerfCounters &);
+        PerfCounters &operator=(const PerfCounters &);
+        int _fd[nEvents];                       //!<\brief Event descriptors.
+        unsigned long long _value[nEvents];     //!<\brief Last values.
+};
+/* }}} */
+/* ExpressionProfile {{{ */
+/*!\brief Profile of the evaluation of a single expression. */
+struct ExpressionProfile {
+    int repeat;                 //!<\brief Number of evaluations.
+    double time;                //!<\brief Wall time per evaluation, in s.
+    ProfileCounters counters;   //!<\brief Counters, for all evaluations.
+    unsigned long long perf[PerfCounters::nEvents]; //!<\brief Hardware
+                                                    //!< counters.
+    bool hasPerf;               //!<\brief False if perf is unavailable.
+    /*!\brief Writes a human readable report. */
+    friend ostream &operator<<(ostream &os, const ExpressionProfile &p);
+};
+/*!\brief Evaluates a scalar expression repeat times and profiles it.
+ *
+ * Software counters are only filled if the library was built with
+ * MATHEXPR_PROFILE.
+ */
+ExpressionProfile profile(Expression *exp, VarDef &vars, int repeat=1);
+/* }}} */
+#endif //PROFILER_H
+/* profiler.h */
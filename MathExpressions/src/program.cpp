@@ -0,0 +1,1143 @@
+/* This file is a part of MathExpression. {{{
+ * Copyright (C) 2012 Romain Dubessy
+ *
+ * MathExpression is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MathExpression is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MathExpression.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * }}} */
+#include <typeinfo>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "program.h"
+#include "registry.h"
+using std::vector;
+#define PROGRAM_VERSION 3
+/*!\brief Number of elements of the blocks of fused regions. */
+#define FUSED_BLOCK 256
+/*!\brief Maximal number of elements of a value, so that its size in bytes
+ * fits in a long long. */
+#define PROGRAM_ELEMENTS (LLONG_MAX/(long long)sizeof(double))
+/*!\brief Instruction codes of fused regions. */
+enum FusedCode {
+    fuseLoad,       //!<\brief Push array leaf arg.
+    fuseScale,      //!<\brief Multiply the top by scalar leaf arg.
+    fuseDivide,     //!<\brief Divide the top by scalar leaf arg.
+    fuseAdd,        //!<\brief Pop two blocks, push their sum.
+    fuseSub,        //!<\brief Pop two blocks, push their difference.
+    fuseCall        //!<\brief Apply function arg to the top.
+};
+/* Shapes {{{ */
+/*!\brief Returns true if a shape is consistent with its kind. */
+static bool validShape(const Shape &s) {
+    if(s.n<=0 || s.m<=0 || (long long)s.n*s.m>PROGRAM_ELEMENTS)
+        return false;
+    switch(s.kind) {
+        case valueScalar:
+            return s.n==1 && s.m==1;
+        case valueBra:
+            return s.n==1;
+        case valueKet:
+            return s.m==1;
+        case valueMatrix:
+            return true;
+    }
+    return false;
+}
+/*!\brief Returns the shape of a scalar. */
+static Shape scalarShape(void) {
+    Shape s;
+    s.kind=valueScalar;
+    s.n=s.m=1;
+    return s;
+}
+/*!\brief Returns the shape of the result of a binary operation.
+ *
+ * The rules follow BinaryOp::simplify: arrays are scaled by scalars, added
+ * to arrays of the same shape, and multiplied following the matrix product
+ * rules (bra*ket is a scalar, ket*bra a matrix).
+ */
+static Shape binaryShape(unsigned int code, const Shape &a, const Shape &b) {
+    if(a.kind==valueScalar && b.kind==valueScalar)
+        return a;
+    switch(code) {
+        case opAdd:
+        case opSub:
+            if(a.kind!=b.kind || a.n!=b.n || a.m!=b.m)
+                throw incompatibleSizes;
+            return a;
+        case opDiv:
+            if(b.kind!=valueScalar)
+                throw incompatibleSizes;
+            return a;
+        case opMul:
+            {
+                if(a.kind==valueScalar)
+                    return b;
+                if(b.kind==valueScalar)
+                    return a;
+                if(a.m!=b.n)
+                    throw incompatibleSizes;
+                Shape res;
+                res.n=a.n;
+                res.m=b.m;
+                if(a.kind==valueBra && b.kind==valueKet)
+                    return scalarShape();
+                else if(a.kind==valueKet && b.kind==valueBra)
+                    res.kind=valueMatrix;
+                else if(a.kind==valueMatrix && b.kind==valueMatrix)
+                    res.kind=valueMatrix;
+                else if(a.kind==valueMatrix && b.kind==valueKet)
+                    res.kind=valueKet;
+                else if(a.kind==valueBra && b.kind==valueMatrix)
+                    res.kind=valueBra;
+                else
+                    throw incompatibleSizes;
+                if(!validShape(res))
+                    throw incompatibleSizes;
+                return res;
+            }
+    }
+    throw incompatibleSizes;
+}
+/*!\brief Returns true if node i is an elementwise operation on arrays. */
+static bool elementwise(const vector<ProgramNode> &nodes, int i) {
+    const ProgramNode &node=nodes[i];
+    if(node.shape.kind==valueScalar)
+        return false;
+    switch(node.code) {
+        case opAdd:
+        case opSub:
+        case opDiv:
+        case opCall:
+            return true;
+        case opMul:
+            return nodes[node.left].shape.kind==valueScalar
+                || nodes[node.right].shape.kind==valueScalar;
+    }
+    return false;
+}
+/* }}} */
+/* reorderProducts {{{ */
+/*!\brief Returns the instruction code of a binary operator. */
+static unsigned int binaryCode(char c) {
+    switch(c) {
+        case '+':
+            return opAdd;
+        case '-':
+            return opSub;
+        case '*':
+            return opMul;
+        case '/':
+            return opDiv;
+        case '^':
+            return opPow;
+    }
+    throw incorExpr;
+}
+Shape shapeOf(Expression *exp, VarDef &vars, const ShapeDef &shapes) {
+    Shape s=scalarShape();
+    if(typeid(*exp)==typeid(BConstant)) {
+        s.kind=valueBra;
+        s.m=((BConstant*)exp)->value().size();
+    } else if(typeid(*exp)==typeid(KConstant)) {
+        s.kind=valueKet;
+        s.n=((KConstant*)exp)->value().size();
+    } else if(typeid(*exp)==typeid(MConstant)) {
+        s.kind=valueMatrix;
+        s.n=((MConstant*)exp)->value().n();
+        s.m=((MConstant*)exp)->value().m();
+    } else if(typeid(*exp)==typeid(Variable)) {
+        string name=((Variable*)exp)->name();
+        ShapeDef::const_iterator it=shapes.find(name);
+        if(it!=shapes.end())
+            s=it->second;
+        else if(vars.find(name)!=vars.end())
+            s=shapeOf(vars[name],vars,shapes);
+    } else if(typeid(*exp)==typeid(BinaryOp)) {
+        BinaryOp *op=(BinaryOp*)exp;
+        s=binaryShape(binaryCode(op->op()),shapeOf(op->left(),vars,shapes),
+                shapeOf(op->right(),vars,shapes));
+    } else if(typeid(*exp)==typeid(SingleValFunction)) {
+        s=shapeOf(((SingleValFunction*)exp)->arg(),vars,shapes);
+    } else if(typeid(*exp)==typeid(MultiValFunction)) {
+        MultiValFunction *fun=(MultiValFunction*)exp;
+        for(int k=0;k<fun->nargs();k++)
+            if(shapeOf(fun->arg(k),vars,shapes).kind!=valueScalar)
+                throw incompatibleSizes;
+    }
+    return s;
+}
+/*!\brief Appends the factors of the product chain rooted at exp. */
+static void chainFactors(Expression *exp, vector<Expression *> &factors) {
+    if(typeid(*exp)==typeid(BinaryOp) && ((BinaryOp*)exp)->op()=='*') {
+        chainFactors(((BinaryOp*)exp)->left(),factors);
+        chainFactors(((BinaryOp*)exp)->right(),factors);
+    } else {
+        factors.push_back(exp);
+    }
+}
+/*!\brief Builds the product of factors i to j following the splits. */
+static Expression *chainProduct(const vector<Expression *> &factors,
+        const vector<vector<int> > &split, int i, int j) {
+    if(i==j)
+        return factors[i];
+    const int k=split[i][j];
+    return new BinaryOp('*',chainProduct(factors,split,i,k),
+            chainProduct(factors,split,k+1,j));
+}
+/*!\brief Rebuilds the chain rooted at exp with new factors. */
+static Expression *chainRebuild(Expression *exp,
+        const vector<Expression *> &factors, int &next) {
+    if(typeid(*exp)==typeid(BinaryOp) && ((BinaryOp*)exp)->op()=='*') {
+        Expression *left=chainRebuild(((BinaryOp*)exp)->left(),factors,next);
+        return new BinaryOp('*',left,
+                chainRebuild(((BinaryOp*)exp)->right(),factors,next));
+    }
+    return factors[next++];
+}
+/*!\brief Returns the product of factors in the cheapest order, or 0 if
+ * the chain cannot be reordered. */
+static Expression *reorderChain(const vector<Expression *> &factors,
+        VarDef &vars, const ShapeDef &shapes) {
+    vector<Expression *> arrays;
+    vector<Shape> dims;
+    Expression *scale=0;
+    for(unsigned int f=0;f<factors.size();f++) {
+        Shape s=shapeOf(factors[f],vars,shapes);
+        if(s.kind==valueScalar) {
+            scale=(scale==0?factors[f]:new BinaryOp('*',scale,factors[f]));
+        } else {
+            if(!dims.empty() && dims.back().m!=s.n)
+                return 0;
+            arrays.push_back(factors[f]);
+            dims.push_back(s);
+        }
+    }
+    const int n=arrays.size();
+    if(n<2)
+        return 0;
+    //Matrix chain ordering, cost[i][j] is the cost of arrays i to j.
+    vector<vector<double> > cost(n,vector<double>(n,0.));
+    vector<vector<int> > split(n,vector<int>(n,0));
+    for(int l=1;l<n;l++)
+        for(int i=0;i+l<n;i++) {
+            const int j=i+l;
+            cost[i][j]=-1;
+            for(int k=i;k<j;k++) {
+                double c=cost[i][k]+cost[k+1][j]
+                    +(double)dims[i].n*dims[k].m*dims[j].m;
+                if(cost[i][j]<0 || c<cost[i][j]) {
+                    cost[i][j]=c;
+                    split[i][j]=k;
+                }
+            }
+        }
+    if(scale!=0) {
+        int small=0;
+        for(int i=1;i<n;i++)
+            if((double)dims[i].n*dims[i].m<(double)dims[small].n*dims[small].m)
+                small=i;
+        arrays[small]=new BinaryOp('*',scale,arrays[small]);
+    }
+    return chainProduct(arrays,split,0,n-1);
+}
+Expression *reorderProducts(Expression *exp, VarDef &vars,
+        const ShapeDef &shapes) {
+    PROFILE_PHASE(phaseSimplify);
+    if(typeid(*exp)==typeid(SingleValFunction)) {
+        SingleValFunction *fun=(SingleValFunction*)exp;
+        return new SingleValFunction(fun->i(),
+                reorderProducts(fun->arg(),vars,shapes));
+    }
+    if(typeid(*exp)==typeid(MultiValFunction)) {
+        MultiValFunction *fun=(MultiValFunction*)exp;
+        vector<Expression *> args(fun->nargs());
+        for(int k=0;k<fun->nargs();k++)
+            args[k]=reorderProducts(fun->arg(k),vars,shapes);
+        return new MultiValFunction(fun->i(),args);
+    }
+    if(typeid(*exp)!=typeid(BinaryOp))
+        return exp;
+    BinaryOp *op=(BinaryOp*)exp;
+    if(op->op()=='*') {
+        vector<Expression *> factors;
+        chainFactors(exp,factors);
+        for(unsigned int f=0;f<factors.size();f++)
+            factors[f]=reorderProducts(factors[f],vars,shapes);
+        int next=0;
+        Expression *res=chainRebuild(exp,factors,next);
+        //Bra-ket products inside the chain, or operators not defined for
+        //some pairs of kinds, can make the new order invalid.
+        try {
+            Expression *best=reorderChain(factors,vars,shapes);
+            if(best!=0) {
+                Shape a=shapeOf(res,vars,shapes);
+                Shape b=shapeOf(best,vars,shapes);
+                if(a.kind==b.kind && a.n==b.n && a.m==b.m)
+                    return best;
+            }
+        } catch (exception &) {
+        }
+        return res;
+    }
+    return new BinaryOp(op->op(),reorderProducts(op->left(),vars,shapes),
+            reorderProducts(op->right(),vars,shapes));
+}
+/* }}} */
+/* Builder {{{ */
+/*!\brief Accumulates the sections of a program before assembly. */
+struct Builder {
+    vector<Instruction> instr;  //!<\brief Instructions.
+    vector<double> pool;        //!<\brief Constant pool.
+    vector<ArrayConstant> arrays;   //!<\brief Array descriptors.
+    vector<string> symbols;     //!<\brief Symbol names.
+    vector<Shape> shapes;       //!<\brief Symbol shapes.
+    vector<int> funcs;          //!<\brief Registry identifiers of the
+                                //!< functions.
+    int depth;                  //!<\brief Current stack depth.
+    int stack;                  //!<\brief Maximal stack depth.
+    /*!\brief Appends an instruction and tracks the stack depth. */
+    void push(OpCode code, int arg, int delta) {
+        Instruction i;
+        i.code=code;
+        i.arg=arg;
+        instr.push_back(i);
+        depth+=delta;
+        if(depth>stack)
+            stack=depth;
+    };
+    /*!\brief Appends an array constant to the pool. */
+    int array(int n, int m, const double *data) {
+        ArrayConstant a;
+        a.n=n;
+        a.m=m;
+        a.offset=pool.size();
+        a.pad=0;
+        for(int i=0;i<n*m;i++)
+            pool.push_back(data[i]);
+        arrays.push_back(a);
+        return arrays.size()-1;
+    };
+    /*!\brief Returns the index of a function in the functions section. */
+    int function(int id) {
+        unsigned int k=0;
+        while(k<funcs.size() && funcs[k]!=id)
+            k++;
+        if(k==funcs.size())
+            funcs.push_back(id);
+        return k;
+    };
+    /*!\brief Recursively compiles an expression. */
+    void compile(Expression *exp, VarDef &vars, const ShapeDef &def) {
+        if(typeid(*exp)==typeid(Constant)) {
+            pool.push_back(((Constant*)exp)->value());
+            push(opConstant,pool.size()-1,1);
+        } else if(typeid(*exp)==typeid(Variable)) {
+            string name=((Variable*)exp)->name();
+            unsigned int k=0;
+            while(k<symbols.size() && symbols[k]!=name)
+                k++;
+            if(k==symbols.size()) {
+                symbols.push_back(name);
+                ShapeDef::const_iterator it=def.find(name);
+                shapes.push_back(it==def.end()?scalarShape():it->second);
+                if(!validShape(shapes.back()))
+                    throw incompatibleSizes;
+            }
+            push(opVariable,k,1);
+        } else if(typeid(*exp)==typeid(BinaryOp)) {
+            BinaryOp *op=(BinaryOp*)exp;
+            compile(op->left(),vars,def);
+            compile(op->right(),vars,def);
+            switch(op->op()) {
+                case '+':
+                    push(opAdd,0,-1);
+                    break;
+                case '-':
+                    push(opSub,0,-1);
+                    break;
+                case '*':
+                    push(opMul,0,-1);
+                    break;
+                case '/':
+                    push(opDiv,0,-1);
+                    break;
+                case '^':
+                    push(opPow,0,-1);
+                    break;
+                default:
+                    throw incorExpr;
+            }
+        } else if(typeid(*exp)==typeid(SingleValFunction)) {
+            SingleValFunction *fun=(SingleValFunction*)exp;
+            compile(fun->arg(),vars,def);
+            push(opCall,function(fun->i()),0);
+        } else if(typeid(*exp)==typeid(MultiValFunction)) {
+            MultiValFunction *fun=(MultiValFunction*)exp;
+            for(int k=0;k<fun->nargs();k++)
+                compile(fun->arg(k),vars,def);
+            push(opCall,function(fun->i()),1-fun->nargs());
+        } else if(typeid(*exp)==typeid(BConstant)) {
+            const Bra<double> &b=((BConstant*)exp)->value();
+            push(opBra,array(1,b.size(),b.data()),1);
+        } else if(typeid(*exp)==typeid(KConstant)) {
+            const Ket<double> &k=((KConstant*)exp)->value();
+            push(opKet,array(k.size(),1,k.data()),1);
+        } else if(typeid(*exp)==typeid(MConstant)) {
+            const Matrix<double> &m=((MConstant*)exp)->value();
+            push(opMatrix,array(m.n(),m.m(),m.data()),1);
+        } else {
+            throw incorExpr;
+        }
+    };
+};
+/* }}} */
+/* align {{{ */
+/*!\brief Rounds an offset up to the next 8 bytes boundary. */
+static unsigned long long align(unsigned long long offset) {
+    return (offset+7)&~7ULL;
+}
+/* }}} */
+/* Image checks {{{ */
+/*!\brief Returns true if count items of the given size, starting at offset,
+ * end before end, without overflowing. */
+static bool fits(unsigned long long offset, long long count,
+        unsigned long long size, unsigned long long end) {
+    return count>=0 && offset<=end
+        && (unsigned long long)count<=(end-offset)/size;
+}
+/* }}} */
+/* Program class implementation {{{ */
+/* Program {{{ */
+Program::Program(Expression *exp, VarDef &vars, const ShapeDef &shapes) {
+    Builder b;
+    b.depth=b.stack=0;
+    b.compile(reorderProducts(exp,vars,shapes)->simplify(vars),vars,shapes);
+    string strings;
+    vector<Symbol> symbols;
+    for(unsigned int k=0;k<b.symbols.size();k++) {
+        Symbol s;
+        s.offset=strings.size();
+        s.length=b.symbols[k].size();
+        s.kind=b.shapes[k].kind;
+        s.n=b.shapes[k].n;
+        s.m=b.shapes[k].m;
+        s.pad=0;
+        strings+=b.symbols[k];
+        symbols.push_back(s);
+    }
+    vector<FunctionSymbol> funcs;
+    for(unsigned int k=0;k<b.funcs.size();k++) {
+        const FunctionInfo &info=functionRegistry()[b.funcs[k]];
+        FunctionSymbol f;
+        f.offset=strings.size();
+        f.length=info.name.size();
+        f.nargs=info.nargs;
+        f.pad=0;
+        strings+=info.name;
+        funcs.push_back(f);
+    }
+    ProgramHeader h;
+    memset(&h,0,sizeof(h));
+    memcpy(h.magic,"MXPR",4);
+    h.version=PROGRAM_VERSION;
+    h.endian=0x01020304;
+    h.nfunc=funcs.size();
+    h.ninstr=b.instr.size();
+    h.nconst=b.pool.size();
+    h.narray=b.arrays.size();
+    h.nsym=symbols.size();
+    h.stack=b.stack;
+    h.instrOffset=align(sizeof(h));
+    h.constOffset=align(h.instrOffset+h.ninstr*sizeof(Instruction));
+    h.arrayOffset=align(h.constOffset+h.nconst*sizeof(double));
+    h.symOffset=align(h.arrayOffset+h.narray*sizeof(ArrayConstant));
+    h.funcOffset=align(h.symOffset+h.nsym*sizeof(Symbol));
+    h.strOffset=align(h.funcOffset+h.nfunc*sizeof(FunctionSymbol));
+    h.size=align(h.strOffset+strings.size());
+    char *image=new char[h.size];
+    memset(image,0,h.size);
+    memcpy(image,&h,sizeof(h));
+    if(h.ninstr>0)
+        memcpy(image+h.instrOffset,&b.instr[0],h.ninstr*sizeof(Instruction));
+    if(h.nconst>0)
+        memcpy(image+h.constOffset,&b.pool[0],h.nconst*sizeof(double));
+    if(h.narray>0)
+        memcpy(image+h.arrayOffset,&b.arrays[0],
+                h.narray*sizeof(ArrayConstant));
+    if(h.nsym>0)
+        memcpy(image+h.symOffset,&symbols[0],h.nsym*sizeof(Symbol));
+    if(h.nfunc>0)
+        memcpy(image+h.funcOffset,&funcs[0],h.nfunc*sizeof(FunctionSymbol));
+    memcpy(image+h.strOffset,strings.data(),strings.size());
+    _image=image;
+    _mapped=false;
+    _length=h.size;
+    check();
+}
+Program::Program(const string &file) {
+    int fd=open(file.c_str(),O_RDONLY);
+    if(fd<0)
+        throw badFormat;
+    struct stat st;
+    if(fstat(fd,&st)!=0 || (unsigned long)st.st_size<sizeof(ProgramHeader)) {
+        close(fd);
+        throw badFormat;
+    }
+    void *map=mmap(0,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+    close(fd);
+    if(map==MAP_FAILED)
+        throw badFormat;
+    _image=(const char*)map;
+    _mapped=true;
+    _length=st.st_size;
+    const ProgramHeader *h=(const ProgramHeader*)_image;
+    if(h->size>(unsigned long long)st.st_size) {
+        munmap(map,st.st_size);
+        throw badFormat;
+    }
+    try {
+        check();
+    }
+    catch (...) {
+        munmap(map,st.st_size);
+        throw;
+    }
+}
+/* }}} */
+/* ~Program {{{ */
+Program::~Program(void) {
+    if(_mapped)
+        munmap((void*)_image,_length);
+    else
+        delete[] _image;
+}
+/* }}} */
+/* check {{{ */
+/*!\brief Validates the image and sets up the section pointers. */
+void Program::check(void) {
+    const ProgramHeader *h=(const ProgramHeader*)_image;
+    if(memcmp(h->magic,"MXPR",4)!=0 || h->version!=PROGRAM_VERSION
+            || h->endian!=0x01020304)
+        throw badFormat;
+    if(h->instrOffset<sizeof(ProgramHeader)
+            || !fits(h->instrOffset,h->ninstr,sizeof(Instruction),
+                h->constOffset)
+            || !fits(h->constOffset,h->nconst,sizeof(double),h->arrayOffset)
+            || !fits(h->arrayOffset,h->narray,sizeof(ArrayConstant),
+                h->symOffset)
+            || !fits(h->symOffset,h->nsym,sizeof(Symbol),h->funcOffset)
+            || !fits(h->funcOffset,h->nfunc,sizeof(FunctionSymbol),
+                h->strOffset)
+            || h->strOffset>h->size || (h->constOffset&7)!=0)
+        throw badFormat;
+    _header=h;
+    _instr=(const Instruction*)(_image+h->instrOffset);
+    _const=(const double*)(_image+h->constOffset);
+    _arrays=(const ArrayConstant*)(_image+h->arrayOffset);
+    _symbols=(const Symbol*)(_image+h->symOffset);
+    _strings=_image+h->strOffset;
+    //Resolve the functions by name.
+    const FunctionSymbol *funcs=(const FunctionSymbol*)(_image+h->funcOffset);
+    _funcs.resize(h->nfunc);
+    for(unsigned int k=0;k<h->nfunc;k++) {
+        if(funcs[k].offset<0 || !fits(h->strOffset+funcs[k].offset,
+                    funcs[k].length,1,h->size))
+            throw badFormat;
+        _funcs[k]=functionRegistry().find(string(_strings+funcs[k].offset,
+                    funcs[k].length));
+        if(_funcs[k]==-1)
+            throw unknownFunction;
+        if(functionRegistry()[_funcs[k]].nargs!=funcs[k].nargs)
+            throw badFormat;
+    }
+    //Array constants lie in the constant pool.
+    for(int k=0;k<h->narray;k++) {
+        const ArrayConstant &a=_arrays[k];
+        if(a.offset<0 || a.n<=0 || a.m<=0 || a.offset>h->nconst
+                || (long long)a.n*a.m>h->nconst-a.offset)
+            throw badFormat;
+    }
+    //Check the arguments once, so that evaluation can trust them.
+    int depth=0;
+    for(int i=0;i<h->ninstr;i++) {
+        int arg=_instr[i].arg;
+        switch(_instr[i].code) {
+            case opConstant:
+                if(arg<0 || arg>=h->nconst)
+                    throw badFormat;
+                depth++;
+                break;
+            case opVariable:
+                if(arg<0 || arg>=h->nsym)
+                    throw badFormat;
+                depth++;
+                break;
+            case opAdd:
+            case opSub:
+            case opMul:
+            case opDiv:
+            case opPow:
+                depth--;
+                break;
+            case opCall:
+                if(arg<0 || arg>=(int)h->nfunc)
+                    throw badFormat;
+                depth+=1-functionRegistry()[_funcs[arg]].nargs;
+                break;
+            case opBra:
+            case opKet:
+            case opMatrix:
+                if(arg<0 || arg>=h->narray)
+                    throw badFormat;
+                depth++;
+                break;
+            default:
+                throw badFormat;
+        }
+        if(depth<1 || depth>h->stack)
+            throw badFormat;
+    }
+    if(h->ninstr>0 && depth!=1)
+        throw badFormat;
+    _scalar=(h->narray==0);
+    for(int k=0;k<h->nsym;k++) {
+        if(_symbols[k].offset<0 || !fits(h->strOffset+_symbols[k].offset,
+                    _symbols[k].length,1,h->size)
+                || !validShape(shape(k)))
+            throw badFormat;
+        if(_symbols[k].kind!=valueScalar)
+            _scalar=false;
+    }
+    //Build the expression tree and infer the shapes.
+    _nodes.resize(h->ninstr);
+    vector<int> stack;
+    for(int i=0;i<h->ninstr;i++) {
+        ProgramNode &node=_nodes[i];
+        node.code=_instr[i].code;
+        node.arg=_instr[i].arg;
+        node.left=node.right=-1;
+        node.fused=-1;
+        switch(node.code) {
+            case opConstant:
+                node.shape=scalarShape();
+                break;
+            case opVariable:
+                node.shape=shape(node.arg);
+                break;
+            case opCall:
+                node.arg=_funcs[node.arg];
+                node.args.resize(functionRegistry()[node.arg].nargs);
+                for(int k=node.args.size()-1;k>=0;k--) {
+                    node.args[k]=stack.back();
+                    stack.pop_back();
+                }
+                node.shape=scalarShape();
+                if(node.args.size()==1) {
+                    //Functions of one argument apply to each element.
+                    node.left=node.args[0];
+                    node.shape=_nodes[node.left].shape;
+                } else {
+                    for(unsigned int k=0;k<node.args.size();k++)
+                        if(_nodes[node.args[k]].shape.kind!=valueScalar)
+                            throw incompatibleSizes;
+                }
+                break;
+            case opBra:
+            case opKet:
+            case opMatrix:
+                node.shape.kind=(node.code==opBra?valueBra:
+                        (node.code==opKet?valueKet:valueMatrix));
+                node.shape.n=_arrays[node.arg].n;
+                node.shape.m=_arrays[node.arg].m;
+                if(!validShape(node.shape))
+                    throw badFormat;
+                break;
+            default:
+                node.right=stack.back();
+                stack.pop_back();
+                node.left=stack.back();
+                stack.pop_back();
+                node.shape=binaryShape(node.code,_nodes[node.left].shape,
+                        _nodes[node.right].shape);
+        }
+        stack.push_back(i);
+    }
+    //Each maximal elementwise subtree becomes a fused region.
+    vector<int> parent(h->ninstr,-1);
+    for(int i=0;i<h->ninstr;i++) {
+        if(_nodes[i].left>=0)
+            parent[_nodes[i].left]=i;
+        if(_nodes[i].right>=0)
+            parent[_nodes[i].right]=i;
+    }
+    _regions.clear();
+    for(int i=0;i<h->ninstr;i++) {
+        if(!elementwise(_nodes,i)
+                || (parent[i]>=0 && elementwise(_nodes,parent[i])))
+            continue;
+        FusedRegion r;
+        fuse(i,r);
+        int d=0;
+        r.depth=0;
+        for(unsigned int c=0;c<r.code.size();c++) {
+            if(r.code[c].code==fuseLoad)
+                d++;
+            else if(r.code[c].code==fuseAdd || r.code[c].code==fuseSub)
+                d--;
+            r.depth=(d>r.depth?d:r.depth);
+        }
+        _nodes[i].fused=_regions.size();
+        _regions.push_back(r);
+    }
+}
+/*!\brief Appends the instructions of the elementwise subtree rooted at node
+ * i to a region. */
+void Program::fuse(int i, FusedRegion &region) {
+    const ProgramNode &node=_nodes[i];
+    Instruction in;
+    in.arg=0;
+    if(!elementwise(_nodes,i)) {
+        in.code=fuseLoad;
+        in.arg=region.leaves.size();
+        region.leaves.push_back(i);
+    } else if(node.code==opAdd || node.code==opSub) {
+        fuse(node.left,region);
+        fuse(node.right,region);
+        in.code=(node.code==opAdd?fuseAdd:fuseSub);
+    } else if(node.code==opCall) {
+        fuse(node.left,region);
+        in.code=fuseCall;
+        in.arg=node.arg;
+    } else {
+        //Products and ratios with a scalar.
+        int a=node.left;
+        int s=node.right;
+        if(_nodes[a].shape.kind==valueScalar) {
+            a=node.right;
+            s=node.left;
+        }
+        fuse(a,region);
+        in.code=(node.code==opMul?fuseScale:fuseDivide);
+        in.arg=region.leaves.size();
+        region.leaves.push_back(s);
+    }
+    region.code.push_back(in);
+}
+/* }}} */
+/* save {{{ */
+void Program::save(const string &file) const {
+    FILE *f=fopen(file.c_str(),"wb");
+    if(f==0)
+        throw badFormat;
+    size_t n=fwrite(_image,1,_header->size,f);
+    if(fclose(f)!=0 || n!=_header->size)
+        throw badFormat;
+}
+/* }}} */
+/* evaluate {{{ */
+double Program::evaluate(const double *x) const {
+    if(!isScalar())
+        throw incompatibleSizes;
+    if(_header->ninstr==0)
+        return 0;
+    PROFILE_PHASE(phaseEvaluate);
+    PROFILE_ADD(nodes,_header->ninstr);
+    double buffer[32];
+    buffer[0]=0;
+    double *s=buffer;
+    if(_header->stack>32)
+        s=new double[_header->stack];
+    int top=-1;
+    for(int i=0;i<_header->ninstr;i++) {
+        const Instruction &in=_instr[i];
+        switch(in.code) {
+            case opConstant:
+                s[++top]=_const[in.arg];
+                break;
+            case opVariable:
+                s[++top]=x[in.arg];
+                break;
+            case opAdd:
+                s[top-1]+=s[top];
+                top--;
+                break;
+            case opSub:
+                s[top-1]-=s[top];
+                top--;
+                break;
+            case opMul:
+                s[top-1]*=s[top];
+                top--;
+                break;
+            case opDiv:
+                s[top-1]/=s[top];
+                top--;
+                break;
+            case opPow:
+                s[top-1]=pow(s[top-1],s[top]);
+                top--;
+                break;
+            case opCall:
+                {
+                    const int id=_funcs[in.arg];
+                    PROFILE_CALL(id,1);
+                    top+=1-functionRegistry()[id].nargs;
+                    s[top]=functionRegistry().call(id,s+top);
+                }
+                break;
+        }
+    }
+    double res=s[0];
+    if(s!=buffer)
+        delete[] s;
+    return res;
+}
+void Program::evaluate(int n, const double *const *x, double *out) const {
+    if(!isScalar())
+        throw incompatibleSizes;
+    if(n<=0)
+        return;
+    if(_header->ninstr==0) {
+        for(int i=0;i<n;i++)
+            out[i]=0;
+        return;
+    }
+    PROFILE_PHASE(phaseEvaluate);
+    PROFILE_ADD(nodes,_header->ninstr);
+    //Stack slots point either to an input column or to their own buffer.
+    double *work=new double[_header->stack*n];
+    const double **s=new const double*[_header->stack];
+    int top=-1;
+    for(int k=0;k<_header->ninstr;k++) {
+        const Instruction &in=_instr[k];
+        double *dst;
+        const double *a;
+        const double *b;
+        switch(in.code) {
+            case opConstant:
+                top++;
+                dst=work+top*n;
+                for(int i=0;i<n;i++)
+                    dst[i]=_const[in.arg];
+                s[top]=dst;
+                continue;
+            case opVariable:
+                top++;
+                s[top]=x[in.arg];
+                continue;
+            case opCall:
+                {
+                    const int id=_funcs[in.arg];
+                    top+=1-functionRegistry()[id].nargs;
+                    dst=work+top*n;
+                    functionRegistry().apply(id,n,s+top,dst);
+                    s[top]=dst;
+                }
+                continue;
+        }
+        top--;
+        dst=work+top*n;
+        a=s[top];
+        b=s[top+1];
+        switch(in.code) {
+            case opAdd:
+                for(int i=0;i<n;i++)
+                    dst[i]=a[i]+b[i];
+                break;
+            case opSub:
+                for(int i=0;i<n;i++)
+                    dst[i]=a[i]-b[i];
+                break;
+            case opMul:
+                for(int i=0;i<n;i++)
+                    dst[i]=a[i]*b[i];
+                break;
+            case opDiv:
+                for(int i=0;i<n;i++)
+                    dst[i]=a[i]/b[i];
+                break;
+            case opPow:
+                for(int i=0;i<n;i++)
+                    dst[i]=pow(a[i],b[i]);
+                break;
+        }
+        s[top]=dst;
+    }
+    for(int i=0;i<n;i++)
+        out[i]=s[0][i];
+    delete[] s;
+    delete[] work;
+}
+void Program::evaluate(const double *const *x, double *out) const {
+    if(_header->ninstr==0) {
+        out[0]=0;
+        return;
+    }
+    PROFILE_PHASE(phaseEvaluate);
+    PROFILE_ADD(nodes,_header->ninstr);
+    const int root=_header->ninstr-1;
+    if(_nodes[root].shape.kind==valueScalar)
+        out[0]=scalar(root,x);
+    else
+        array(root,x,out);
+}
+/*!\brief Returns a pointer to the elements of array node i.
+ *
+ * Constants and symbols are used in place, other nodes are evaluated in
+ * tmp.
+ */
+const double *Program::operand(int i, const double *const *x,
+        vector<double> &tmp) const {
+    const ProgramNode &node=_nodes[i];
+    if(node.code==opVariable)
+        return x[node.arg];
+    if(node.code==opBra || node.code==opKet || node.code==opMatrix)
+        return _const+_arrays[node.arg].offset;
+    tmp.resize((size_t)node.shape.n*node.shape.m);
+    array(i,x,&tmp[0]);
+    return &tmp[0];
+}
+/*!\brief Returns the value of scalar node i. */
+double Program::scalar(int i, const double *const *x) const {
+    const ProgramNode &node=_nodes[i];
+    switch(node.code) {
+        case opConstant:
+            return _const[node.arg];
+        case opVariable:
+            return x[node.arg][0];
+        case opCall:
+            {
+                vector<double> a(node.args.size()+1);
+                for(unsigned int k=0;k<node.args.size();k++)
+                    a[k]=scalar(node.args[k],x);
+                PROFILE_CALL(node.arg,1);
+                return functionRegistry().call(node.arg,&a[0]);
+            }
+    }
+    if(_nodes[node.left].shape.kind!=valueScalar) {
+        //Bra-ket product.
+        vector<double> ta,tb;
+        const double *a=operand(node.left,x,ta);
+        const double *b=operand(node.right,x,tb);
+        return dot(_nodes[node.left].shape.m,a,b);
+    }
+    const double a=scalar(node.left,x);
+    const double b=scalar(node.right,x);
+    switch(node.code) {
+        case opAdd:
+            return a+b;
+        case opSub:
+            return a-b;
+        case opMul:
+            return a*b;
+        case opDiv:
+            return a/b;
+        default:
+            return pow(a,b);
+    }
+}
+/*!\brief Stores the elements of array node i in out. */
+void Program::array(int i, const double *const *x, double *out) const {
+    const ProgramNode &node=_nodes[i];
+    const long long size=(long long)node.shape.n*node.shape.m;
+    if(node.fused>=0) {
+        const FusedRegion &r=_regions[node.fused];
+        const int nl=r.leaves.size();
+        vector<vector<double> > tmp(nl);
+        vector<const double *> ptr(nl);
+        vector<double> val(nl);
+        for(int k=0;k<nl;k++) {
+            if(_nodes[r.leaves[k]].shape.kind==valueScalar)
+                val[k]=scalar(r.leaves[k],x);
+            else
+                ptr[k]=operand(r.leaves[k],x,tmp[k]);
+        }
+        const int nc=r.code.size();
+        const FunctionRegistry &reg=functionRegistry();
+        long long grain=KERNEL_GRAIN/nc;
+        for(int c=0;c<nc;c++)
+            if(r.code[c].code==fuseCall) {
+                PROFILE_CALL(r.code[c].arg,size);
+                if(!(reg[r.code[c].arg].flags&functionThreadSafe))
+                    grain=size;
+            }
+        parallelForLocal(size,grain,[&](long long i0, long long i1) {
+            vector<double> buffer(r.depth*FUSED_BLOCK);
+            vector<const double *> s(r.depth);
+            for(long long b=i0;b<i1;b+=FUSED_BLOCK) {
+                const int w=(i1-b<FUSED_BLOCK?i1-b:FUSED_BLOCK);
+                int top=-1;
+                for(int c=0;c<nc;c++) {
+                    const Instruction &in=r.code[c];
+                    if(in.code==fuseLoad) {
+                        s[++top]=ptr[in.arg]+b;
+                        continue;
+                    }
+                    if(in.code==fuseAdd || in.code==fuseSub)
+                        top--;
+                    //The last instruction writes the result in place.
+                    double *dst=(c==nc-1?out+b:&buffer[top*FUSED_BLOCK]);
+                    const double *u=s[top];
+                    const double *v=(top+1<r.depth?s[top+1]:0);
+                    switch(in.code) {
+                        case fuseScale:
+                            for(int j=0;j<w;j++)
+                                dst[j]=u[j]*val[in.arg];
+                            break;
+                        case fuseDivide:
+                            for(int j=0;j<w;j++)
+                                dst[j]=u[j]/val[in.arg];
+                            break;
+                        case fuseAdd:
+                            for(int j=0;j<w;j++)
+                                dst[j]=u[j]+v[j];
+                            break;
+                        case fuseSub:
+                            for(int j=0;j<w;j++)
+                                dst[j]=u[j]-v[j];
+                            break;
+                        case fuseCall:
+                            reg.batch(in.arg,w,&u,dst);
+                            break;
+                    }
+                    s[top]=dst;
+                }
+            }
+        });
+        return;
+    }
+    if(node.code==opMul) {
+        const Shape &a=_nodes[node.left].shape;
+        const Shape &b=_nodes[node.right].shape;
+        vector<double> ta,tb;
+        const double *pa=operand(node.left,x,ta);
+        const double *pb=operand(node.right,x,tb);
+        if(a.kind==valueKet) {
+            kernelFill(size,out,0.);
+            ger(a.n,b.m,1.,pa,pb,out,b.m);
+        } else if(a.kind==valueBra) {
+            gemvT(b.n,b.m,pb,b.m,pa,out);
+        } else if(b.kind==valueKet) {
+            gemv(a.n,a.m,pa,a.m,pb,out);
+        } else {
+            kernelFill(size,out,0.);
+            gemm(a.n,a.m,b.m,pa,a.m,pb,b.m,out,b.m);
+        }
+        return;
+    }
+    //Constants and symbols.
+    vector<double> tmp;
+    kernelCopy(size,operand(i,x,tmp),out);
+}
+/* }}} */
+/* expression {{{ */
+Expression *Program::expression(void) const {
+    if(_header->ninstr==0)
+        return new Constant(0.);
+    vector<Expression *> s;
+    for(int i=0;i<_header->ninstr;i++) {
+        const Instruction &in=_instr[i];
+        Expression *r;
+        switch(in.code) {
+            case opConstant:
+                s.push_back(new Constant(_const[in.arg]));
+                break;
+            case opVariable:
+                s.push_back(new Variable(symbol(in.arg)));
+                break;
+            case opCall:
+                {
+                    const int id=_funcs[in.arg];
+                    const int nargs=functionRegistry()[id].nargs;
+                    if(nargs==1) {
+                        s.back()=new SingleValFunction(id,s.back());
+                        break;
+                    }
+                    vector<Expression *> args(s.end()-nargs,s.end());
+                    s.resize(s.size()-nargs);
+                    s.push_back(new MultiValFunction(id,args));
+                }
+                break;
+            case opBra:
+            case opKet:
+            case opMatrix:
+                {
+                    const ArrayConstant &a=_arrays[in.arg];
+                    const double *data=_const+a.offset;
+                    if(in.code==opMatrix) {
+                        Matrix<double> m(a.n,a.m);
+                        for(int k=0;k<a.n;k++)
+                            for(int l=0;l<a.m;l++)
+                                m.at(k,l)=data[k*a.m+l];
+                        s.push_back(new MConstant(m));
+                    } else if(in.code==opBra) {
+                        Bra<double> b(a.m);
+                        for(int k=0;k<a.m;k++)
+                            b[k]=data[k];
+                        s.push_back(new BConstant(b));
+                    } else {
+                        Ket<double> k(a.n);
+                        for(int l=0;l<a.n;l++)
+                            k[l]=data[l];
+                        s.push_back(new KConstant(k));
+                    }
+                }
+                break;
+            default:
+                r=s.back();
+                s.pop_back();
+                s.back()=new BinaryOp("??+-*/^"[in.code],s.back(),r);
+        }
+    }
+    return s.back();
+}
+/* }}} */
+/* shape {{{ */
+Shape Program::shape(void) const {
+    if(_header->ninstr==0)
+        return scalarShape();
+    return _nodes[_header->ninstr-1].shape;
+}
+Shape Program::shape(int k) const {
+    if(k<0 || k>=_header->nsym)
+        throw outOfBounds;
+    Shape s;
+    s.kind=_symbols[k].kind;
+    s.n=_symbols[k].n;
+    s.m=_symbols[k].m;
+    return s;
+}
+/* }}} */
+/* symbol {{{ */
+string Program::symbol(int k) const {
+    if(k<0 || k>=_header->nsym)
+        throw outOfBounds;
+    return string(_strings+_symbols[k].offset,_symbols[k].length);
+}
+int Program::symbol(const string &name) const {
+    for(int k=0;k<_header->nsym;k++)
+        if(name.compare(0,string::npos,_strings+_symbols[k].offset,
+                    _symbols[k].length)==0)
+            return k;
+    return -1;
+}
+/* }}} */
+/* }}} */
+/* program.cpp */
@@ -0,0 +1,233 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef PROGRAM_H
+#define PROGRAM_H
+#include <string>
+#include <vector>
+#include "expression.h"
+using std::string;
+using std::vector;
+/*!\brief Program instruction codes. */
+enum OpCode {
+    opConstant,     //!<\brief Push constants[arg].
+    opVariable,     //!<\brief Push the value of symbol arg.
+    opAdd,          //!<\brief Pop two values, push their sum.
+    opSub,          //!<\brief Pop two values, push their difference.
+    opMul,          //!<\brief Pop two values, push their product.
+    opDiv,          //!<\brief Pop two values, push their ratio.
+    opPow,          //!<\brief Pop two values, push their power.
+    opCall,         //!<\brief Pop the arguments of function arg, push its
+                    //!< value.
+    opBra,          //!<\brief Push the vector constant arrays[arg].
+    opKet,          //!<\brief Push the vector constant arrays[arg].
+    opMatrix        //!<\brief Push the matrix constant arrays[arg].
+};
+/*!\brief Single program instruction. */
+struct Instruction {
+    unsigned int code;  //!<\brief Instruction code, see OpCode.
+    int arg;            //!<\brief Instruction argument.
+};
+/*!\brief Array constant descriptor, data is stored in the constant pool. */
+struct ArrayConstant {
+    int n;          //!<\brief Number of rows.
+    int m;          //!<\brief Number of columns.
+    int offset;     //!<\brief Index of the first element in the pool.
+    int pad;        //!<\brief Unused.
+};
+/*!\brief Kinds of program values. */
+enum ValueKind {
+    valueScalar,    //!<\brief Scalar.
+    valueBra,       //!<\brief Bra, 1 x m.
+    valueKet,       //!<\brief Ket, n x 1.
+    valueMatrix     //!<\brief Matrix, n x m.
+};
+/*!\brief Shape of a program value, scalars are 1 x 1. */
+struct Shape {
+    int kind;       //!<\brief Value kind, see ValueKind.
+    int n;          //!<\brief Number of rows.
+    int m;          //!<\brief Number of columns.
+};
+/*!\brief Shapes of the array valued variables, by name. */
+typedef map<string,Shape> ShapeDef;
+/*!\brief Symbol descriptor, the name is stored in the string pool. */
+struct Symbol {
+    int offset;     //!<\brief Offset of the name in the string pool.
+    int length;     //!<\brief Length of the name.
+    int kind;       //!<\brief Value kind, see ValueKind.
+    int n;          //!<\brief Number of rows.
+    int m;          //!<\brief Number of columns.
+    int pad;        //!<\brief Unused.
+};
+/*!\brief Function descriptor, the name is stored in the string pool.
+ *
+ * Functions are saved by name and looked up in functionRegistry() when a
+ * program is loaded.
+ */
+struct FunctionSymbol {
+    int offset;     //!<\brief Offset of the name in the string pool.
+    int length;     //!<\brief Length of the name.
+    int nargs;      //!<\brief Number of arguments.
+    int pad;        //!<\brief Unused.
+};
+/*!\brief Node of the expression tree of a program, built at load time.
+ *
+ * Node i corresponds to instruction i, its operands are the nodes left and
+ * right (-1 if absent), or args for calls. The argument of calls is the
+ * identifier of the function in functionRegistry().
+ */
+struct ProgramNode {
+    unsigned int code;  //!<\brief Instruction code, see OpCode.
+    int arg;            //!<\brief Instruction argument.
+    int left;           //!<\brief Left operand.
+    int right;          //!<\brief Right operand.
+    Shape shape;        //!<\brief Shape of the value.
+    int fused;          //!<\brief Fused region rooted here, or -1.
+    vector<int> args;   //!<\brief Operands of calls.
+};
+/*!\brief Elementwise region of a program, evaluated in a single loop.
+ *
+ * The region is a small postfix program over its leaves, which are either
+ * scalars or arrays computed beforehand (constants, symbols, products).
+ */
+struct FusedRegion {
+    vector<Instruction> code;   //!<\brief Region instructions.
+    vector<int> leaves;         //!<\brief Leaf nodes.
+    int depth;                  //!<\brief Maximal stack depth.
+};
+/*!\brief Binary program header.
+ *
+ * A program image is the header followed by the instructions, the constant
+ * pool (doubles, including the elements of vector and matrix constants), the
+ * array descriptors, the symbols, the functions and the string pool.
+ * Every section starts on an 8 bytes boundary and offsets are counted from
+ * the beginning of the image, so that an image is used in place whether it
+ * was built in memory or mapped from a file.
+ */
+struct ProgramHeader {
+    char magic[4];          //!<\brief "MXPR".
+    unsigned int version;   //!<\brief Format version.
+    unsigned int endian;    //!<\brief 0x01020304, in the writer byte order.
+    unsigned int nfunc;     //!<\brief Number of functions.
+    int ninstr;             //!<\brief Number of instructions.
+    int nconst;             //!<\brief Number of doubles in the pool.
+    int narray;             //!<\brief Number of array constants.
+    int nsym;               //!<\brief Number of symbols.
+    int stack;              //!<\brief Maximal stack depth.
+    int pad;                //!<\brief Unused.
+    unsigned long long instrOffset;     //!<\brief Instructions offset.
+    unsigned long long constOffset;     //!<\brief Constant pool offset.
+    unsigned long long arrayOffset;     //!<\brief Array descriptors offset.
+    unsigned long long symOffset;       //!<\brief Symbols offset.
+    unsigned long long funcOffset;      //!<\brief Functions offset.
+    unsigned long long strOffset;       //!<\brief String pool offset.
+    unsigned long long size;            //!<\brief Total image size.
+};
+/*!\brief Returns the shape of an expression.
+ *
+ * Variables defined in vars have the shape of their definition, other
+ * variables are scalars unless declared in shapes.
+ */
+Shape shapeOf(Expression *exp, VarDef &vars,
+        const ShapeDef &shapes=ShapeDef());
+/*!\brief Reorders the chains of products of arrays to minimize their cost.
+ *
+ * A chain such as A*B*C*k is parsed as ((A*B)*C)*k, which costs O(n^3)
+ * where A*(B*(C*k)) costs O(n^2). The factors of each chain are regrouped
+ * with the matrix chain dynamic programming algorithm, scalar factors
+ * being applied to the smallest array. Chains whose shapes cannot be
+ * inferred are left unchanged.
+ * The expression is not modified, the result shares its leaves.
+ */
+Expression *reorderProducts(Expression *exp, VarDef &vars,
+        const ShapeDef &shapes=ShapeDef());
+/* Program {{{ */
+/*!\brief Represents an expression compiled to a postfix program.
+ *
+ * The program is stored as a flat binary image that can be written to disk
+ * and mapped back in memory with mmap: loading only checks the header, there
+ * is no deserialization pass, and several processes mapping the same file
+ * share its pages.
+ * Variables left undefined after simplification become symbols, numbered in
+ * order of first appearance. Symbols are scalars unless their shape is
+ * declared when compiling. Functions are stored by name, a program using
+ * registered functions can only be loaded once they are registered.
+ *
+ * Shapes are inferred when the program is built or mapped, so that
+ * incompatible sizes are reported before any evaluation. Array valued
+ * programs are evaluated on the expression tree: products call the gemm,
+ * gemv and dot kernels, and each maximal elementwise subtree, such as
+ * Exp[a*M1]+b*M2-M3, is evaluated in a single parallel loop over blocks of
+ * elements, without temporary arrays.
+ */
+class Program {
+    public:
+        /*!\brief Compiles an expression, simplified with vars beforehand.
+         *
+         * Variables listed in shapes become array valued symbols. Chains of
+         * products are reordered with reorderProducts before simplifying.
+         */
+        Program(Expression *exp, VarDef &vars,
+                const ShapeDef &shapes=ShapeDef());
+        /*!\brief Maps a program image from a file. */
+        Program(const string &file);
+        ~Program(void);
+        /*!\brief Writes the program image to a file. */
+        void save(const string &file) const;
+        /*!\brief Evaluates a scalar program, x[k] is the value of symbol k. */
+        double evaluate(const double *x) const;
+        /*!\brief Evaluates a scalar program on n points.
+         *
+         * x[k][i] is the value of symbol k at point i, the result is stored
+         * in out[i].
+         * Each instruction is applied to the n points at once.
+         */
+        void evaluate(int n, const double *const *x, double *out) const;
+        /*!\brief Evaluates a program of any shape.
+         *
+         * x[k] points to the elements of symbol k, stored row by row, and
+         * the elements of the result are stored in out, which must not
+         * overlap the inputs.
+         */
+        void evaluate(const double *const *x, double *out) const;
+        /*!\brief Rebuilds the expression tree, ie for vector programs. */
+        Expression *expression(void) const;
+        /*!\brief Returns the number of symbols. */
+        int nsymbols(void) const { return _header->nsym; };
+        /*!\brief Returns the name of symbol k. */
+        string symbol(int k) const;
+        /*!\brief Returns the index of a symbol, -1 if not found. */
+        int symbol(const string &name) const;
+        /*!\brief Returns the number of instructions. */
+        int size(void) const { return _header->ninstr; };
+        /*!\brief Returns true if the program only involves scalars. */
+        bool isScalar(void) const { return _scalar; };
+        /*!\brief Returns the shape of the result. */
+        Shape shape(void) const;
+        /*!\brief Returns the shape of symbol k. */
+        Shape shape(int k) const;
+    private:
+        Program(const Program &);
+        Program &operator=(const Program &);
+        void check(void);
+        void fuse(int node, FusedRegion &region);
+        const double *operand(int node, const double *const *x,
+                vector<double> &tmp) const;
+        double scalar(int node, const double *const *x) const;
+        void array(int node, const double *const *x, double *out) const;
+        const char *_image;             //!<\brief Program image.
+        const ProgramHeader *_header;   //!<\brief Image header.
+        const Instruction *_instr;      //!<\brief Instructions.
+        const double *_const;           //!<\brief Constant pool.
+        const ArrayConstant *_arrays;   //!<\brief Array descriptors.
+        const Symbol *_symbols;         //!<\brief Symbols.
+        const char *_strings;           //!<\brief String pool.
+        bool _mapped;                   //!<\brief True if mapped from a file.
+        unsigned long _length;          //!<\brief Length of the mapping.
+        vector<ProgramNode> _nodes;     //!<\brief Expression tree.
+        vector<FusedRegion> _regions;   //!<\brief Elementwise regions.
+        vector<int> _funcs;             //!<\brief Registry identifiers of
+                                        //!< the functions.
+        bool _scalar;                   //!<\brief True if only scalars.
+};
+/* }}} */
+#endif //PROGRAM_H
+/* program.h */
@@ -0,0 +1,231 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef REDUCTIONS_H
+#define REDUCTIONS_H
+#include <cmath>
+#include <vector>
+#include "myexceptions.h"
+#include "threadpool.h"
+#include "complex.h"
+#include "kernels.h"
+using std::vector;
+template <class T> class Vector;
+template <class T> class Bra;
+template <class T> class Ket;
+/*!\brief Vector reductions.
+ *
+ * Arrays are cut in blocks of REDUCE_BLOCK elements, the blocks are reduced
+ * in parallel and the partial results are combined in a fixed order, so
+ * that the result does not depend on the number of threads.
+ * The blocks are split with parallelForLocal, like the elementwise kernels.
+ * Sums take a summation policy as first template parameter:
+ *  - PlainSum accumulates in four independent partial sums, which the
+ *    compiler vectorizes,
+ *  - KahanSum carries a compensation term in each partial sum, the error
+ *    does not grow with n,
+ *  - PairwiseSum adds halves recursively, the error grows as log(n) for
+ *    almost the cost of PlainSum.
+ * The compensated policies rely on strict floating point semantics and
+ * are defeated by -ffast-math.
+ */
+/*!\brief Number of elements of a reduction block. */
+#define REDUCE_BLOCK 8192
+/*!\brief Number of elements below which PairwiseSum stops recursing. */
+#define PAIRWISE_LEAF 128
+/* PlainSum {{{ */
+/*!\brief Sums with four partial sums. */
+struct PlainSum {
+    /*!\brief Returns the sum of f(i) for i in [i0,i1). */
+    template <class T, class F> static T sum(long long i0, long long i1,
+            const F &f) {
+        T s0=0,s1=0,s2=0,s3=0;
+        long long i=i0;
+        for(;i+4<=i1;i+=4) {
+            s0+=f(i);
+            s1+=f(i+1);
+            s2+=f(i+2);
+            s3+=f(i+3);
+        }
+        for(;i<i1;i++)
+            s0+=f(i);
+        return (s0+s1)+(s2+s3);
+    };
+};
+/* }}} */
+/* KahanSum {{{ */
+/*!\brief Sums with four compensated partial sums. */
+struct KahanSum {
+    /*!\brief Returns the sum of f(i) for i in [i0,i1). */
+    template <class T, class F> static T sum(long long i0, long long i1,
+            const F &f) {
+        T s[4],c[4];
+        for(int l=0;l<4;l++)
+            s[l]=c[l]=0;
+        long long i=i0;
+        for(;i+4<=i1;i+=4)
+            for(int l=0;l<4;l++)
+                add(s[l],c[l],f(i+l));
+        for(;i<i1;i++)
+            add(s[0],c[0],f(i));
+        T res=0,cres=0;
+        for(int l=0;l<4;l++) {
+            add(res,cres,s[l]);
+            add(res,cres,((T)0)-c[l]);
+        }
+        return res-cres;
+    };
+    /*!\brief Adds x to the sum s with compensation c. */
+    template <class T> static inline void add(T &s, T &c, const T &x) {
+        T y=x-c;
+        T t=s+y;
+        c=(t-s)-y;
+        s=t;
+    };
+};
+/* }}} */
+/* PairwiseSum {{{ */
+/*!\brief Sums recursively by halves. */
+struct PairwiseSum {
+    /*!\brief Returns the sum of f(i) for i in [i0,i1). */
+    template <class T, class F> static T sum(long long i0, long long i1,
+            const F &f) {
+        if(i1-i0<=PAIRWISE_LEAF)
+            return PlainSum::sum<T>(i0,i1,f);
+        const long long h=i0+(i1-i0)/2;
+        return sum<T>(i0,h,f)+sum<T>(h,i1,f);
+    };
+};
+/* }}} */
+/* reduce {{{ */
+/*!\brief Returns the sum of f(i) for i in [0,n) with policy S, in
+ * parallel. */
+template <class S, class T, class F> T reduce(long long n, const F &f) {
+    if(n<=REDUCE_BLOCK)
+        return S::template sum<T>(0,n,f);
+    const long long nb=(n+REDUCE_BLOCK-1)/REDUCE_BLOCK;
+    vector<T> partial(nb);
+    parallelForLocal(nb,KERNEL_GRAIN/REDUCE_BLOCK,
+            [&](long long b0, long long b1) {
+        for(long long b=b0;b<b1;b++) {
+            const long long i1=(b+1)*REDUCE_BLOCK;
+            partial[b]=S::template sum<T>(b*REDUCE_BLOCK,(i1<n?i1:n),f);
+        }
+    });
+    return S::template sum<T>(0,nb,[&](long long b) { return partial[b]; });
+};
+/* }}} */
+/* Array reductions {{{ */
+/*!\brief Returns the sum of the elements. */
+template <class S=PlainSum, class T> T sum(long long n, const T *x) {
+    return reduce<S,T>(n,[&](long long i) { return x[i]; });
+};
+/*!\brief Returns the scalar product sum x(i)*y(i). */
+template <class S=PlainSum, class T> T dot(long long n, const T *x,
+        const T *y) {
+    return reduce<S,T>(n,[&](long long i) { return x[i]*y[i]; });
+};
+/*!\brief Returns the euclidian norm. */
+template <class S=PlainSum, class T> double norm2(long long n, const T *x) {
+    return sqrt(reduce<S,double>(n,
+                [&](long long i) { return (double)magnitude2(x[i]); }));
+};
+/*!\brief Returns the index of the element of largest modulus, the first
+ * one in case of ties, or -1 if n is 0. */
+template <class T> long long argmax(long long n, const T *x) {
+    if(n<=0)
+        return -1;
+    const long long nb=(n+REDUCE_BLOCK-1)/REDUCE_BLOCK;
+    vector<long long> partial(nb);
+    parallelForLocal(nb,KERNEL_GRAIN/REDUCE_BLOCK,
+            [&](long long b0, long long b1) {
+        for(long long b=b0;b<b1;b++) {
+            const long long i1=((b+1)*REDUCE_BLOCK<n?(b+1)*REDUCE_BLOCK:n);
+            long long k=b*REDUCE_BLOCK;
+            double m=magnitude2(x[k]);
+            for(long long i=k+1;i<i1;i++)
+                if(magnitude2(x[i])>m) {
+                    m=magnitude2(x[i]);
+                    k=i;
+                }
+            partial[b]=k;
+        }
+    });
+    long long k=partial[0];
+    for(long long b=1;b<nb;b++)
+        if(magnitude2(x[partial[b]])>magnitude2(x[k]))
+            k=partial[b];
+    return k;
+};
+/*!\brief Returns the largest modulus of the elements, 0 if n is 0. */
+template <class T> double maxAbs(long long n, const T *x) {
+    return (n>0?(double)magnitude(x[argmax(n,x)]):0.);
+};
+/*!\brief Divides the elements by the euclidian norm, returns the norm.
+ *
+ * The elements are left unchanged if the norm is zero.
+ */
+template <class S=PlainSum, class T> double normalize(long long n, T *x) {
+    const double norm=norm2<S>(n,x);
+    if(norm==0)
+        return norm;
+    kernelScale(n,(T)(1./norm),x);
+    return norm;
+};
+/*!\brief Returns the scalar product sum x(i)*y(i) and sets norm to the
+ * euclidian norm of y.
+ *
+ * Both sums are computed block by block, the second one while the block
+ * of y is still in cache, so that the arrays are read once from memory.
+ */
+template <class S=PlainSum, class T> T dotNorm(long long n, const T *x,
+        const T *y, double &norm) {
+    const long long nb=(n+REDUCE_BLOCK-1)/REDUCE_BLOCK;
+    vector<T> pdot(nb);
+    vector<double> pnorm(nb);
+    parallelForLocal(nb,KERNEL_GRAIN/REDUCE_BLOCK,
+            [&](long long b0, long long b1) {
+        for(long long b=b0;b<b1;b++) {
+            const long long i0=b*REDUCE_BLOCK;
+            const long long i1=(i0+REDUCE_BLOCK<n?i0+REDUCE_BLOCK:n);
+            pdot[b]=S::template sum<T>(i0,i1,
+                    [&](long long i) { return x[i]*y[i]; });
+            pnorm[b]=S::template sum<double>(i0,i1,
+                    [&](long long i) { return (double)magnitude2(y[i]); });
+        }
+    });
+    norm=sqrt(S::template sum<double>(0,nb,
+                [&](long long b) { return pnorm[b]; }));
+    return S::template sum<T>(0,nb,[&](long long b) { return pdot[b]; });
+};
+/* }}} */
+/* Vector reductions {{{ */
+/*!\brief Returns the sum of the elements. */
+template <class S=PlainSum, class T> T sum(const Vector<T> &x) {
+    return sum<S>(x.size(),x.data());
+};
+/*!\brief Returns the euclidian norm. */
+template <class S=PlainSum, class T> double norm2(const Vector<T> &x) {
+    return norm2<S>(x.size(),x.data());
+};
+/*!\brief Returns the largest modulus of the elements. */
+template <class T> double maxAbs(const Vector<T> &x) {
+    return maxAbs(x.size(),x.data());
+};
+/*!\brief Returns the index of the element of largest modulus. */
+template <class T> int argmax(const Vector<T> &x) {
+    return (int)argmax(x.size(),x.data());
+};
+/*!\brief Divides the elements by the euclidian norm, returns the norm. */
+template <class S=PlainSum, class T> double normalize(Vector<T> &x) {
+    return normalize<S>(x.size(),x.data());
+};
+/*!\brief Returns b*k and sets norm to the euclidian norm of k, in a
+ * single pass. */
+template <class S=PlainSum, class T> T dotNorm(const Bra<T> &b,
+        const Ket<T> &k, double &norm) {
+    if(b.size()!=k.size())
+        throw incompatibleSizes;
+    return dotNorm<S>(b.size(),b.data(),k.data(),norm);
+};
+/* }}} */
+#endif //REDUCTIONS_H
+/* reductions.h */
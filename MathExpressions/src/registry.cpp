@@ -0,0 +1,125 @@
+/* This file is a part of MathExpression. {{{
+ * Copyright (C) 2012 Romain Dubessy
+ *
+ * MathExpression is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MathExpression is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MathExpression.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * }}} */
+#include <cctype>
+#include "expression.h"
+#include "threadpool.h"
+#include "registry.h"
+/*!\brief Minimal number of function calls processed by a thread. */
+#define FUNCTION_GRAIN 2048
+/* Built-in derivatives {{{ */
+static double dExp(const double *x) { return exp(x[0]); }
+static double dSqrt(const double *x) { return 0.5/sqrt(x[0]); }
+static double dErf(const double *x) {
+    return 2/sqrt(M_PI)*exp(-x[0]*x[0]);
+}
+static double dCos(const double *x) { return -sin(x[0]); }
+static double dSin(const double *x) { return cos(x[0]); }
+static double dTan(const double *x) {
+    const double t=tan(x[0]);
+    return 1+t*t;
+}
+static double dCosh(const double *x) { return sinh(x[0]); }
+static double dSinh(const double *x) { return cosh(x[0]); }
+static double dTanh(const double *x) {
+    const double t=tanh(x[0]);
+    return 1-t*t;
+}
+static double dLog(const double *x) { return 1/x[0]; }
+/* }}} */
+/* FunctionRegistry class implementation {{{ */
+FunctionRegistry::FunctionRegistry(void) {
+    //Same order as funcNames.
+    double (*derivatives[])(const double *)={dExp,dSqrt,dErf,dCos,dSin,
+        dTan,dCosh,dSinh,dTanh,dLog};
+    for(int i=0;i<Nfunc;i++) {
+        FunctionInfo f;
+        f.name=funcNames[i];
+        f.nargs=1;
+        double (*p)(double)=funcPointers[i];
+        f.scalar=[p](const double *x) { return p(x[0]); };
+        f.batch=[i](long long n, const double *const *x, double *out) {
+            funcApply(i,n,x[0],out);
+        };
+        f.derivatives.push_back(derivatives[i]);
+        f.flags=functionPure|functionThreadSafe;
+        add(f);
+    }
+}
+int FunctionRegistry::add(const FunctionInfo &f) {
+    if(f.name.empty() || !isalpha(f.name[0]) || f.nargs<0 || !f.scalar
+            || (!f.derivatives.empty() && (int)f.derivatives.size()!=f.nargs))
+        throw badFormat;
+    for(unsigned int k=0;k<f.name.size();k++)
+        if(!isalnum(f.name[k]))
+            throw badFormat;
+    if(_index.find(f.name)!=_index.end())
+        throw alreadyDefined;
+    _funcs.push_back(f);
+    _index[f.name]=_funcs.size()-1;
+    return _funcs.size()-1;
+}
+int FunctionRegistry::find(const string &name) const {
+    std::unordered_map<string,int>::const_iterator it=_index.find(name);
+    return (it==_index.end()?-1:it->second);
+}
+const FunctionInfo &FunctionRegistry::operator[](int id) const {
+    if(id<0 || id>=(int)_funcs.size())
+        throw unknownFunction;
+    return _funcs[id];
+}
+void FunctionRegistry::batch(int id, long long n, const double *const *x,
+        double *out) const {
+    const FunctionInfo &f=(*this)[id];
+    if(f.batch) {
+        f.batch(n,x,out);
+        return;
+    }
+    vector<double> a(f.nargs>0?f.nargs:1);
+    for(long long i=0;i<n;i++) {
+        for(int k=0;k<f.nargs;k++)
+            a[k]=x[k][i];
+        out[i]=f.scalar(&a[0]);
+    }
+}
+void FunctionRegistry::apply(int id, long long n, const double *const *x,
+        double *out) const {
+    const FunctionInfo &f=(*this)[id];
+    PROFILE_CALL(id,n);
+    if(!(f.flags&functionThreadSafe)) {
+        batch(id,n,x,out);
+        return;
+    }
+    parallelForLocal(n,FUNCTION_GRAIN,[&](long long i0, long long i1) {
+        vector<const double *> y(f.nargs>0?f.nargs:1);
+        for(int k=0;k<f.nargs;k++)
+            y[k]=x[k]+i0;
+        batch(id,i1-i0,&y[0],out+i0);
+    });
+}
+double FunctionRegistry::derivative(int id, int k, const double *x) const {
+    const FunctionInfo &f=(*this)[id];
+    if(k<0 || k>=(int)f.derivatives.size())
+        throw outOfBounds;
+    return f.derivatives[k](x);
+}
+FunctionRegistry &functionRegistry(void) {
+    static FunctionRegistry registry;
+    return registry;
+}
+/* }}} */
+/* registry.cpp */
@@ -0,0 +1,87 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef REGISTRY_H
+#define REGISTRY_H
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+using std::string;
+using std::vector;
+/*!\brief Scalar implementation of a function, x holds the arguments. */
+typedef std::function<double(const double *x)> ScalarFunction;
+/*!\brief Batch implementation of a function.
+ *
+ * Computes out[i]=f(x[0][i],...,x[nargs-1][i]) for i<n, out may be one of
+ * the inputs.
+ */
+typedef std::function<void(long long n, const double *const *x,
+        double *out)> BatchFunction;
+/*!\brief Function flags. */
+enum FunctionFlags {
+    functionPure=1,         //!<\brief Only depends on its arguments.
+    functionThreadSafe=2    //!<\brief May be called by several threads.
+};
+/*!\brief Description of a function, as registered. */
+struct FunctionInfo {
+    string name;            //!<\brief Name used in expressions.
+    int nargs;              //!<\brief Number of arguments.
+    ScalarFunction scalar;  //!<\brief Scalar implementation.
+    BatchFunction batch;    //!<\brief Batch implementation, may be empty.
+    vector<ScalarFunction> derivatives; //!<\brief Partial derivatives,
+                                        //!< empty or one per argument.
+    unsigned int flags;     //!<\brief Function flags, see FunctionFlags.
+};
+/* FunctionRegistry {{{ */
+/*!\brief Functions usable in expressions, by name and by identifier.
+ *
+ * The functions of funcNames are registered first, so that their
+ * identifiers are their index in funcNames. Names are looked up in a hash
+ * table.
+ * Calls with constant arguments are folded by simplify only for pure
+ * functions, other calls are made by evaluate and by programs.
+ * Batch calls are split across the threads of the pool for thread safe
+ * functions, functions without a batch implementation are called point by
+ * point.
+ * Functions are registered before being used: registering while other
+ * threads parse or evaluate expressions is not supported.
+ */
+class FunctionRegistry {
+    public:
+        /*!\brief Constructor, registers the functions of funcNames. */
+        FunctionRegistry(void);
+        /*!\brief Registers a function, returns its identifier.
+         *
+         * Names start with a letter and contain letters and digits only,
+         * a name can be registered once.
+         */
+        int add(const FunctionInfo &f);
+        /*!\brief Returns the identifier of a function, -1 if not found. */
+        int find(const string &name) const;
+        /*!\brief Returns the number of functions. */
+        int size(void) const { return _funcs.size(); };
+        /*!\brief Returns the description of a function. */
+        const FunctionInfo &operator[](int id) const;
+        /*!\brief Returns f(x[0],...,x[nargs-1]). */
+        double call(int id, const double *x) const {
+            return (*this)[id].scalar(x);
+        };
+        /*!\brief Calls function id on n points, in the calling thread. */
+        void batch(int id, long long n, const double *const *x,
+                double *out) const;
+        /*!\brief Calls function id on n points, in parallel if possible. */
+        void apply(int id, long long n, const double *const *x,
+                double *out) const;
+        /*!\brief Returns the partial derivative k of function id at x. */
+        double derivative(int id, int k, const double *x) const;
+    private:
+        FunctionRegistry(const FunctionRegistry &);
+        FunctionRegistry &operator=(const FunctionRegistry &);
+        std::deque<FunctionInfo> _funcs;        //!<\brief Functions.
+        std::unordered_map<string,int> _index;  //!<\brief Names index.
+};
+/*!\brief Returns the library function registry. */
+FunctionRegistry &functionRegistry(void);
+/* }}} */
+#endif //REGISTRY_H
+/* registry.h */
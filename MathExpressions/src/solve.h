@@ -0,0 +1,115 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef SOLVE_H
+#define SOLVE_H
+#include <vector>
+#include "myexceptions.h"
+#include "matrix.h"
+#include "complex.h"
+#include "kernels.h"
+using std::vector;
+/* LU {{{ */
+/*!\brief LU factorization with partial pivoting of a square matrix.
+ *
+ * The factors are stored row by row in a single matrix, so that the
+ * elimination and the substitutions only run over contiguous rows.
+ */
+template <class T> class LU {
+    public:
+        /*!\brief Factorizes a, throws singular if a is not invertible. */
+        LU(const Matrix<T> &a) : _lu(a) {
+            if(!a.isSquare())
+                throw notSquare;
+            const int n=a.n();
+            T *lu=_lu.data();
+            _piv.resize(n);
+            _sign=1;
+            for(int k=0;k<n;k++) {
+                int p=k;
+                for(int i=k+1;i<n;i++)
+                    if(magnitude(lu[i*n+k])>magnitude(lu[p*n+k]))
+                        p=i;
+                _piv[k]=p;
+                if(lu[p*n+k]==(T)0)
+                    throw singular;
+                if(p!=k) {
+                    for(int j=0;j<n;j++) {
+                        T tmp=lu[k*n+j];
+                        lu[k*n+j]=lu[p*n+j];
+                        lu[p*n+j]=tmp;
+                    }
+                    _sign=-_sign;
+                }
+                T inv=((T)1)/lu[k*n+k];
+                for(int i=k+1;i<n;i++) {
+                    T l=lu[i*n+k]*inv;
+                    lu[i*n+k]=l;
+                    kernelAxpy(n-k-1,((T)0)-l,lu+k*n+k+1,lu+i*n+k+1);
+                }
+            }
+        };
+        /*!\brief Returns the size of the system. */
+        int n(void) const { return _lu.n(); };
+        /*!\brief Returns the determinant. */
+        T det(void) const {
+            T res=(T)_sign;
+            for(int i=0;i<n();i++)
+                res*=_lu.data()[i*n()+i];
+            return res;
+        };
+        /*!\brief Solves a*x=b in place, b has p columns and row stride ldb.
+         */
+        void solve(T *b, int p, long ldb) const {
+            const int n=_lu.n();
+            const T *lu=_lu.data();
+            for(int k=0;k<n;k++)
+                if(_piv[k]!=k)
+                    for(int j=0;j<p;j++) {
+                        T tmp=b[k*ldb+j];
+                        b[k*ldb+j]=b[_piv[k]*ldb+j];
+                        b[_piv[k]*ldb+j]=tmp;
+                    }
+            for(int i=1;i<n;i++)
+                for(int k=0;k<i;k++)
+                    kernelAxpy(p,((T)0)-lu[i*n+k],b+k*ldb,b+i*ldb);
+            for(int i=n-1;i>=0;i--) {
+                for(int k=i+1;k<n;k++)
+                    kernelAxpy(p,((T)0)-lu[i*n+k],b+k*ldb,b+i*ldb);
+                T inv=((T)1)/lu[i*n+i];
+                for(int j=0;j<p;j++)
+                    b[i*ldb+j]*=inv;
+            }
+        };
+        /*!\brief Returns the solution of a*x=b. */
+        Matrix<T> solve(const Matrix<T> &b) const {
+            if(b.n()!=n())
+                throw incompatibleSizes;
+            Matrix<T> x(b);
+            solve(x.data(),x.m(),x.m());
+            return x;
+        };
+        /*!\brief Returns the solution of a*x=b. */
+        Ket<T> solve(const Ket<T> &b) const {
+            if(b.size()!=n())
+                throw incompatibleSizes;
+            Ket<T> x(b);
+            solve(x.data(),1,1);
+            return x;
+        };
+    private:
+        Matrix<T> _lu;      //!<\brief L (unit diagonal) and U factors.
+        vector<int> _piv;   //!<\brief Row exchanged with row k at step k.
+        int _sign;          //!<\brief Sign of the permutation.
+};
+/* }}} */
+/* solve {{{ */
+/*!\brief Returns the solution of a*x=b. */
+template <class T> Matrix<T> solve(const Matrix<T> &a, const Matrix<T> &b) {
+    return LU<T>(a).solve(b);
+};
+/*!\brief Returns the solution of a*x=b. */
+template <class T> Ket<T> solve(const Matrix<T> &a, const Ket<T> &b) {
+    return LU<T>(a).solve(b);
+};
+/* }}} */
+#endif //SOLVE_H
+/* solve.h */
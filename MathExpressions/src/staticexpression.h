@@ -0,0 +1,286 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef STATICEXPRESSION_H
+#define STATICEXPRESSION_H
+#if __cplusplus < 201703L
+#error "staticexpression.h requires a C++17 compiler."
+#endif
+#include <cmath>
+/*!\brief Compile-time front end of the expression parser.
+ *
+ * The expression and the comma separated list of its variables are given as
+ * static constexpr character arrays, for example:
+ * \code
+ * static constexpr char f[]="X+Exp[Y*Z]";
+ * static constexpr char v[]="X,Y,Z";
+ * double x[3]={1,2,3};
+ * double r=StaticExpression<f,v>::evaluate(x);
+ * \endcode
+ * The string is parsed by the compiler into a tree of types, following the
+ * rules of parseString, and evaluate() is a chain of inline calls without any
+ * map lookup or virtual dispatch.
+ * Variables are bound to the input array by their position in the list.
+ * Vector and matrix constants are not supported.
+ */
+/* Parsing helpers {{{ */
+/*!\brief Returns the length of a null terminated string. */
+constexpr int staticLength(const char *s) {
+    int n=0;
+    while(s[n]!=0)
+        n++;
+    return n;
+}
+/*!\brief Returns the position of the rightmost c outside brackets in [b,e),
+ * -1 if not found and -2 if brackets are unbalanced. */
+constexpr int staticFind(const char *s, int b, int e, char c) {
+    int p=0;
+    for(int n=e-1;n>=b;n--) {
+        if(s[n]=='(' || s[n]=='[' || s[n]=='{')
+            p++;
+        else if(s[n]==')' || s[n]==']' || s[n]=='}')
+            p--;
+        else if(p==0 && s[n]==c) {
+            //Same early return as find(), the remaining brackets are checked
+            //when the operands are parsed.
+            return n;
+        }
+    }
+    return (p==0?-1:-2);
+}
+/*!\brief Returns the binary operator splitting [b,e), 0 if none. */
+constexpr char staticOperator(const char *s, int b, int e) {
+    const char c[]={'+','-','*','/','^'};
+    for(int i=0;i<5;i++)
+        if(staticFind(s,b,e,c[i])!=-1)
+            return c[i];
+    return 0;
+}
+/*!\brief Compares [b,e) with a null terminated string. */
+constexpr bool staticEqual(const char *s, int b, int e, const char *t) {
+    int i=0;
+    for(;b+i<e;i++)
+        if(t[i]!=s[b+i])
+            return false;
+    return t[i]==0;
+}
+/*!\brief Returns the position of the first c in [b,e), -1 if not found. */
+constexpr int staticFirst(const char *s, int b, int e, char c) {
+    for(int n=b;n<e;n++)
+        if(s[n]==c)
+            return n;
+    return -1;
+}
+/*!\brief Returns the index of the function named [b,e), -1 if unknown.
+ *
+ * The order is the one of funcNames.
+ */
+constexpr int staticFunction(const char *s, int b, int e) {
+    const char *names[]={"Exp","Sqrt","Erf","Cos","Sin","Tan","Cosh","Sinh",
+        "Tanh","Log"};
+    for(int i=0;i<10;i++)
+        if(staticEqual(s,b,e,names[i]))
+            return i;
+    return -1;
+}
+/*!\brief Returns the position of the variable [b,e) in a comma separated
+ * list, -1 if not found. */
+constexpr int staticVariable(const char *vars, const char *s, int b, int e) {
+    int k=0;
+    int i=0;
+    while(true) {
+        int j=i;
+        while(vars[j]!=',' && vars[j]!=0)
+            j++;
+        bool same=(j-i==e-b);
+        for(int l=0;same && l<e-b;l++)
+            same=(vars[i+l]==s[b+l]);
+        if(same)
+            return k;
+        if(vars[j]==0)
+            return -1;
+        i=j+1;
+        k++;
+    }
+}
+/*!\brief Converts [b,e) to a double, as atof would.
+ *
+ * The result is correctly rounded as long as the mantissa holds in 15
+ * digits and the decimal exponent is below 22.
+ */
+constexpr double staticNumber(const char *s, int b, int e) {
+    double m=0;
+    int exp10=0;
+    int i=b;
+    for(;i<e && s[i]>='0' && s[i]<='9';i++)
+        m=10*m+(s[i]-'0');
+    if(i<e && s[i]=='.') {
+        for(i++;i<e && s[i]>='0' && s[i]<='9';i++) {
+            m=10*m+(s[i]-'0');
+            exp10--;
+        }
+    }
+    if(i+1<e && (s[i]=='e' || s[i]=='E')) {
+        int x=0;
+        for(i++;i<e && s[i]>='0' && s[i]<='9';i++)
+            x=10*x+(s[i]-'0');
+        exp10+=x;
+    }
+    double p=1;
+    for(int k=0;k<(exp10<0?-exp10:exp10);k++)
+        p*=10;
+    return (exp10<0?m/p:m*p);
+}
+/*!\brief Kind of the sub-expression [b,e), see parseString. */
+enum StaticKind {
+    staticEmpty,
+    staticBinary,
+    staticParenthesis,
+    staticCall,
+    staticVector,
+    staticConstant,
+    staticVariableName
+};
+/*!\brief Classifies the sub-expression [b,e) as parseString does. */
+constexpr StaticKind staticKind(const char *s, int b, int e) {
+    if(e<=b)
+        return staticEmpty;
+    if(staticOperator(s,b,e)!=0)
+        return staticBinary;
+    if(s[b]=='(')
+        return staticParenthesis;
+    if(staticFirst(s,b,e,'[')!=-1)
+        return staticCall;
+    if(s[b]=='{')
+        return staticVector;
+    if(s[b]>='0' && s[b]<='9')
+        return staticConstant;
+    return staticVariableName;
+}
+/* }}} */
+/* Expression nodes {{{ */
+/*!\brief Constant node. */
+template <const char *S, int B, int E> struct StaticConstant {
+    static constexpr double value=staticNumber(S,B,E);
+    /*!\brief Evaluate method. */
+    static inline double evaluate(const double *) { return value; };
+};
+/*!\brief Zero node, produced by empty operands (ie "-X"). */
+struct StaticZero {
+    /*!\brief Evaluate method. */
+    static inline double evaluate(const double *) { return 0; };
+};
+/*!\brief Variable node, bound to the K-th input. */
+template <int K> struct StaticVariable {
+    /*!\brief Evaluate method. */
+    static inline double evaluate(const double *x) { return x[K]; };
+};
+/*!\brief Binary operation node. */
+template <char C, class L, class R> struct StaticBinaryOp;
+template <class L, class R> struct StaticBinaryOp<'+',L,R> {
+    static inline double evaluate(const double *x) {
+        return L::evaluate(x)+R::evaluate(x);
+    };
+};
+template <class L, class R> struct StaticBinaryOp<'-',L,R> {
+    static inline double evaluate(const double *x) {
+        return L::evaluate(x)-R::evaluate(x);
+    };
+};
+template <class L, class R> struct StaticBinaryOp<'*',L,R> {
+    static inline double evaluate(const double *x) {
+        return L::evaluate(x)*R::evaluate(x);
+    };
+};
+template <class L, class R> struct StaticBinaryOp<'/',L,R> {
+    static inline double evaluate(const double *x) {
+        return L::evaluate(x)/R::evaluate(x);
+    };
+};
+template <class L, class R> struct StaticBinaryOp<'^',L,R> {
+    static inline double evaluate(const double *x) {
+        return std::pow(L::evaluate(x),R::evaluate(x));
+    };
+};
+/*!\brief Single value function node, I indexes funcNames. */
+template <int I, class A> struct StaticFunction;
+#define STATIC_FUNCTION(I,f) \
+template <class A> struct StaticFunction<I,A> { \
+    static inline double evaluate(const double *x) { \
+        return std::f(A::evaluate(x)); \
+    }; \
+};
+STATIC_FUNCTION(0,exp)
+STATIC_FUNCTION(1,sqrt)
+STATIC_FUNCTION(2,erf)
+STATIC_FUNCTION(3,cos)
+STATIC_FUNCTION(4,sin)
+STATIC_FUNCTION(5,tan)
+STATIC_FUNCTION(6,cosh)
+STATIC_FUNCTION(7,sinh)
+STATIC_FUNCTION(8,tanh)
+STATIC_FUNCTION(9,log)
+#undef STATIC_FUNCTION
+/* }}} */
+/* Parser {{{ */
+/*!\brief Parses [B,E) into a node type. */
+template <const char *S, const char *V, int B, int E,
+         StaticKind K=staticKind(S,B,E)> struct StaticParse;
+template <const char *S, const char *V, int B, int E>
+struct StaticParse<S,V,B,E,staticEmpty> {
+    typedef StaticZero type;
+};
+template <const char *S, const char *V, int B, int E>
+struct StaticParse<S,V,B,E,staticBinary> {
+    static constexpr char op=staticOperator(S,B,E);
+    static constexpr int index=staticFind(S,B,E,op);
+    static_assert(index>=0,"Incorrect expression!");
+    typedef StaticBinaryOp<op,
+            typename StaticParse<S,V,B,(index<0?B:index)>::type,
+            typename StaticParse<S,V,(index<0?B:index+1),E>::type> type;
+};
+template <const char *S, const char *V, int B, int E>
+struct StaticParse<S,V,B,E,staticParenthesis> {
+    static_assert(S[E-1]==')',"Incorrect expression!");
+    typedef typename StaticParse<S,V,B+1,E-1>::type type;
+};
+template <const char *S, const char *V, int B, int E>
+struct StaticParse<S,V,B,E,staticCall> {
+    static constexpr int bra=staticFirst(S,B,E,'[');
+    static_assert(S[E-1]==']',"Incorrect expression!");
+    static constexpr int fun=staticFunction(S,B,bra);
+    static_assert(fun>=0,"Unknown function!");
+    typedef StaticFunction<fun,
+            typename StaticParse<S,V,bra+1,E-1>::type> type;
+};
+template <const char *S, const char *V, int B, int E>
+struct StaticParse<S,V,B,E,staticVector> {
+    static_assert(B<0,"Vector and matrix constants are not supported!");
+    typedef StaticZero type;
+};
+template <const char *S, const char *V, int B, int E>
+struct StaticParse<S,V,B,E,staticConstant> {
+    typedef StaticConstant<S,B,E> type;
+};
+template <const char *S, const char *V, int B, int E>
+struct StaticParse<S,V,B,E,staticVariableName> {
+    static constexpr int k=staticVariable(V,S,B,E);
+    static_assert(k>=0,"Variable not defined!");
+    typedef StaticVariable<k> type;
+};
+/* }}} */
+/* StaticExpression {{{ */
+/*!\brief Expression parsed at compile time.
+ *
+ * \param S Expression string.
+ * \param V Comma separated list of the variable names.
+ */
+template <const char *S, const char *V> struct StaticExpression {
+    /*!\brief Expression tree, as a type. */
+    typedef typename StaticParse<S,V,0,staticLength(S)>::type type;
+    /*!\brief Evaluate method, x[k] is the value of the k-th variable. */
+    static inline double evaluate(const double *x) {
+        return type::evaluate(x);
+    };
+};
+/* }}} */
+#endif //STATICEXPRESSION_H
+/* staticexpression.h */
@@ -0,0 +1,812 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef TENSOR_H
+#define TENSOR_H
+#include <iostream>
+#include <string>
+#include <vector>
+#include <utility>
+#include <initializer_list>
+#include "myexceptions.h"
+#include "checking.h"
+#include "matrix.h"
+#include "kernels.h"
+#include "transpose.h"
+#include "threadpool.h"
+#include "reductions.h"
+using std::ostream;
+using std::string;
+using std::vector;
+using std::pair;
+template <class T> class Tensor;
+/*!\brief Dense tensors of arbitrary rank.
+ *
+ * Tensor owns its elements, stored contiguously with the last index running
+ * fastest. TensorView references elements owned by another container
+ * through a pointer, dimensions and strides, with the same conventions as
+ * VectorView and MatrixView: building a view never copies, assignment
+ * copies elements and views do not propagate constness.
+ * Contractions are written with the einsum notation, eg "ij,jk->ik", and
+ * lowered to gemm after the operands are transposed to the required
+ * layout.
+ */
+/*!\brief Maximal number of operands for the exhaustive contraction order
+ * search, a greedy search is used above. */
+#define TENSOR_OPTIMAL 10
+/* TensorView {{{ */
+/*!\brief This class implements a strided view of a tensor. */
+template <class T> class TensorView {
+    public:
+        /* Constructors {{{ */
+        /*!\brief Default constructor. */
+        TensorView(T *data, const vector<int> &dims,
+                const vector<long> &strides) : _dims(dims), _strides(strides) {
+            if(dims.size()!=strides.size())
+                throw incompatibleSizes;
+            _data=data;
+        };
+        /*!\brief Contiguous view, the last index running fastest. */
+        TensorView(T *data, const vector<int> &dims) : _dims(dims),
+            _strides(dims.size()) {
+            _data=data;
+            long s=1;
+            for(int k=rank()-1;k>=0;k--) {
+                _strides[k]=s;
+                s*=dims[k];
+            }
+        };
+        /*!\brief Contiguous view of a tensor. */
+        TensorView(const Tensor<T> &other);
+        /*!\brief Copy constructor, the elements are shared. */
+        TensorView(const TensorView<T> &other) : _dims(other._dims),
+            _strides(other._strides) {
+            _data=other._data;
+        };
+        /* }}} */
+        /* Access member methods {{{ */
+        /*!\brief Returns the number of indices. */
+        int rank(void) const { return _dims.size(); };
+        /*!\brief Returns the dimension of index k. */
+        int dim(int k) const { return _dims.at(k); };
+        /*!\brief Returns the dimensions. */
+        const vector<int> &dims(void) const { return _dims; };
+        /*!\brief Returns the distance between two elements along index k. */
+        long stride(int k) const { return _strides.at(k); };
+        /*!\brief Returns the number of elements. */
+        long size(void) const {
+            long s=1;
+            for(int k=0;k<rank();k++)
+                s*=_dims[k];
+            return s;
+        };
+        /*!\brief Returns a pointer to the first element. */
+        T *data(void) const { return _data; };
+        /*!\brief Access member method. */
+        T &at(const vector<int> &i) const { return get<Checked>(i); };
+        /*!\brief Access member method, with checking policy P. */
+        template <class P> T &get(const vector<int> &i) const {
+            P::check((int)i.size()==rank());
+            long o=0;
+            for(int k=0;k<rank();k++) {
+                P::check(i[k]>=0 && i[k]<_dims[k]);
+                o+=i[k]*_strides[k];
+            }
+            return _data[o];
+        };
+        /*!\brief Returns true if the elements are contiguous, the last index
+         * running fastest. */
+        bool isContiguous(void) const {
+            long s=1;
+            for(int k=rank()-1;k>=0;k--) {
+                if(_dims[k]!=1 && _strides[k]!=s)
+                    return false;
+                s*=_dims[k];
+            }
+            return true;
+        };
+        /*!\brief Returns a view with permuted indices, index k of the result
+         * being index perm[k] of this view. */
+        TensorView<T> permute(const vector<int> &perm) const {
+            if((int)perm.size()!=rank())
+                throw incompatibleSizes;
+            vector<int> d(rank());
+            vector<long> s(rank());
+            vector<bool> seen(rank(),false);
+            for(int k=0;k<rank();k++) {
+                if(perm[k]<0 || perm[k]>=rank() || seen[perm[k]])
+                    throw outOfBounds;
+                seen[perm[k]]=true;
+                d[k]=_dims[perm[k]];
+                s[k]=_strides[perm[k]];
+            }
+            return TensorView<T>(_data,d,s);
+        };
+        /*!\brief Returns a view with other dimensions and the same number of
+         * elements, the view must be contiguous. */
+        TensorView<T> reshape(const vector<int> &dims) const {
+            long s=1;
+            for(unsigned int k=0;k<dims.size();k++)
+                s*=dims[k];
+            if(s!=size() || !isContiguous())
+                throw incompatibleSizes;
+            return TensorView<T>(_data,dims);
+        };
+        /*!\brief Copies the elements to the contiguous array dst. */
+        void copy(T *dst) const;
+        /*!\brief Friend standard output operator. */
+        friend ostream &operator<<(ostream &os, const TensorView<T> &other) {
+            Tensor<T> tmp(other);
+            return os << tmp;
+        };
+        /* }}} */
+        /* Algebraic operators {{{ */
+        /*!\brief Assignement operator, copies the elements.
+         *
+         * Overlapping views are copied through a temporary tensor.
+         */
+        TensorView<T> &operator=(const TensorView<T> &other) {
+            if(_dims!=other._dims)
+                throw incompatibleSizes;
+            if(other._data==_data && other._strides==_strides)
+                return *this;
+            if(isContiguous() && !overlaps(other))
+                other.copy(_data);
+            else {
+                Tensor<T> tmp(other);
+                assign(tmp.data());
+            }
+            return *this;
+        };
+        /* }}} */
+    private:
+        /*!\brief Bounds of the offsets spanned by the view. */
+        void extent(long &lo, long &hi) const {
+            lo=hi=0;
+            for(int k=0;k<rank();k++) {
+                if(_dims[k]==0) {
+                    lo=1;
+                    hi=0;
+                    return;
+                }
+                const long o=(long)(_dims[k]-1)*_strides[k];
+                (o<0?lo:hi)+=o;
+            }
+        };
+        /*!\brief Returns true if the views may share elements. */
+        bool overlaps(const TensorView<T> &other) const {
+            long alo,ahi,blo,bhi;
+            extent(alo,ahi);
+            other.extent(blo,bhi);
+            if(alo>ahi || blo>bhi)
+                return false;
+            return rangesOverlap((const T *)_data,alo,ahi,
+                    (const T *)other._data,blo,bhi);
+        };
+        /*!\brief Copies the contiguous array src into this view. */
+        void assign(const T *src) {
+            const long n=size();
+            vector<int> i(rank(),0);
+            for(long e=0;e<n;e++) {
+                long o=0;
+                for(int k=0;k<rank();k++)
+                    o+=i[k]*_strides[k];
+                _data[o]=src[e];
+                for(int k=rank()-1;k>=0 && ++i[k]==_dims[k];k--)
+                    i[k]=0;
+            }
+        };
+        T *_data;               //!<\brief First element.
+        vector<int> _dims;      //!<\brief Dimensions.
+        vector<long> _strides;  //!<\brief Distances between elements.
+};
+/* }}} */
+/* Tensor {{{ */
+/*!\brief This class implements a dense tensor container. */
+template <class T> class Tensor {
+    public:
+        /* Constructors {{{ */
+        /*!\brief Default constructor, the elements are set to zero.
+         *
+         * A tensor without dimensions has rank 0 and holds one element.
+         */
+        Tensor(const vector<int> &dims=vector<int>()) : _dims(dims) {
+            long s=1;
+            for(int k=0;k<rank();k++) {
+                if(dims[k]<0)
+                    throw outOfBounds;
+                s*=dims[k];
+            }
+            _data.assign(s,(T)0);
+        };
+        /*!\brief Default constructor, eg Tensor<T> t({2,3,4}). */
+        Tensor(std::initializer_list<int> dims) : Tensor(vector<int>(dims)) {};
+        /*!\brief Copies the elements of a view. */
+        explicit Tensor(const TensorView<T> &other) : _dims(other.dims()),
+            _data(other.size()) {
+            if(!_data.empty())
+                other.copy(&_data[0]);
+        };
+        /*!\brief Copies a matrix into a rank 2 tensor. */
+        explicit Tensor(const Matrix<T> &other) : _dims(2),
+            _data(other.data(),other.data()+(long)other.n()*other.m()) {
+            _dims[0]=other.n();
+            _dims[1]=other.m();
+        };
+        /*!\brief Copies a vector into a rank 1 tensor. */
+        explicit Tensor(const Vector<T> &other) : _dims(1,other.size()),
+            _data(other.data(),other.data()+other.size()) {};
+        /* }}} */
+        /* Access member methods {{{ */
+        /*!\brief Returns the number of indices. */
+        int rank(void) const { return _dims.size(); };
+        /*!\brief Returns the dimension of index k. */
+        int dim(int k) const { return _dims.at(k); };
+        /*!\brief Returns the dimensions. */
+        const vector<int> &dims(void) const { return _dims; };
+        /*!\brief Returns the number of elements. */
+        long size(void) const { return _data.size(); };
+        /*!\brief Returns a pointer to the elements. */
+        T *data(void) { return (_data.empty()?0:&_data[0]); };
+        /*!\brief Returns a pointer to the elements. */
+        const T *data(void) const { return (_data.empty()?0:&_data[0]); };
+        /*!\brief Access member method. */
+        T &at(const vector<int> &i) { return get<Checked>(i); };
+        /*!\brief Access member method. */
+        T at(const vector<int> &i) const { return get<Checked>(i); };
+        /*!\brief Access member method, with checking policy P. */
+        template <class P> T &get(const vector<int> &i) {
+            return _data[offset<P>(i)];
+        };
+        /*!\brief Access member method, with checking policy P. */
+        template <class P> T get(const vector<int> &i) const {
+            return _data[offset<P>(i)];
+        };
+        /*!\brief Returns a view of the elements. */
+        TensorView<T> view(void) const { return TensorView<T>(*this); };
+        /*!\brief Returns a view with permuted indices, see TensorView. */
+        TensorView<T> permute(const vector<int> &perm) const {
+            return view().permute(perm);
+        };
+        /*!\brief Returns a view with other dimensions. */
+        TensorView<T> reshape(const vector<int> &dims) const {
+            return view().reshape(dims);
+        };
+        /*!\brief Returns a copy of a rank 2 tensor as a matrix. */
+        Matrix<T> matrix(void) const {
+            if(rank()!=2)
+                throw incompatibleSizes;
+            Matrix<T> res(_dims[0],_dims[1]);
+            for(long e=0;e<size();e++)
+                res.data()[e]=_data[e];
+            return res;
+        };
+        /*!\brief Friend standard output operator. */
+        friend ostream &operator<<(ostream &os, const Tensor<T> &other) {
+            for(long e=0;e<other.size();e++)
+                os << other._data[e] << " ";
+            return os;
+        };
+        /* }}} */
+        /* Iterators {{{ */
+        typedef T *iterator;                //!<\brief Contiguous iterator.
+        typedef const T *const_iterator;    //!<\brief Contiguous iterator.
+        /*!\brief Returns an iterator to the first element. */
+        iterator begin(void) { return data(); };
+        /*!\brief Returns an iterator past the last element. */
+        iterator end(void) { return data()+size(); };
+        /*!\brief Returns an iterator to the first element. */
+        const_iterator begin(void) const { return data(); };
+        /*!\brief Returns an iterator past the last element. */
+        const_iterator end(void) const { return data()+size(); };
+        /* }}} */
+    private:
+        /*!\brief Returns the position of element i. */
+        template <class P> long offset(const vector<int> &i) const {
+            P::check((int)i.size()==rank());
+            long o=0;
+            for(int k=0;k<rank();k++) {
+                P::check(i[k]>=0 && i[k]<_dims[k]);
+                o=o*_dims[k]+i[k];
+            }
+            return o;
+        };
+        vector<int> _dims;  //!<\brief Dimensions.
+        vector<T> _data;    //!<\brief Elements, last index fastest.
+};
+/* }}} */
+/* TensorView methods {{{ */
+template <class T> TensorView<T>::TensorView(const Tensor<T> &other)
+    : _dims(other.dims()), _strides(other.rank()) {
+    _data=const_cast<T *>(other.data());
+    long s=1;
+    for(int k=rank()-1;k>=0;k--) {
+        _strides[k]=s;
+        s*=_dims[k];
+    }
+};
+/*!\brief Copies the elements to the contiguous array dst.
+ *
+ * Indices that are contiguous in memory are merged first. If the fastest
+ * index of the destination is strided in the source but another index is
+ * contiguous, the copy is a set of matrix transpositions done with the
+ * cache oblivious kernel; otherwise it is a set of strided row copies.
+ * The outer indices are split across the threads.
+ */
+template <class T> void TensorView<T>::copy(T *dst) const {
+    //Merge indices, dropping dimensions 1.
+    vector<int> d;
+    vector<long> s;
+    for(int k=0;k<rank();k++) {
+        if(_dims[k]==0)
+            return;
+        if(_dims[k]==1)
+            continue;
+        if(!d.empty() && s.back()==_strides[k]*_dims[k]) {
+            d.back()*=_dims[k];
+            s.back()=_strides[k];
+        } else {
+            d.push_back(_dims[k]);
+            s.push_back(_strides[k]);
+        }
+    }
+    const int r=d.size();
+    if(r==0) {
+        dst[0]=_data[0];
+        return;
+    }
+    vector<long> ds(r);
+    ds[r-1]=1;
+    for(int k=r-2;k>=0;k--)
+        ds[k]=ds[k+1]*d[k+1];
+    int q=-1;
+    if(s[r-1]!=1)
+        for(int k=0;k<r-1;k++)
+            if(s[k]==1)
+                q=k;
+    //Outer indices: all but the last one, and q.
+    vector<int> outer;
+    long count=1;
+    for(int k=0;k<r-1;k++)
+        if(k!=q) {
+            outer.push_back(k);
+            count*=d[k];
+        }
+    const long inner=(long)d[r-1]*(q<0?1:d[q]);
+    const T *src=_data;
+    parallelFor(count,(inner>=KERNEL_GRAIN?1:KERNEL_GRAIN/inner),
+            [&](long long o0, long long o1) {
+        const int no=outer.size();
+        vector<int> i(no);
+        long long rem=o0;
+        for(int k=no-1;k>=0;k--) {
+            i[k]=rem%d[outer[k]];
+            rem/=d[outer[k]];
+        }
+        for(long long o=o0;o<o1;o++) {
+            long so=0,dO=0;
+            for(int k=0;k<no;k++) {
+                so+=i[k]*s[outer[k]];
+                dO+=i[k]*ds[outer[k]];
+            }
+            if(q<0) {
+                const long sl=s[r-1];
+                for(int j=0;j<d[r-1];j++)
+                    dst[dO+j]=src[so+j*sl];
+            } else
+                transposeCopy(src+so,s[r-1],dst+dO,ds[q],d[r-1],d[q]);
+            for(int k=no-1;k>=0 && ++i[k]==d[outer[k]];k--)
+                i[k]=0;
+        }
+    });
+};
+/* }}} */
+/* Contraction {{{ */
+/*!\brief Checks a list of labels and records the dimensions of its indices.
+ *
+ * Throws incorExpr if a label is repeated, incompatibleSizes if the rank
+ * or a dimension does not match.
+ */
+inline void tensorLabels(const string &l, const vector<int> &dims,
+        int size[256]) {
+    if(l.size()!=dims.size())
+        throw incompatibleSizes;
+    for(unsigned int k=0;k<l.size();k++) {
+        const unsigned char c=l[k];
+        if(l.find(l[k],k+1)!=string::npos)
+            throw incorExpr;
+        if(size[c]>=0 && size[c]!=dims[k])
+            throw incompatibleSizes;
+        size[c]=dims[k];
+    }
+};
+/*!\brief Returns the sum of a over the indices whose labels are not in
+ * keep, with labels kept in the order of la. */
+template <class T> Tensor<T> tensorSum(const TensorView<T> &a,
+        const string &la, const string &keep, string &lres) {
+    vector<int> perm,dims;
+    lres="";
+    for(int k=0;k<a.rank();k++)
+        if(keep.find(la[k])!=string::npos) {
+            perm.push_back(k);
+            dims.push_back(a.dim(k));
+            lres+=la[k];
+        }
+    long inner=1;
+    for(int k=0;k<a.rank();k++)
+        if(keep.find(la[k])==string::npos) {
+            perm.push_back(k);
+            inner*=a.dim(k);
+        }
+    Tensor<T> tmp(a.permute(perm));
+    Tensor<T> res(dims);
+    for(long e=0;e<res.size();e++)
+        res.data()[e]=sum(inner,tmp.data()+e*inner);
+    return res;
+};
+/*!\brief Returns the contraction of a and b, labelled by la and lb, with
+ * the indices of the result labelled by lc.
+ *
+ * Labels in la and lb but not in lc are summed over, labels in la, lb and
+ * lc are batch indices, and labels of a single operand missing from lc are
+ * summed over first. The operands are transposed to (batch,free,summed)
+ * and (batch,summed,free) layouts, copies being avoided when they already
+ * are, and each batch is a gemm call.
+ */
+template <class T> Tensor<T> contract(const TensorView<T> &a,
+        const string &la, const TensorView<T> &b, const string &lb,
+        const string &lc) {
+    int size[256];
+    for(int c=0;c<256;c++)
+        size[c]=-1;
+    tensorLabels(la,a.dims(),size);
+    tensorLabels(lb,b.dims(),size);
+    for(unsigned int k=0;k<lc.size();k++)
+        if(size[(unsigned char)lc[k]]<0 || lc.find(lc[k],k+1)!=string::npos)
+            throw incorExpr;
+    //Sum over the indices of a single operand first.
+    string keepa=lb+lc,keepb=la+lc;
+    for(unsigned int k=0;k<la.size();k++)
+        if(keepa.find(la[k])==string::npos) {
+            string l;
+            Tensor<T> s=tensorSum(a,la,keepa,l);
+            return contract(TensorView<T>(s),l,b,lb,lc);
+        }
+    for(unsigned int k=0;k<lb.size();k++)
+        if(keepb.find(lb[k])==string::npos) {
+            string l;
+            Tensor<T> s=tensorSum(b,lb,keepb,l);
+            return contract(a,la,TensorView<T>(s),l,lc);
+        }
+    //Classify the labels.
+    string batch,free_a,free_b,summed;
+    for(unsigned int k=0;k<la.size();k++) {
+        const bool inb=(lb.find(la[k])!=string::npos);
+        const bool inc=(lc.find(la[k])!=string::npos);
+        if(inb && inc)
+            batch+=la[k];
+        else if(inb)
+            summed+=la[k];
+        else
+            free_a+=la[k];
+    }
+    for(unsigned int k=0;k<lb.size();k++)
+        if(la.find(lb[k])==string::npos)
+            free_b+=lb[k];
+    long nb=1,m=1,n=1,p=1;
+    for(unsigned int k=0;k<batch.size();k++)
+        nb*=size[(unsigned char)batch[k]];
+    for(unsigned int k=0;k<free_a.size();k++)
+        n*=size[(unsigned char)free_a[k]];
+    for(unsigned int k=0;k<summed.size();k++)
+        m*=size[(unsigned char)summed[k]];
+    for(unsigned int k=0;k<free_b.size();k++)
+        p*=size[(unsigned char)free_b[k]];
+    //Transpose the operands.
+    const string oa=batch+free_a+summed,ob=batch+summed+free_b;
+    vector<int> pa(oa.size()),pb(ob.size());
+    for(unsigned int k=0;k<oa.size();k++)
+        pa[k]=la.find(oa[k]);
+    for(unsigned int k=0;k<ob.size();k++)
+        pb[k]=lb.find(ob[k]);
+    TensorView<T> va=a.permute(pa),vb=b.permute(pb);
+    vector<T> ca,cb;
+    const T *da=va.data(),*db=vb.data();
+    if(!va.isContiguous()) {
+        ca.resize(va.size());
+        va.copy(&ca[0]);
+        da=&ca[0];
+    }
+    if(!vb.isContiguous()) {
+        cb.resize(vb.size());
+        vb.copy(&cb[0]);
+        db=&cb[0];
+    }
+    //Multiply.
+    const string oc=batch+free_a+free_b;
+    vector<int> dims(oc.size());
+    for(unsigned int k=0;k<oc.size();k++)
+        dims[k]=size[(unsigned char)oc[k]];
+    Tensor<T> c(dims);
+    T *dd=c.data();
+    if(c.size()>0 && m>0) {
+        const long long work=(long long)n*m*p;
+        parallelFor(nb,(work>=KERNEL_GRAIN?1:KERNEL_GRAIN/(work>0?work:1)),
+                [&](long long b0, long long b1) {
+            for(long long t=b0;t<b1;t++)
+                gemm(n,m,p,da+t*n*m,m,db+t*m*p,p,dd+t*n*p,p);
+        });
+    }
+    if(oc==lc)
+        return c;
+    vector<int> pc(lc.size());
+    for(unsigned int k=0;k<lc.size();k++)
+        pc[k]=oc.find(lc[k]);
+    return Tensor<T>(c.permute(pc));
+};
+/* }}} */
+/* Contraction order {{{ */
+/*!\brief Returns an order of pairwise contractions of a tensor network.
+ *
+ * \param labels Labels of the operands.
+ * \param out Labels of the result.
+ * \param size Dimension of each label, indexed by character.
+ * \param flops If not null, set to the number of multiply-adds.
+ * \return Pairs of operands to contract, operands being numbered from 0 to
+ * n-1 and the result of step s being numbered n+s.
+ *
+ * The order minimizes the number of multiply-adds, and then the size of the
+ * largest intermediate tensor, exhaustively for up to TENSOR_OPTIMAL
+ * operands and greedily above.
+ */
+inline vector<pair<int,int> > contractionOrder(const vector<string> &labels,
+        const string &out, const int size[256], double *flops=0) {
+    const int n=labels.size();
+    //Bit masks of the labels.
+    string all;
+    for(int i=0;i<n;i++)
+        for(unsigned int k=0;k<labels[i].size();k++)
+            if(all.find(labels[i][k])==string::npos)
+                all+=labels[i][k];
+    if(all.size()>64)
+        throw incorExpr;
+    vector<unsigned long long> mask(n,0);
+    unsigned long long outMask=0;
+    for(int i=0;i<n;i++)
+        for(unsigned int k=0;k<labels[i].size();k++)
+            mask[i]|=1ULL<<all.find(labels[i][k]);
+    for(unsigned int k=0;k<out.size();k++)
+        if(all.find(out[k])!=string::npos)
+            outMask|=1ULL<<all.find(out[k]);
+    vector<double> dim(all.size());
+    for(unsigned int k=0;k<all.size();k++)
+        dim[k]=size[(unsigned char)all[k]];
+    //Product of the dimensions of a set of labels.
+    auto volume=[&](unsigned long long m) {
+        double v=1;
+        for(unsigned int k=0;k<all.size();k++)
+            if(m>>k&1)
+                v*=dim[k];
+        return v;
+    };
+    vector<pair<int,int> > order;
+    double total=0;
+    if(n<2) {
+        if(flops)
+            *flops=0;
+        return order;
+    }
+    if(n<=TENSOR_OPTIMAL) {
+        //Dynamic programming over the subsets of operands.
+        const int ns=1<<n;
+        vector<unsigned long long> lab(ns,0),kept(ns,0);
+        for(int s=1;s<ns;s++)
+            for(int i=0;i<n;i++)
+                if(s>>i&1)
+                    lab[s]|=mask[i];
+        for(int s=1;s<ns;s++)
+            kept[s]=lab[s]&(lab[(ns-1)^s]|outMask);
+        vector<double> cost(ns,0),peak(ns,0);
+        vector<int> split(ns,0);
+        for(int s=1;s<ns;s++) {
+            if((s&(s-1))==0)
+                continue;
+            cost[s]=-1;
+            for(int s1=(s-1)&s;s1>0;s1=(s1-1)&s) {
+                const int s2=s^s1;
+                if(s1<s2)
+                    continue;
+                const double c=cost[s1]+cost[s2]+volume(kept[s1]|kept[s2]);
+                double p=volume(kept[s]);
+                p=(p>peak[s1]?p:peak[s1]);
+                p=(p>peak[s2]?p:peak[s2]);
+                if(cost[s]<0 || c<cost[s] || (c==cost[s] && p<peak[s])) {
+                    cost[s]=c;
+                    peak[s]=p;
+                    split[s]=s1;
+                }
+            }
+        }
+        total=cost[ns-1];
+        //Post-order traversal of the contraction tree.
+        vector<int> id(ns,-1);
+        for(int i=0;i<n;i++)
+            id[1<<i]=i;
+        vector<pair<int,bool> > stack(1,pair<int,bool>(ns-1,false));
+        while(!stack.empty()) {
+            pair<int,bool> t=stack.back();
+            stack.pop_back();
+            if(id[t.first]>=0)
+                continue;
+            const int s1=split[t.first],s2=t.first^s1;
+            if(t.second) {
+                id[t.first]=n+order.size();
+                order.push_back(pair<int,int>(id[s1],id[s2]));
+            } else {
+                stack.push_back(pair<int,bool>(t.first,true));
+                stack.push_back(pair<int,bool>(s2,false));
+                stack.push_back(pair<int,bool>(s1,false));
+            }
+        }
+    } else {
+        //Greedy: contract the cheapest pair first.
+        vector<unsigned long long> m(mask);
+        vector<int> id(n);
+        for(int i=0;i<n;i++)
+            id[i]=i;
+        while(m.size()>1) {
+            int bi=-1,bj=-1;
+            double bc=0,bp=0;
+            for(unsigned int i=0;i<m.size();i++)
+                for(unsigned int j=i+1;j<m.size();j++) {
+                    unsigned long long rest=outMask;
+                    for(unsigned int k=0;k<m.size();k++)
+                        if(k!=i && k!=j)
+                            rest|=m[k];
+                    const double c=volume(m[i]|m[j]);
+                    const double p=volume((m[i]|m[j])&rest);
+                    if(bi<0 || c<bc || (c==bc && p<bp)) {
+                        bi=i;
+                        bj=j;
+                        bc=c;
+                        bp=p;
+                    }
+                }
+            unsigned long long rest=outMask;
+            for(unsigned int k=0;k<m.size();k++)
+                if((int)k!=bi && (int)k!=bj)
+                    rest|=m[k];
+            total+=bc;
+            order.push_back(pair<int,int>(id[bi],id[bj]));
+            m[bi]=(m[bi]|m[bj])&rest;
+            id[bi]=n+order.size()-1;
+            m.erase(m.begin()+bj);
+            id.erase(id.begin()+bj);
+        }
+    }
+    if(flops)
+        *flops=total;
+    return order;
+};
+/* }}} */
+/* einsum {{{ */
+/*!\brief Splits an einsum specification in operand and result labels.
+ *
+ * Without "->", the result holds the labels appearing once, in alphabetical
+ * order. Throws incorExpr if the specification is malformed.
+ */
+inline void einsumParse(const string &spec, vector<string> &labels,
+        string &out) {
+    string s;
+    for(unsigned int k=0;k<spec.size();k++)
+        if(spec[k]!=' ')
+            s+=spec[k];
+    const size_t arrow=s.find("->");
+    const string in=s.substr(0,arrow);
+    labels.clear();
+    size_t start=0;
+    for(;;) {
+        const size_t comma=in.find(',',start);
+        labels.push_back(in.substr(start,comma-start));
+        if(comma==string::npos)
+            break;
+        start=comma+1;
+    }
+    if(arrow!=string::npos)
+        out=s.substr(arrow+2);
+    else {
+        out="";
+        for(int c=0;c<256;c++) {
+            int count=0;
+            for(unsigned int i=0;i<labels.size();i++)
+                for(unsigned int k=0;k<labels[i].size();k++)
+                    count+=((unsigned char)labels[i][k]==c);
+            if(count==1)
+                out+=(char)c;
+        }
+    }
+    const string reserved=",->";
+    for(unsigned int i=0;i<=labels.size();i++) {
+        const string &l=(i<labels.size()?labels[i]:out);
+        for(unsigned int k=0;k<l.size();k++)
+            if(reserved.find(l[k])!=string::npos)
+                throw incorExpr;
+    }
+};
+/*!\brief Returns the contraction of a tensor network written in einsum
+ * notation, eg einsum<double>("ij,jk,kl->il",{a,b,c}): the element type
+ * cannot be deduced from a braced list of operands.
+ *
+ * The operands are contracted pairwise in the order given by
+ * contractionOrder(), and intermediate tensors are freed as soon as they
+ * are consumed.
+ */
+template <class T> Tensor<T> einsum(const string &spec,
+        const vector<TensorView<T> > &ops) {
+    vector<string> labels;
+    string out;
+    einsumParse(spec,labels,out);
+    if(labels.size()!=ops.size())
+        throw incorExpr;
+    int size[256];
+    for(int c=0;c<256;c++)
+        size[c]=-1;
+    for(unsigned int i=0;i<ops.size();i++)
+        tensorLabels(labels[i],ops[i].dims(),size);
+    if(ops.size()==1) {
+        string l;
+        for(unsigned int k=0;k<out.size();k++)
+            if(size[(unsigned char)out[k]]<0
+                    || out.find(out[k],k+1)!=string::npos)
+                throw incorExpr;
+        Tensor<T> s=tensorSum(ops[0],labels[0],out,l);
+        if(l==out)
+            return s;
+        vector<int> perm(out.size());
+        for(unsigned int k=0;k<out.size();k++)
+            perm[k]=l.find(out[k]);
+        return Tensor<T>(s.permute(perm));
+    }
+    vector<pair<int,int> > order=contractionOrder(labels,out,size);
+    const int n=ops.size();
+    vector<Tensor<T> > tmp;
+    tmp.reserve(n);
+    vector<TensorView<T> > views(ops);
+    for(unsigned int s=0;s<order.size();s++) {
+        const int i=order[s].first,j=order[s].second;
+        //Keep the labels needed by the remaining operands or the result.
+        string rest=out;
+        for(int k=0;k<n+(int)s;k++)
+            if(k!=i && k!=j && !labels[k].empty())
+                rest+=labels[k];
+        string l;
+        const string lij=labels[i]+labels[j];
+        for(unsigned int k=0;k<lij.size();k++)
+            if(rest.find(lij[k])!=string::npos && l.find(lij[k])==string::npos)
+                l+=lij[k];
+        if(s==order.size()-1)
+            l=out;
+        tmp.push_back(contract(views[i],labels[i],views[j],labels[j],l));
+        views.push_back(TensorView<T>(tmp.back()));
+        labels.push_back(l);
+        //Free the consumed operands.
+        labels[i]=labels[j]="";
+        for(int k=0;k<2;k++) {
+            const int t=(k==0?i:j)-n;
+            if(t>=0)
+                tmp[t]=Tensor<T>();
+        }
+    }
+    return tmp.back();
+};
+/*!\brief Returns the contraction of two tensors in einsum notation. */
+template <class T> Tensor<T> einsum(const string &spec,
+        const TensorView<T> &a, const TensorView<T> &b) {
+    return einsum(spec,vector<TensorView<T> >{a,b});
+};
+/*!\brief Permutes or sums the indices of a tensor in einsum notation. */
+template <class T> Tensor<T> einsum(const string &spec,
+        const TensorView<T> &a) {
+    return einsum(spec,vector<TensorView<T> >{a});
+};
+/* }}} */
+#endif //TENSOR_H
+/* tensor.h */
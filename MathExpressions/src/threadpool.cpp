@@ -0,0 +1,177 @@
+/* This file is a part of MathExpression. {{{
+ * Copyright (C) 2012 Romain Dubessy
+ *
+ * MathExpression is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MathExpression is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with MathExpression.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * }}} */
+#include <cstdlib>
+#include <new>
+#include <pthread.h>
+#include "numa.h"
+#include "threadpool.h"
+/*!\brief True in the threads executing a parallel loop. */
+static thread_local bool inLoop=false;
+/* ThreadPool class implementation {{{ */
+ThreadPool::ThreadPool(int nthreads) {
+    if(nthreads<=0) {
+        const char *v=getenv("MATHEXPR_THREADS");
+        if(v!=0)
+            nthreads=atoi(v);
+        if(nthreads<=0)
+            nthreads=std::thread::hardware_concurrency();
+        if(nthreads<=0)
+            nthreads=1;
+    }
+    _f=0;
+    _n=_grain=0;
+    _local=false;
+    _next=0;
+    _busy=0;
+    _generation=0;
+    _stop=false;
+    const char *policy=getenv("MATHEXPR_AFFINITY");
+    if(policy!=0) {
+        try {
+            _affinity=numaTopology().affinity(policy,nthreads);
+        } catch (std::exception &) {
+            //Invalid cpu lists disable pinning.
+            _affinity.clear();
+        }
+    }
+    //Pinned threads are all workers, the caller keeps its own mask.
+    _size=nthreads;
+    for(int i=(_affinity.empty()?1:0);i<nthreads;i++)
+        _workers.push_back(std::thread(&ThreadPool::loop,this,i));
+}
+ThreadPool::~ThreadPool(void) {
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _stop=true;
+        _wake.notify_all();
+    }
+    for(unsigned int i=0;i<_workers.size();i++)
+        _workers[i].join();
+}
+void ThreadPool::run(long long n, long long grain,
+        const std::function<void(long long,long long)> &f) {
+    start(n,grain,false,f);
+}
+void ThreadPool::runLocal(long long n,
+        const std::function<void(long long,long long)> &f) {
+    start(n,1,true,f);
+}
+void ThreadPool::start(long long n, long long grain, bool local,
+        const std::function<void(long long,long long)> &f) {
+    if(inLoop || _workers.empty()) {
+        f(0,n);
+        return;
+    }
+    std::unique_lock<std::mutex> running(_running);
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _f=&f;
+        _n=n;
+        _grain=grain;
+        _local=local;
+        _next=0;
+        _busy=_workers.size();
+        _error=nullptr;
+        _generation++;
+        _wake.notify_all();
+    }
+    //The caller helps with dynamic loops, and takes part 0 of static ones
+    //when no worker is pinned on it.
+    if(!local || _affinity.empty()) {
+        inLoop=true;
+        work(0);
+        inLoop=false;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(_busy>0)
+        _done.wait(lock);
+    _f=0;
+    if(_error)
+        std::rethrow_exception(_error);
+}
+void ThreadPool::loop(int id) {
+    if(!_affinity.empty())
+        pinThread(_affinity[id]);
+    inLoop=true;
+    unsigned long generation=0;
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while(_generation==generation && !_stop)
+                _wake.wait(lock);
+            if(_stop)
+                return;
+            generation=_generation;
+        }
+        work(id);
+        std::unique_lock<std::mutex> lock(_mutex);
+        if(--_busy==0)
+            _done.notify_all();
+    }
+}
+void ThreadPool::work(int id) {
+    if(_local) {
+        const long long begin=_n*id/size();
+        const long long end=_n*(id+1)/size();
+        if(begin<end)
+            call(begin,end);
+        return;
+    }
+    for(;;) {
+        long long begin=_next.fetch_add(_grain);
+        if(begin>=_n)
+            return;
+        call(begin,(begin+_grain<_n?begin+_grain:_n));
+    }
+}
+void ThreadPool::call(long long begin, long long end) {
+    try {
+        (*_f)(begin,end);
+    }
+    catch (...) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if(!_error)
+            _error=std::current_exception();
+        _next=_n;
+    }
+}
+void ThreadPool::forked(void) {
+    threadPool().forget();
+}
+void ThreadPool::forget(void) {
+    //Only the forking thread exists in the child: the worker handles must
+    //not be joined nor destroyed, and the locks may have been held by a
+    //worker. The thread objects are leaked.
+    new (&_workers) vector<std::thread>();
+    new (&_mutex) std::mutex();
+    new (&_running) std::mutex();
+    new (&_wake) std::condition_variable();
+    new (&_done) std::condition_variable();
+    _affinity.clear();
+    _size=1;
+    _busy=0;
+    _f=0;
+}
+ThreadPool &threadPool(void) {
+    static ThreadPool pool;
+    static int handler=pthread_atfork(0,0,&ThreadPool::forked);
+    (void)handler;
+    return pool;
+}
+/* }}} */
+/* threadpool.cpp */
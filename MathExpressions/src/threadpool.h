@@ -0,0 +1,157 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+using std::vector;
+/* ThreadPool {{{ */
+/*!\brief Persistent pool of worker threads.
+ *
+ * The pool runs one parallel loop at a time: the range [0,n) is split in
+ * chunks of grain iterations which are handed out to the workers and to the
+ * calling thread until none is left.
+ * A loop started from inside a parallel loop runs serially in the calling
+ * thread, so that kernels can be nested freely.
+ *
+ * Threads can be pinned on cpus with the MATHEXPR_AFFINITY environment
+ * variable, see NumaTopology::affinity for its values. The calling thread is
+ * never pinned: with pinned threads the pool starts one worker per cpu, and
+ * runLocal gives the same part of a range to the same worker on every call,
+ * so that data first touched by a thread stays on its NUMA node.
+ *
+ * The workers do not survive fork(): in the child process, the library
+ * pool forgets them and runs every loop in the calling thread.
+ */
+class ThreadPool {
+    public:
+        /*!\brief Default constructor, starts nthreads-1 workers, or
+         * nthreads pinned workers.
+         *
+         * If nthreads<=0, the MATHEXPR_THREADS environment variable is
+         * used, or the number of hardware threads if it is not set.
+         */
+        ThreadPool(int nthreads=0);
+        /*!\brief Destructor, stops the workers. */
+        ~ThreadPool(void);
+        /*!\brief Returns the number of threads running a loop. */
+        int size(void) const { return _size; };
+        /*!\brief Calls f(begin,end) on chunks covering [0,n).
+         *
+         * The first exception thrown by f is rethrown once all the workers
+         * are done.
+         */
+        void run(long long n, long long grain,
+                const std::function<void(long long,long long)> &f);
+        /*!\brief Calls f(begin,end) once per thread on a static partition
+         * of [0,n).
+         *
+         * Thread t gets [t*n/size(),(t+1)*n/size()): with pinned threads,
+         * thread t is the worker pinned on affinity()[t] and the caller
+         * only waits, otherwise the caller is thread 0.
+         */
+        void runLocal(long long n,
+                const std::function<void(long long,long long)> &f);
+        /*!\brief Returns the cpu of each thread, empty if not pinned. */
+        const vector<int> &affinity(void) const { return _affinity; };
+    private:
+        ThreadPool(const ThreadPool &);
+        ThreadPool &operator=(const ThreadPool &);
+        friend ThreadPool &threadPool(void);
+        /*!\brief Starts a loop and waits for its end. */
+        void start(long long n, long long grain, bool local,
+                const std::function<void(long long,long long)> &f);
+        /*!\brief Worker thread main loop. */
+        void loop(int id);
+        /*!\brief Processes chunks until the loop is exhausted, id is the
+         * thread index used by static partitions. */
+        void work(int id);
+        /*!\brief Calls the body, records the first exception. */
+        void call(long long begin, long long end);
+        /*!\brief Child fork handler of the library pool, see forget. */
+        static void forked(void);
+        /*!\brief Drops the workers without joining them, once they are gone,
+         * and resets the synchronization state. */
+        void forget(void);
+        vector<std::thread> _workers;       //!<\brief Worker threads.
+        vector<int> _affinity;              //!<\brief Cpu of each thread.
+        int _size;                          //!<\brief Number of threads.
+        std::mutex _mutex;                  //!<\brief Protects the state.
+        std::mutex _running;                //!<\brief Serializes run().
+        std::condition_variable _wake;      //!<\brief Signals a new loop.
+        std::condition_variable _done;      //!<\brief Signals the end.
+        const std::function<void(long long,long long)> *_f; //!<\brief Body.
+        long long _n;                       //!<\brief Loop size.
+        long long _grain;                   //!<\brief Chunk size.
+        bool _local;                        //!<\brief Static partition.
+        std::atomic<long long> _next;       //!<\brief Next chunk start.
+        int _busy;                          //!<\brief Workers still busy.
+        unsigned long _generation;          //!<\brief Loop counter.
+        bool _stop;                         //!<\brief Stops the workers.
+        std::exception_ptr _error;          //!<\brief First exception.
+};
+/*!\brief Returns the library thread pool, started on first use.
+ *
+ * A fork handler registered with the pool makes it serial in the child.
+ */
+ThreadPool &threadPool(void);
+/* }}} */
+/* parallelFor {{{ */
+/*!\brief Calls f(begin,end) on chunks of at least grain iterations covering
+ * [0,n), in parallel.
+ *
+ * Small loops run in the calling thread without touching the pool.
+ */
+template <class F> void parallelFor(long long n, long long grain, const F &f) {
+    if(grain<1)
+        grain=1;
+    if(n<=grain) {
+        if(n>0)
+            f(0LL,n);
+        return;
+    }
+    ThreadPool &pool=threadPool();
+    if(pool.size()==1) {
+        f(0LL,n);
+        return;
+    }
+    //Do not create more chunks than needed to balance the load.
+    long long chunk=(n+4*pool.size()-1)/(4*pool.size());
+    if(chunk<grain)
+        chunk=grain;
+    pool.run(n,chunk,std::function<void(long long,long long)>(f));
+};
+/* }}} */
+/* parallelForLocal {{{ */
+/*!\brief Calls f(begin,end) on one contiguous part of [0,n) per thread.
+ *
+ * Thread t always gets the same part of a range of a given size, so that
+ * loops over data initialized by parallelForLocal access memory of the
+ * NUMA node they run on, if the threads are pinned. Use it for memory bound
+ * loops with uniform cost.
+ * Loops with less than grain iterations per thread are scheduled by
+ * parallelFor.
+ */
+template <class F> void parallelForLocal(long long n, long long grain,
+        const F &f) {
+    if(grain<1)
+        grain=1;
+    if(n<=grain) {
+        if(n>0)
+            f(0LL,n);
+        return;
+    }
+    ThreadPool &pool=threadPool();
+    if(n<grain*pool.size()) {
+        parallelFor(n,grain,f);
+        return;
+    }
+    pool.runLocal(n,std::function<void(long long,long long)>(f));
+};
+/* }}} */
+#endif //THREADPOOL_H
+/* threadpool.h */
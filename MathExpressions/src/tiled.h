@@ -0,0 +1,347 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef TILED_H
+#define TILED_H
+#include <string>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "myexceptions.h"
+#include "matrix.h"
+#include "kernels.h"
+#include "transpose.h"
+#include "threadpool.h"
+#include "binaryio.h"
+using std::string;
+/*!\brief Default edge of the tiles of a TiledMatrix, in elements. */
+#define TILE_EDGE 512
+/* TiledMatrix {{{ */
+/*!\brief Out-of-core matrix stored by tiles in a memory-mapped file.
+ *
+ * The matrix is cut in square tiles of tile() x tile() elements, stored one
+ * after the other by rows of tiles, each tile being stored row by row and
+ * padded to full size on the right and bottom edges. A tile is thus a
+ * contiguous range of the file and an operation on a tile only touches the
+ * pages it needs, so that matrices larger than memory are processed by
+ * streaming tiles through the page cache.
+ * The file uses the binary array format with kind arrayTiled and the tile
+ * edge stored in the header.
+ * The streaming operations announce the tiles they are about to use with
+ * madvise(MADV_WILLNEED), so that the kernel reads them while the previous
+ * ones are computed, and release the tiles they are done with.
+ */
+template <class T> class TiledMatrix {
+    public:
+        /* Constructors {{{ */
+        /*!\brief Creates a file holding a n x m matrix set to zero.
+         *
+         * \param file File name, overwritten.
+         * \param n Number of rows.
+         * \param m Number of columns.
+         * \param tile Edge of the tiles, in elements.
+         */
+        TiledMatrix(const string &file, long long n, long long m,
+                int tile=TILE_EDGE) {
+            if(n<0 || n>LLONG_MAX-INT_MAX || m<0 || m>LLONG_MAX-INT_MAX
+                    || tile<1)
+                throw outOfBounds;
+            ArrayHeader h=arrayHeader<T>(arrayTiled,n,m,
+                    sysconf(_SC_PAGESIZE));
+            h.tile=tile;
+            const long long nt=(n+tile-1)/tile,mt=(m+tile-1)/tile;
+            if(!arrayFits(h,ULLONG_MAX,nt,mt,tile,tile))
+                throw outOfBounds;
+            int fd=open(file.c_str(),O_RDWR|O_CREAT|O_TRUNC,0644);
+            if(fd<0)
+                throw badFormat;
+            const unsigned long length=h.offset
+                +nt*mt*(unsigned long)tile*tile*sizeof(T);
+            if(ftruncate(fd,length)!=0
+                    || pwrite(fd,&h,sizeof(h),0)!=(ssize_t)sizeof(h)) {
+                ::close(fd);
+                throw badFormat;
+            }
+            map(fd,length,true);
+        };
+        /*!\brief Opens an existing file.
+         *
+         * \param file File name.
+         * \param writable If false, the file is mapped read only.
+         */
+        TiledMatrix(const string &file, bool writable=false) {
+            int fd=open(file.c_str(),writable?O_RDWR:O_RDONLY);
+            if(fd<0)
+                throw badFormat;
+            struct stat st;
+            if(fstat(fd,&st)!=0
+                    || (unsigned long)st.st_size<sizeof(ArrayHeader)) {
+                ::close(fd);
+                throw badFormat;
+            }
+            map(fd,st.st_size,writable);
+        };
+        /*!\brief Destructor, unmaps the file. */
+        ~TiledMatrix(void) {
+            munmap(_map,_length);
+        };
+        /* }}} */
+        /* Access member methods {{{ */
+        /*!\brief Returns the number of rows. */
+        long long n(void) const { return _header.n; };
+        /*!\brief Returns the number of columns. */
+        long long m(void) const { return _header.m; };
+        /*!\brief Returns the edge of the tiles. */
+        int tile(void) const { return _header.tile; };
+        /*!\brief Returns the number of rows of tiles. */
+        long long nt(void) const { return (n()+tile()-1)/tile(); };
+        /*!\brief Returns the number of columns of tiles. */
+        long long mt(void) const { return (m()+tile()-1)/tile(); };
+        /*!\brief Returns the number of rows of the tiles of row I. */
+        int rows(long long I) const {
+            return (n()-I*tile()<tile()?n()-I*tile():tile());
+        };
+        /*!\brief Returns the number of columns of the tiles of column J. */
+        int cols(long long J) const {
+            return (m()-J*tile()<tile()?m()-J*tile():tile());
+        };
+        /*!\brief Returns a pointer to tile (I,J), stored row by row with row
+         * stride tile(). */
+        T *data(long long I, long long J) const {
+            return (T*)((char*)_map+_header.offset)
+                +(I*mt()+J)*(long long)tile()*tile();
+        };
+        /*!\brief Access member method. */
+        T &at(long long i, long long j) {
+            if(i<0 || i>=n() || j<0 || j>=m())
+                throw outOfBounds;
+            return data(i/tile(),j/tile())[i%tile()*tile()+j%tile()];
+        };
+        /*!\brief Access member method. */
+        T at(long long i, long long j) const {
+            if(i<0 || i>=n() || j<0 || j>=m())
+                throw outOfBounds;
+            return data(i/tile(),j/tile())[i%tile()*tile()+j%tile()];
+        };
+        /*!\brief Returns a view of tile (I,J). */
+        MatrixView<T> view(long long I, long long J) const {
+            return MatrixView<T>(data(I,J),rows(I),cols(J),tile(),1);
+        };
+        /*!\brief Returns true if the file is mapped for writing. */
+        bool writable(void) const { return _writable; };
+        /* }}} */
+        /* Dense conversions {{{ */
+        /*!\brief Copies a dense matrix of the same size. */
+        void load(const Matrix<T> &a) {
+            if(a.n()!=n() || a.m()!=m())
+                throw incompatibleSizes;
+            for(long long I=0;I<nt();I++)
+                for(long long J=0;J<mt();J++)
+                    view(I,J)=MatrixView<T>(const_cast<T*>(a.data())
+                            +I*tile()*a.m()+J*tile(),rows(I),cols(J),a.m(),1);
+        };
+        /*!\brief Returns a dense copy, which must fit in memory. */
+        Matrix<T> matrix(void) const {
+            Matrix<T> res(n(),m());
+            for(long long I=0;I<nt();I++)
+                for(long long J=0;J<mt();J++)
+                    MatrixView<T>(res.data()+I*tile()*m()+J*tile(),
+                            rows(I),cols(J),m(),1)=view(I,J);
+            return res;
+        };
+        /* }}} */
+        /* Paging {{{ */
+        /*!\brief Advises the kernel that tiles [first,last) in file order
+         * will be used soon. */
+        void prefetch(long long first, long long last) const {
+            advise(first,last,MADV_WILLNEED);
+        };
+        /*!\brief Releases the pages of tiles [first,last) in file order.
+         *
+         * Modified pages of a writable file are kept in the page cache and
+         * written back, so this only bounds the memory footprint.
+         */
+        void release(long long first, long long last) const {
+            advise(first,last,MADV_DONTNEED);
+        };
+        /*!\brief Schedules the write back of the modified pages. */
+        void flush(void) {
+            msync(_map,_length,MS_ASYNC);
+        };
+        /* }}} */
+    private:
+        TiledMatrix(const TiledMatrix &);
+        TiledMatrix &operator=(const TiledMatrix &);
+        /*!\brief Maps the file and checks its header, closes fd. */
+        void map(int fd, unsigned long length, bool writable) {
+            _length=length;
+            _writable=writable;
+            _map=mmap(0,_length,writable?PROT_READ|PROT_WRITE:PROT_READ,
+                    MAP_SHARED,fd,0);
+            ::close(fd);
+            if(_map==MAP_FAILED)
+                throw badFormat;
+            const ArrayHeader *h=(const ArrayHeader*)_map;
+            const unsigned long page=sysconf(_SC_PAGESIZE);
+            if(memcmp(h->magic,"MXAR",4)!=0 || h->version!=1
+                    || h->endian!=0x01020304
+                    || h->type!=(unsigned int)TypeCode<T>::value
+                    || h->size!=sizeof(T) || h->kind!=arrayTiled
+                    || h->tile<1 || h->tile>INT_MAX
+                    || h->n<0 || h->n>LLONG_MAX-INT_MAX
+                    || h->m<0 || h->m>LLONG_MAX-INT_MAX
+                    || h->offset%page!=0) {
+                munmap(_map,_length);
+                throw badFormat;
+            }
+            _header=*h;
+            if(!arrayFits(_header,_length,nt(),mt(),tile(),tile())) {
+                munmap(_map,_length);
+                throw badFormat;
+            }
+        };
+        /*!\brief Calls madvise on the pages of tiles [first,last). */
+        void advise(long long first, long long last, int advice) const {
+            const unsigned long page=sysconf(_SC_PAGESIZE);
+            const unsigned long size=(unsigned long)tile()*tile()*sizeof(T);
+            unsigned long begin=_header.offset+first*size;
+            unsigned long end=_header.offset+last*size;
+            //Whole pages only: a partial page may be shared with a tile in
+            //use.
+            if(advice==MADV_DONTNEED) {
+                begin=(begin+page-1)/page*page;
+                end=end/page*page;
+            } else {
+                begin=begin/page*page;
+                end=(end+page-1)/page*page;
+            }
+            if(end>_length)
+                end=_length;
+            if(begin<end)
+                madvise((char*)_map+begin,end-begin,advice);
+        };
+        void *_map;             //!<\brief Mapped file.
+        unsigned long _length;  //!<\brief Length of the mapping.
+        bool _writable;         //!<\brief True if mapped for writing.
+        ArrayHeader _header;    //!<\brief File header.
+};
+/* }}} */
+/* Streaming kernels {{{ */
+/*!\brief Computes y=A*x, reading A once by rows of tiles.
+ *
+ * The next row of tiles, contiguous in the file, is prefetched while the
+ * current one is processed by the threads, each thread handling a range of
+ * rows across the tiles, and released afterwards.
+ */
+template <class T> void gemv(const TiledMatrix<T> &a, const T *x, T *y) {
+    const int b=a.tile();
+    const long long mt=a.mt();
+    a.prefetch(0,mt);
+    for(long long I=0;I<a.nt();I++) {
+        if(I+1<a.nt())
+            a.prefetch((I+1)*mt,(I+2)*mt);
+        const int r=a.rows(I);
+        T *yi=y+I*b;
+        parallelFor(r,kernelRows(a.m()),[&](long long i0, long long i1) {
+            for(long long i=i0;i<i1;i++) {
+                T s=0;
+                for(long long J=0;J<mt;J++)
+                    s+=kernelDot(a.cols(J),a.data(I,J)+i*b,x+J*b);
+                yi[i]=s;
+            }
+        });
+        a.release(I*mt,(I+1)*mt);
+    }
+};
+/*!\brief Computes y=x*A, reading A once by rows of tiles.
+ *
+ * The threads share the columns of tiles, so that each updates its own
+ * range of y.
+ */
+template <class T> void gemvT(const TiledMatrix<T> &a, const T *x, T *y) {
+    const int b=a.tile();
+    const long long mt=a.mt();
+    for(long long j=0;j<a.m();j++)
+        y[j]=0;
+    a.prefetch(0,mt);
+    for(long long I=0;I<a.nt();I++) {
+        if(I+1<a.nt())
+            a.prefetch((I+1)*mt,(I+2)*mt);
+        const int r=a.rows(I);
+        parallelFor(mt,1,[&](long long J0, long long J1) {
+            for(long long J=J0;J<J1;J++) {
+                const T *t=a.data(I,J);
+                for(int i=0;i<r;i++)
+                    kernelAxpy(a.cols(J),x[I*b+i],t+i*b,y+J*b);
+            }
+        });
+        a.release(I*mt,(I+1)*mt);
+    }
+};
+/*!\brief Computes C=A*B, all stored by tiles of the same edge.
+ *
+ * Tile (I,J) of C is accumulated over the row of tiles I of A, which stays
+ * in memory while J runs over the columns of tiles of C, and the column of
+ * tiles J of B. J runs alternately forward and backward, so that the last
+ * columns of B used for a row are reused for the next one. Each tile
+ * product is a threaded gemm; A is read once and B once per row of tiles.
+ */
+template <class T> void gemm(const TiledMatrix<T> &a,
+        const TiledMatrix<T> &b, TiledMatrix<T> &c) {
+    if(a.m()!=b.n() || c.n()!=a.n() || c.m()!=b.m())
+        throw incompatibleSizes;
+    if(a.tile()!=b.tile() || a.tile()!=c.tile() || !c.writable())
+        throw badFormat;
+    const int e=a.tile();
+    const long long kt=a.mt(),mt=c.mt();
+    a.prefetch(0,kt);
+    for(long long I=0;I<c.nt();I++) {
+        if(I+1<c.nt())
+            a.prefetch((I+1)*kt,(I+2)*kt);
+        for(long long s=0;s<mt;s++) {
+            const long long J=(I%2==0?s:mt-1-s);
+            const long long Jn=(I%2==0?J+1:J-1);
+            if(Jn>=0 && Jn<mt)
+                for(long long K=0;K<kt;K++)
+                    b.prefetch(K*mt+Jn,K*mt+Jn+1);
+            T *ct=c.data(I,J);
+            for(long long k=0;k<(long long)e*e;k++)
+                ct[k]=0;
+            for(long long K=0;K<kt;K++)
+                gemm(c.rows(I),a.cols(K),c.cols(J),a.data(I,K),e,
+                        b.data(K,J),e,ct,e);
+        }
+        a.release(I*kt,(I+1)*kt);
+        c.release(I*mt,(I+1)*mt);
+    }
+};
+/*!\brief Writes the transpose of A in C, tile by tile.
+ *
+ * Tiles of A are read in file order and each is transposed with the cache
+ * oblivious kernel into its image, a contiguous tile of C.
+ */
+template <class T> void transpose(const TiledMatrix<T> &a,
+        TiledMatrix<T> &c) {
+    if(c.n()!=a.m() || c.m()!=a.n())
+        throw incompatibleSizes;
+    if(a.tile()!=c.tile() || !c.writable())
+        throw badFormat;
+    const int e=a.tile();
+    const long long mt=a.mt();
+    a.prefetch(0,mt);
+    for(long long I=0;I<a.nt();I++) {
+        if(I+1<a.nt())
+            a.prefetch((I+1)*mt,(I+2)*mt);
+        parallelFor(mt,1,[&](long long J0, long long J1) {
+            for(long long J=J0;J<J1;J++) {
+                transposeCopy(a.data(I,J),e,c.data(J,I),e,a.rows(I),
+                        a.cols(J));
+                c.release(J*c.mt()+I,J*c.mt()+I+1);
+            }
+        });
+        a.release(I*mt,(I+1)*mt);
+    }
+};
+/* }}} */
+#endif //TILED_H
+/* tiled.h */
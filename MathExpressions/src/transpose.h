@@ -0,0 +1,116 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+#include <vector>
+using std::vector;
+/*!\brief Transposition kernels.
+ *
+ * Matrices are given by a pointer to element (0,0) and a row stride, the
+ * columns are contiguous.
+ * The out-of-place kernel recursively halves the largest dimension until
+ * the blocks fit in a tile, so that both the reads and the writes stay in
+ * cache at every level of the memory hierarchy.
+ */
+/*!\brief Edge of a transposition tile, in elements. */
+#define TRANSPOSE_TILE 16
+/* transposeTile {{{ */
+/*!\brief Writes the transpose of the n x m block a in b.
+ *
+ * Full tiles have compile-time bounds and are unrolled and vectorized by
+ * the compiler.
+ */
+template <class T> inline void transposeTile(const T *__restrict__ a,
+        long sa, T *__restrict__ b, long sb, int n, int m) {
+    if(n==TRANSPOSE_TILE && m==TRANSPOSE_TILE) {
+        for(int j=0;j<TRANSPOSE_TILE;j++)
+            for(int i=0;i<TRANSPOSE_TILE;i++)
+                b[j*sb+i]=a[i*sa+j];
+        return;
+    }
+    for(int j=0;j<m;j++)
+        for(int i=0;i<n;i++)
+            b[j*sb+i]=a[i*sa+j];
+};
+/* }}} */
+/* transposeCopy {{{ */
+/*!\brief Writes the transpose of the n x m matrix a in the m x n matrix b,
+ * which must not overlap. */
+template <class T> void transposeCopy(const T *a, long sa, T *b, long sb,
+        int n, int m) {
+    if(n<=TRANSPOSE_TILE && m<=TRANSPOSE_TILE) {
+        transposeTile(a,sa,b,sb,n,m);
+        return;
+    }
+    //Split on a tile boundary, so that the leaves are full tiles.
+    if(n>=m) {
+        int h=(n/2+TRANSPOSE_TILE-1)/TRANSPOSE_TILE*TRANSPOSE_TILE;
+        transposeCopy(a,sa,b,sb,h,m);
+        transposeCopy(a+h*sa,sa,b+h,sb,n-h,m);
+    } else {
+        int h=(m/2+TRANSPOSE_TILE-1)/TRANSPOSE_TILE*TRANSPOSE_TILE;
+        transposeCopy(a,sa,b,sb,n,h);
+        transposeCopy(a+h,sa,b+h*sb,sb,n,m-h);
+    }
+};
+/* }}} */
+/* transposeSquare {{{ */
+/*!\brief Transposes the n x n matrix a in place.
+ *
+ * The matrix is processed by pairs of tiles (I,J) and (J,I), which are
+ * swapped and transposed in a single pass.
+ */
+template <class T> void transposeSquare(T *a, long sa, int n) {
+    for(int bi=0;bi<n;bi+=TRANSPOSE_TILE) {
+        int ni=(n-bi<TRANSPOSE_TILE?n-bi:TRANSPOSE_TILE);
+        //Diagonal tile.
+        for(int i=0;i<ni;i++)
+            for(int j=i+1;j<ni;j++) {
+                T tmp=a[(bi+i)*sa+bi+j];
+                a[(bi+i)*sa+bi+j]=a[(bi+j)*sa+bi+i];
+                a[(bi+j)*sa+bi+i]=tmp;
+            }
+        for(int bj=bi+TRANSPOSE_TILE;bj<n;bj+=TRANSPOSE_TILE) {
+            int nj=(n-bj<TRANSPOSE_TILE?n-bj:TRANSPOSE_TILE);
+            T *__restrict__ u=a+bi*sa+bj;
+            T *__restrict__ v=a+bj*sa+bi;
+            for(int i=0;i<ni;i++)
+                for(int j=0;j<nj;j++) {
+                    T tmp=u[i*sa+j];
+                    u[i*sa+j]=v[j*sa+i];
+                    v[j*sa+i]=tmp;
+                }
+        }
+    }
+};
+/* }}} */
+/* transposeCycles {{{ */
+/*!\brief Transposes the contiguous n x m matrix a in place, it becomes a
+ * contiguous m x n matrix.
+ *
+ * Element p=i*m+j moves to j*n+i=p*n mod (nm-1): the permutation is
+ * followed cycle by cycle, using one bit per element to mark the visited
+ * positions.
+ */
+template <class T> void transposeCycles(T *a, int n, int m) {
+    long nm=(long)n*m;
+    if(n<=1 || m<=1)
+        return;
+    vector<bool> done(nm,false);
+    for(long start=1;start<nm-1;start++) {
+        if(done[start])
+            continue;
+        T carry=a[start];
+        long p=start;
+        do {
+            long q=(p*n)%(nm-1);
+            T tmp=a[q];
+            a[q]=carry;
+            carry=tmp;
+            done[p]=true;
+            p=q;
+        } while(p!=start);
+    }
+};
+/* }}} */
+#endif //TRANSPOSE_H
+/* transpose.h */
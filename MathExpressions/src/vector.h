@@ -3,7 +3,11 @@
 #define VECTOR_H
 #include <iostream>
 #include "myexceptions.h"
+#include "checking.h"
 #include "matrix.h"
+#include "view.h"
+#include "kernels.h"
+#include "reductions.h"
 using std::ostream;
 using std::cerr;
 template <class T> class Matrix;
@@ -21,17 +25,28 @@ template <class T> class Vector {
         Vector(int n=0) {
             _n=n;
             _data=0;
+            _own=true;
             if(_n!=0) {
                 _data=new T[_n];
-                for(int i=0;i<_n;i++)
-                    _data[i]=0;
+                kernelFill(_n,_data,(T)0);
             }
         };
+        /*!\brief External storage constructor.
+         *
+         * The vector is a view over data, which is neither copied nor freed.
+         * Assignment writes into data and cannot resize the vector, but a
+         * copy constructed vector owns a copy of the elements.
+         */
+        Vector(int n, T *data) {
+            _n=n;
+            _data=data;
+            _own=false;
+        };
         /* }}} */
         /* Destructor {{{ */
         /*!\brief Destructor. */
         ~Vector(void) {
-            if(_n!=0)
+            if(_n!=0 && _own)
                 delete[] _data;
         };
         /* }}} */
@@ -40,11 +55,11 @@ template <class T> class Vector {
         Vector(const Vector<T> &other) {
             _n=other._n;
             _data=0;
+            _own=true;
             if(_n!=0) {
                 _data=new T[_n];
-                for(int i=0;i<_n;i++)
-                    _data[i]=other._data[i];
-            } 
+                kernelCopy(_n,other._data,_data);
+            }
         };
         /* }}} */
         /* Size method {{{ */
@@ -55,25 +70,77 @@ template <class T> class Vector {
         /* }}} */
         /* Access member method {{{ */
         /*!\brief Access member method. */
-        T &operator[](int i) {
-            if(i<0 || i>=_n)
-                throw outOfBounds;
+        T &operator[](int i) { return get<Checked>(i); };
+        /*!\brief Access member method. */
+        T operator[](int i) const { return get<Checked>(i); };
+        /*!\brief Access member method, with checking policy P. */
+        template <class P> T &get(int i) {
+            P::check(i>=0 && i<_n);
             return _data[i];
         };
-        /*!\brief Access member method. */
-        T operator[](int i) const {
-            if(i<0 || i>=_n)
-                throw outOfBounds;
+        /*!\brief Access member method, with checking policy P. */
+        template <class P> T get(int i) const {
+            P::check(i>=0 && i<_n);
             return _data[i];
         };
+        /*!\brief Returns a pointer to the elements. */
+        T *data(void) { return _data; };
+        /*!\brief Returns a pointer to the elements. */
+        const T *data(void) const { return _data; };
+        /* }}} */
+        /* Iterators {{{ */
+        typedef T *iterator;                //!<\brief Contiguous iterator.
+        typedef const T *const_iterator;    //!<\brief Contiguous iterator.
+        /*!\brief Returns an iterator to the first element. */
+        iterator begin(void) { return _data; };
+        /*!\brief Returns an iterator past the last element. */
+        iterator end(void) { return _data+_n; };
+        /*!\brief Returns an iterator to the first element. */
+        const_iterator begin(void) const { return _data; };
+        /*!\brief Returns an iterator past the last element. */
+        const_iterator end(void) const { return _data+_n; };
+        /*!\brief Returns a view of the elements. */
+        VectorView<T> view(void) const { return VectorView<T>(*this); };
         /* }}} */
         /* Print method {{{ */
         /*!\brief Pure virtual display method. */
         virtual void print(void) const =0;
         /* }}} */
     protected:
+        /* View constructor {{{ */
+        /*!\brief Copies the elements of a view. */
+        Vector(const VectorView<T> &other) {
+            _n=other.size();
+            _data=0;
+            _own=true;
+            if(_n!=0) {
+                _data=new T[_n];
+                view()=other;
+            }
+        };
+        /* }}} */
+        /* Assign method {{{ */
+        /*!\brief Copies the elements of other, resizing if needed.
+         *
+         * Views cannot be resized.
+         */
+        void assign(const Vector<T> &other) {
+            if(_n!=other._n) {
+                if(!_own)
+                    throw incompatibleSizes;
+                if(_n!=0)
+                    delete[] _data;
+                _n=other._n;
+                _data=0;
+                if(_n!=0)
+                    _data=new T[_n];
+            }
+            kernelCopy(_n,other._data,_data);
+        };
+        /* }}} */
         T *_data;   //!<\brief Array containing the vector elements.
         int _n;     //!<\brief Size of the vector.
+        bool _own;  //!<\brief False if the elements are not owned.
 };
 /*!\brief This class implements an "horizontal" template vector container.
  */
@@ -89,6 +156,12 @@ template <class T> class Bra : public Vector<T> {
         /*!\brief Copy constructor. */
         Bra(const Vector<T> &other) : Vector<T>(other) {};
         /* }}} */
+        /* External storage constructor {{{ */
+        /*!\brief External storage constructor, see Vector. */
+        Bra(int n, T *data) : Vector<T>(n,data) {};
+        /*!\brief Copies the elements of a view. */
+        explicit Bra(const VectorView<T> &other) : Vector<T>(other) {};
+        /* }}} */
         /* Print method {{{ */
         /*!\brief Print method. */
         void print(void) const {
@@ -98,7 +171,7 @@ template <class T> class Bra : public Vector<T> {
         /*!\brief Convert to standard stream operator. */
         friend ostream &operator<<(ostream &os, const Bra<T> &other) {
             for(int i=0;i<other.size();i++)
-                os << other[i] << " ";
+                os << other._data[i] << " ";
             return os;
         };
         /* }}} */
@@ -107,19 +180,14 @@ template <class T> class Bra : public Vector<T> {
             if(_n!=other.n())
                 throw incompatibleSizes;
             Bra<T> tmp(other.m());
-            for(int j=0;j<tmp._n;j++)
-                for(int i=0;i<_n;i++)
-                    tmp._data[j]=_data[i]*other.at(i,j);
+            gemvT(_n,other.m(),other.data(),other.m(),_data,tmp._data);
             return tmp;
         };
         /*!\brief Scalar product. */
         T operator*(const Ket<T> &other) const {
             if(_n!=other.size())
                 throw incompatibleSizes;
-            T res=0;
-            for(int i=0;i<_n;i++)
-                res+=_data[i]*other[i];
-            return res;
+            return dot(_n,_data,other.data());
         };
         /*!\brief Transposition method. */
         Ket<T> transpose(void) const {
@@ -128,17 +196,8 @@ template <class T> class Bra : public Vector<T> {
         /* Algebraic operators {{{ */
         /*!\brief Assignement operator. */
         Bra<T> &operator=(const Bra<T> &other) {
-            if(this!=&other) {
-                if(_n!=other._n) {
-                    delete[] _data;
-                    _n=other._n;
-                }
-                if(_n!=0) {
-                    _data=new T[_n];
-                    for(int i=0;i<_n;i++)
-                        _data[i]=other._data[i];
-                }
-            }
+            if(this!=&other)
+                this->assign(other);
             return *this;
         };
         /*!\brief Addition operator. */
@@ -151,8 +210,12 @@ template <class T> class Bra : public Vector<T> {
         Bra<T> &operator+=(const Bra<T> &other) {
             if(_n!=other._n)
                 throw outOfBounds;
-            for(int i=0;i<_n;i++)
-                _data[i]+=other._data[i];
+            kernelAdd(_n,other._data,_data);
+            return *this;
+        };
+        /*!\brief Addition operator. */
+        Bra<T> &operator+=(const VectorView<T> &other) {
+            this->view()+=other;
             return *this;
         };
         /*!\brief Substraction operator. */
@@ -165,8 +228,12 @@ template <class T> class Bra : public Vector<T> {
         Bra<T> &operator-=(const Bra<T> &other) {
             if(_n!=other._n)
                 throw outOfBounds;
-            for(int i=0;i<_n;i++)
-                _data[i]-=other._data[i];
+            kernelSub(_n,other._data,_data);
+            return *this;
+        };
+        /*!\brief Substraction operator. */
+        Bra<T> &operator-=(const VectorView<T> &other) {
+            this->view()-=other;
             return *this;
         };
         /*!\brief Outer division operator. */
@@ -177,9 +244,7 @@ template <class T> class Bra : public Vector<T> {
         };
         /*!\brief Outer division operator. */
         Bra<T> &operator/=(const T t) {
-            T tmp=(T)(1.0/t);
-            for(int i=0;i<_n;i++)
-                _data[i]*=tmp;
+            kernelScale(_n,(T)(1.0/t),_data);
             return *this;
         };
         /*!\brief Outer multiplication operator. */
@@ -190,8 +255,7 @@ template <class T> class Bra : public Vector<T> {
         };
         /*!\brief Outer multiplication operator. */
         Bra<T> &operator*=(const T t) {
-            for(int i=0;i<_n;i++)
-                _data[i]*=t;
+            kernelScale(_n,t,_data);
             return *this;
         };
         /*!\brief Outer multiplication operator. */
@@ -213,6 +277,10 @@ template <class T> class Ket : public Vector<T> {
         Ket(int n=0) : Vector<T>(n) {};
         /*!\brief Copy constructor. */
         Ket(const Vector<T> &other) : Vector<T>(other) {};
+        /*!\brief External storage constructor, see Vector. */
+        Ket(int n, T *data) : Vector<T>(n,data) {};
+        /*!\brief Copies the elements of a view. */
+        explicit Ket(const VectorView<T> &other) : Vector<T>(other) {};
         /*!\brief Print method. */
         void print(void) const {
             cerr << *this;
@@ -221,15 +289,13 @@ template <class T> class Ket : public Vector<T> {
         /*!\brief Convert to standard stream operator. */
         friend ostream &operator<<(ostream &os, const Ket<T> &other) {
             for(int i=0;i<other.size();i++)
-                os << other[i] << " ";
+                os << other._data[i] << " ";
             return os;
         };
         /*!\brief Cross product. */
-        Matrix<T> operator*(const Bra<T> &other) {
+        Matrix<T> operator*(const Bra<T> &other) const {
             Matrix<T> tmp(_n,other.size());
-            for(int i=0;i<_n;i++)
-                for(int j=0;j<other.size();j++)
-                    tmp.at(i,j)=_data[i]*other[j];
+            tmp.ger((T)1,*this,other);
             return tmp;
         };
         /*!\brief Transposition method. */
@@ -239,17 +305,8 @@ template <class T> class Ket : public Vector<T> {
         /* Algebraic operators {{{ */
         /*!\brief Assignement operator. */
         Ket<T> &operator=(const Ket<T> &other) {
-            if(this!=&other) {
-                if(_n!=other._n) {
-                    delete[] _data;
-                    _n=other._n;
-                }
-                if(_n!=0) {
-                    _data=new T[_n];
-                    for(int i=0;i<_n;i++)
-                        _data[i]=other._data[i];
-                }
-            }
+            if(this!=&other)
+                this->assign(other);
             return *this;
         };
         /*!\brief Addition operator. */
@@ -262,8 +319,12 @@ template <class T> class Ket : public Vector<T> {
         Ket<T> &operator+=(const Ket<T> &other) {
             if(_n!=other._n)
                 throw outOfBounds;
-            for(int i=0;i<_n;i++)
-                _data[i]+=other._data[i];
+            kernelAdd(_n,other._data,_data);
+            return *this;
+        };
+        /*!\brief Addition operator. */
+        Ket<T> &operator+=(const VectorView<T> &other) {
+            this->view()+=other;
             return *this;
         };
         /*!\brief Substraction operator. */
@@ -276,8 +337,12 @@ template <class T> class Ket : public Vector<T> {
         Ket<T> &operator-=(const Ket<T> &other) {
             if(_n!=other._n)
                 throw outOfBounds;
-            for(int i=0;i<_n;i++)
-                _data[i]-=other._data[i];
+            kernelSub(_n,other._data,_data);
+            return *this;
+        };
+        /*!\brief Substraction operator. */
+        Ket<T> &operator-=(const VectorView<T> &other) {
+            this->view()-=other;
             return *this;
         };
         /*!\brief Outer division operator. */
@@ -288,9 +353,7 @@ template <class T> class Ket : public Vector<T> {
         };
         /*!\brief Outer division operator. */
         Ket<T> &operator/=(const T t) {
-            T tmp=(T)(1.0/t);
-            for(int i=0;i<_n;i++)
-                _data[i]*=tmp;
+            kernelScale(_n,(T)(1.0/t),_data);
             return *this;
         };
         /*!\brief Outer multiplication operator. */
@@ -301,8 +364,7 @@ template <class T> class Ket : public Vector<T> {
         };
         /*!\brief Outer multiplication operator. */
         Ket<T> &operator*=(const T t) {
-            for(int i=0;i<_n;i++)
-                _data[i]*=t;
+            kernelScale(_n,t,_data);
             return *this;
         };
         /*!\brief Outer multiplication operator. */
@@ -0,0 +1,428 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef VIEW_H
+#define VIEW_H
+#include <iostream>
+#include <vector>
+#include <functional>
+#include "myexceptions.h"
+#include "checking.h"
+#include "transpose.h"
+using std::ostream;
+template <class T> class Vector;
+template <class T> class Bra;
+template <class T> class Ket;
+template <class T> class Matrix;
+/*!\brief Strided views.
+ *
+ * VectorView and MatrixView reference elements owned by another container
+ * through a pointer, dimensions and strides: building a view never copies
+ * nor allocates, and writing through a view modifies the container.
+ * Views copy elements on assignment (the sizes must match) and share them
+ * on copy construction, whereas containers, including those built on
+ * external storage, always copy their elements when copy constructed.
+ * Views do not propagate constness: a view on a const container must not
+ * be written to. Assignments between overlapping views, such as
+ * A=A.transposeView(), go through a temporary copy.
+ */
+/* Overlap {{{ */
+/*!\brief Computes the offsets of the first and last elements of an n x m
+ * strided block. */
+inline void viewExtent(int n, int m, long rs, long cs, long &lo, long &hi) {
+    const long r=(long)(n-1)*rs;
+    const long c=(long)(m-1)*cs;
+    lo=(r<0?r:0)+(c<0?c:0);
+    hi=(r>0?r:0)+(c>0?c:0);
+};
+/*!\brief Returns true if the ranges [a+alo,a+ahi] and [b+blo,b+bhi]
+ * intersect. */
+template <class T> bool rangesOverlap(const T *a, long alo, long ahi,
+        const T *b, long blo, long bhi) {
+    std::less<const T *> less;
+    return !less(a+ahi,b+blo) && !less(b+bhi,a+alo);
+};
+/* }}} */
+/* VectorView {{{ */
+/*!\brief This class implements a strided view of a vector. */
+template <class T> class VectorView {
+    public:
+        /* Constructors {{{ */
+        /*!\brief Default constructor. */
+        VectorView(T *data, int n, int stride=1) {
+            _data=data;
+            _n=n;
+            _stride=stride;
+        };
+        /*!\brief Contiguous view of a vector. */
+        VectorView(const Vector<T> &other) {
+            _data=const_cast<T *>(other.data());
+            _n=other.size();
+            _stride=1;
+        };
+        /*!\brief Copy constructor, the elements are shared. */
+        VectorView(const VectorView<T> &other) {
+            _data=other._data;
+            _n=other._n;
+            _stride=other._stride;
+        };
+        /* }}} */
+        /* Access member methods {{{ */
+        /*!\brief Returns the vector size. */
+        int size(void) const { return _n; };
+        /*!\brief Returns the distance between two elements. */
+        int stride(void) const { return _stride; };
+        /*!\brief Returns a pointer to the first element. */
+        T *data(void) const { return _data; };
+        /*!\brief Access member method. */
+        T &operator[](int i) { return get<Checked>(i); };
+        /*!\brief Access member method. */
+        T operator[](int i) const { return get<Checked>(i); };
+        /*!\brief Access member method, with checking policy P. */
+        template <class P> T &get(int i) const {
+            P::check(i>=0 && i<_n);
+            return _data[(long)i*_stride];
+        };
+        /*!\brief Returns a sub-vector of n elements starting at i. */
+        VectorView<T> segment(int i, int n) const {
+            if(i<0 || n<0 || i+n>_n)
+                throw outOfBounds;
+            return VectorView<T>(_data+(long)i*_stride,n,_stride);
+        };
+        /*!\brief Returns a copy as a Bra. */
+        Bra<T> bra(void) const {
+            Bra<T> tmp(_n);
+            copy(tmp.data(),1);
+            return tmp;
+        };
+        /*!\brief Returns a copy as a Ket. */
+        Ket<T> ket(void) const {
+            Ket<T> tmp(_n);
+            copy(tmp.data(),1);
+            return tmp;
+        };
+        /*!\brief Friend standard output operator. */
+        friend ostream &operator<<(ostream &os, const VectorView<T> &other) {
+            for(int i=0;i<other._n;i++)
+                os << other._data[(long)i*other._stride] << " ";
+            return os;
+        };
+        /* }}} */
+        /* Algebraic operators {{{ */
+        /*!\brief Assignement operator, copies the elements. */
+        VectorView<T> &operator=(const VectorView<T> &other) {
+            if(_n!=other._n)
+                throw incompatibleSizes;
+            if(other._data==_data && other._stride==_stride)
+                return *this;
+            if(overlaps(other)) {
+                vector<T> tmp(_n);
+                other.copy(tmp.data(),1);
+                for(int i=0;i<_n;i++)
+                    _data[(long)i*_stride]=tmp[i];
+                return *this;
+            }
+            other.copy(_data,_stride);
+            return *this;
+        };
+        /*!\brief Addition operator. */
+        VectorView<T> &operator+=(const VectorView<T> &other) {
+            if(_n!=other._n)
+                throw incompatibleSizes;
+            if(overlaps(other) && (other._data!=_data
+                        || other._stride!=_stride)) {
+                vector<T> tmp(_n);
+                other.copy(tmp.data(),1);
+                return (*this)+=VectorView<T>(tmp.data(),_n);
+            }
+            for(int i=0;i<_n;i++)
+                _data[(long)i*_stride]+=other._data[(long)i*other._stride];
+            return *this;
+        };
+        /*!\brief Substraction operator. */
+        VectorView<T> &operator-=(const VectorView<T> &other) {
+            if(_n!=other._n)
+                throw incompatibleSizes;
+            if(overlaps(other) && (other._data!=_data
+                        || other._stride!=_stride)) {
+                vector<T> tmp(_n);
+                other.copy(tmp.data(),1);
+                return (*this)-=VectorView<T>(tmp.data(),_n);
+            }
+            for(int i=0;i<_n;i++)
+                _data[(long)i*_stride]-=other._data[(long)i*other._stride];
+            return *this;
+        };
+        /*!\brief Outer multiplication operator. */
+        VectorView<T> &operator*=(const T t) {
+            for(int i=0;i<_n;i++)
+                _data[(long)i*_stride]*=t;
+            return *this;
+        };
+        /*!\brief Outer division operator. */
+        VectorView<T> &operator/=(const T t) {
+            return (*this)*=((T)1)/t;
+        };
+        /*!\brief Adds t*x, in place. */
+        VectorView<T> &axpy(const T t, const VectorView<T> &x) {
+            if(_n!=x._n)
+                throw incompatibleSizes;
+            for(int i=0;i<_n;i++)
+                _data[(long)i*_stride]+=t*x._data[(long)i*x._stride];
+            return *this;
+        };
+        /* }}} */
+    private:
+        /*!\brief Returns true if other may share elements with this view. */
+        bool overlaps(const VectorView<T> &other) const {
+            if(_n==0)
+                return false;
+            long alo,ahi,blo,bhi;
+            viewExtent(_n,1,_stride,0,alo,ahi);
+            viewExtent(other._n,1,other._stride,0,blo,bhi);
+            return rangesOverlap(_data,alo,ahi,other._data,blo,bhi);
+        };
+        /*!\brief Copies the elements to dst, with stride s. */
+        void copy(T *dst, int s) const {
+            for(int i=0;i<_n;i++)
+                dst[(long)i*s]=_data[(long)i*_stride];
+        };
+        T *_data;       //!<\brief First element.
+        int _n;         //!<\brief Number of elements.
+        int _stride;    //!<\brief Distance between two elements.
+};
+/*!\brief Scalar product of two views. */
+template <class T> T dot(const VectorView<T> &a, const VectorView<T> &b) {
+    if(a.size()!=b.size())
+        throw incompatibleSizes;
+    const T *u=a.data();
+    const T *v=b.data();
+    const long su=a.stride(),sv=b.stride();
+    T res=0;
+    for(int i=0;i<a.size();i++)
+        res+=u[i*su]*v[i*sv];
+    return res;
+};
+/* }}} */
+/* MatrixView {{{ */
+/*!\brief This class implements a strided view of a matrix.
+ *
+ * Element (i,j) is data()[i*rowStride()+j*colStride()], so that
+ * transposition swaps the strides and never moves data.
+ */
+template <class T> class MatrixView {
+    public:
+        /* Constructors {{{ */
+        /*!\brief Default constructor. */
+        MatrixView(T *data, int n, int m, int rs, int cs=1) {
+            _data=data;
+            _n=n;
+            _m=m;
+            _rs=rs;
+            _cs=cs;
+        };
+        /*!\brief View of a whole matrix. */
+        MatrixView(const Matrix<T> &other) {
+            _data=const_cast<T *>(other.data());
+            _n=other.n();
+            _m=other.m();
+            _rs=_m;
+            _cs=1;
+        };
+        /*!\brief Copy constructor, the elements are shared. */
+        MatrixView(const MatrixView<T> &other) {
+            _data=other._data;
+            _n=other._n;
+            _m=other._m;
+            _rs=other._rs;
+            _cs=other._cs;
+        };
+        /* }}} */
+        /* Access member methods {{{ */
+        /*!\brief Returns the number of rows. */
+        int n(void) const { return _n; };
+        /*!\brief Returns the number of columns. */
+        int m(void) const { return _m; };
+        /*!\brief Returns the distance between two rows. */
+        int rowStride(void) const { return _rs; };
+        /*!\brief Returns the distance between two columns. */
+        int colStride(void) const { return _cs; };
+        /*!\brief Returns a pointer to element (0,0). */
+        T *data(void) const { return _data; };
+        /*!\brief Access member method. */
+        T &at(int i, int j) { return get<Checked>(i,j); };
+        /*!\brief Access member method. */
+        T at(int i, int j) const { return get<Checked>(i,j); };
+        /*!\brief Access member method, with checking policy P. */
+        template <class P> T &get(int i, int j) const {
+            P::check(i>=0 && i<_n && j>=0 && j<_m);
+            return _data[(long)i*_rs+(long)j*_cs];
+        };
+        /*!\brief Unchecked access member method. */
+        T &operator()(int i, int j) const {
+            return _data[(long)i*_rs+(long)j*_cs];
+        };
+        /*!\brief Returns a view of row i. */
+        VectorView<T> row(int i) const {
+            if(i<0 || i>=_n)
+                throw outOfBounds;
+            return VectorView<T>(_data+(long)i*_rs,_m,_cs);
+        };
+        /*!\brief Returns a view of column j. */
+        VectorView<T> col(int j) const {
+            if(j<0 || j>=_m)
+                throw outOfBounds;
+            return VectorView<T>(_data+(long)j*_cs,_n,_rs);
+        };
+        /*!\brief Returns a view of the diagonal. */
+        VectorView<T> diag(void) const {
+            return VectorView<T>(_data,(_n<_m?_n:_m),_rs+_cs);
+        };
+        /*!\brief Returns a view of the n x m block starting at (i,j). */
+        MatrixView<T> block(int i, int j, int n, int m) const {
+            if(i<0 || j<0 || n<0 || m<0 || i+n>_n || j+m>_m)
+                throw outOfBounds;
+            return MatrixView<T>(_data+(long)i*_rs+(long)j*_cs,n,m,_rs,_cs);
+        };
+        /*!\brief Returns a view of the transposed matrix. */
+        MatrixView<T> transpose(void) const {
+            return MatrixView<T>(_data,_m,_n,_cs,_rs);
+        };
+        /*!\brief Returns a copy as a Matrix. */
+        Matrix<T> matrix(void) const {
+            return Matrix<T>(*this);
+        };
+        /*!\brief Friend standard output operator. */
+        friend ostream &operator<<(ostream &os, const MatrixView<T> &other) {
+            for(int i=0;i<other._n;i++)
+                for(int j=0;j<other._m;j++)
+                    os << other(i,j) << " ";
+            return os;
+        };
+        /* }}} */
+        /* Algebraic operators {{{ */
+        /*!\brief Assignement operator, copies the elements. */
+        MatrixView<T> &operator=(const MatrixView<T> &other) {
+            if(_n!=other._n || _m!=other._m)
+                throw incompatibleSizes;
+            if(same(other))
+                return *this;
+            if(overlaps(other)) {
+                if(_n==_m && other._data==_data && other._rs==_cs
+                        && other._cs==_rs && (_rs==1 || _cs==1)) {
+                    //Transpose of itself.
+                    transposeSquare(_data,(_cs==1?_rs:_cs),_n);
+                    return *this;
+                }
+                Matrix<T> tmp(other);
+                return (*this)=tmp.view();
+            }
+            if(_cs==1 && other._rs==1 && other._cs!=1) {
+                //Copy of a transposed view.
+                transposeCopy(other._data,other._cs,_data,_rs,_m,_n);
+                return *this;
+            }
+            for(int i=0;i<_n;i++)
+                for(int j=0;j<_m;j++)
+                    (*this)(i,j)=other(i,j);
+            return *this;
+        };
+        /*!\brief Addition operator. */
+        MatrixView<T> &operator+=(const MatrixView<T> &other) {
+            if(_n!=other._n || _m!=other._m)
+                throw incompatibleSizes;
+            if(!same(other) && overlaps(other)) {
+                Matrix<T> tmp(other);
+                return (*this)+=tmp.view();
+            }
+            for(int i=0;i<_n;i++)
+                for(int j=0;j<_m;j++)
+                    (*this)(i,j)+=other(i,j);
+            return *this;
+        };
+        /*!\brief Substraction operator. */
+        MatrixView<T> &operator-=(const MatrixView<T> &other) {
+            if(_n!=other._n || _m!=other._m)
+                throw incompatibleSizes;
+            if(!same(other) && overlaps(other)) {
+                Matrix<T> tmp(other);
+                return (*this)-=tmp.view();
+            }
+            for(int i=0;i<_n;i++)
+                for(int j=0;j<_m;j++)
+                    (*this)(i,j)-=other(i,j);
+            return *this;
+        };
+        /*!\brief Outer product. */
+        MatrixView<T> &operator*=(const T t) {
+            for(int i=0;i<_n;i++)
+                for(int j=0;j<_m;j++)
+                    (*this)(i,j)*=t;
+            return *this;
+        };
+        /*!\brief Outer division. */
+        MatrixView<T> &operator/=(const T t) {
+            return (*this)*=((T)1)/t;
+        };
+        /*!\brief Inner product operator. */
+        friend Matrix<T> operator*(const MatrixView<T> &a,
+                const MatrixView<T> &b) {
+            if(a._m!=b._n)
+                throw incompatibleSizes;
+            Matrix<T> tmp(a._n,b._m);
+            T *c=tmp.data();
+            for(int i=0;i<a._n;i++)
+                for(int k=0;k<a._m;k++) {
+                    const T aik=a(i,k);
+                    for(int j=0;j<b._m;j++)
+                        c[i*b._m+j]+=aik*b(k,j);
+                }
+            return tmp;
+        };
+        /*!\brief Ket reduction. */
+        friend Ket<T> operator*(const MatrixView<T> &a,
+                const VectorView<T> &k) {
+            if(a._m!=k.size())
+                throw incompatibleSizes;
+            Ket<T> tmp(a._n);
+            T *c=tmp.data();
+            for(int i=0;i<a._n;i++)
+                c[i]=dot(a.row(i),k);
+            return tmp;
+        };
+        /*!\brief Bra reduction. */
+        friend Bra<T> operator*(const VectorView<T> &b,
+                const MatrixView<T> &a) {
+            if(a._n!=b.size())
+                throw incompatibleSizes;
+            Bra<T> tmp(a._m);
+            T *c=tmp.data();
+            for(int i=0;i<a._n;i++) {
+                const T bi=b.template get<Unchecked>(i);
+                for(int j=0;j<a._m;j++)
+                    c[j]+=bi*a(i,j);
+            }
+            return tmp;
+        };
+        /* }}} */
+    private:
+        /*!\brief Returns true if other references the same elements. */
+        bool same(const MatrixView<T> &other) const {
+            return other._data==_data && other._rs==_rs && other._cs==_cs;
+        };
+        /*!\brief Returns true if other may share elements with this view. */
+        bool overlaps(const MatrixView<T> &other) const {
+            if(_n==0 || _m==0)
+                return false;
+            long alo,ahi,blo,bhi;
+            viewExtent(_n,_m,_rs,_cs,alo,ahi);
+            viewExtent(other._n,other._m,other._rs,other._cs,blo,bhi);
+            return rangesOverlap(_data,alo,ahi,other._data,blo,bhi);
+        };
+        T *_data;   //!<\brief Element (0,0).
+        int _n;     //!<\brief Number of rows.
+        int _m;     //!<\brief Number of columns.
+        int _rs;    //!<\brief Distance between two rows.
+        int _cs;    //!<\brief Distance between two columns.
+};
+/* }}} */
+#endif //VIEW_H
+/* view.h */
@@ -16,14 +16,98 @@
  *
  * }}} */
 #include <iostream>
+#include <cstdlib>
+#include <cmath>
 #include <common.h>
+#include <sweep.h>
+#include <matrix.h>
 using namespace std;
+/*!\brief Runs a small sweep and checks its results, returns the number of
+ * failed checks. */
+static int checkSweep(void) {
+    int failures=0;
+    vector<range<double> > axes(2);
+    axes[0].min=0;
+    axes[0].max=1;
+    axes[0].incr=0.25;
+    axes[1].min=0;
+    axes[1].max=2;
+    axes[1].incr=1;
+    Sweep s(axes,2);
+    if(rangeSize(axes[0])!=5 || s.size()!=15 || s.results()!=2) {
+        cerr << "[E] Check failed : sweep grid size" << endl;
+        failures++;
+    }
+    bool ok=s.run([](const double *x, double *y) {
+            y[0]=x[0]+x[1];
+            y[1]=x[0]*x[1];
+            },3,2);
+    double x[2];
+    for(long i=0;i<s.size();i++) {
+        s.point(i,x);
+        ok=ok && s.done(i) && s.at(i,0)==x[0]+x[1] && s.at(i,1)==x[0]*x[1];
+    }
+    if(!ok || s.done()!=s.size()) {
+        cerr << "[E] Check failed : sweep results" << endl;
+        failures++;
+    }
+    //A crashing point loses its chunk only.
+    ok=!s.run([](const double *x, double *y) {
+            if(x[0]==0.5 && x[1]==1)
+                abort();
+            y[0]=y[1]=0;
+            },2,1);
+    long lost=0;
+    for(long i=0;i<s.size();i++)
+        lost+=(s.done(i)?0:1);
+    s.point(7,x);
+    if(!ok || lost!=1 || s.done(7) || x[0]!=0.5 || x[1]!=1
+            || !std::isnan(s.at(7,0))) {
+        cerr << "[E] Check failed : sweep worker crash" << endl;
+        failures++;
+    }
+    return failures;
+}
+/*!\brief Runs a sweep calling parallel matrix kernels after the parent
+ * used them, returns the number of failed checks. */
+static int checkFork(void) {
+    //Large matrices go through the MathExpressions thread pool, whose
+    //workers are not copied in the sweep processes.
+    setenv("MATHEXPR_THREADS","4",0);
+    Matrix<double> a(256,256);
+    a.at(1,2)=1;
+    Matrix<double> b=a+a;
+    vector<range<double> > axes(1);
+    axes[0].min=0;
+    axes[0].max=3;
+    axes[0].incr=1;
+    Sweep s(axes,1);
+    bool ok=s.run([](const double *x, double *y) {
+            Matrix<double> a(256,256);
+            a.at(1,2)=x[0];
+            Matrix<double> b=a+a;
+            y[0]=b.at(1,2);
+            },2,1);
+    for(long i=0;ok && i<s.size();i++)
+        ok=(s.done(i) && s.at(i,0)==2*i);
+    if(!ok || b.at(1,2)!=2) {
+        cerr << "[E] Check failed : sweep after parallel kernels" << endl;
+        return 1;
+    }
+    return 0;
+}
 int main(int argc, char *argv[]) {
     ConfigMap config;
     if(!parseOptions(argc,argv,config)) {        //Parse cmd line options
         cerr << "==> Try '" << argv[0] << " --usage'" << endl;
         return -1;
     }
+    if(config.count("check")>0) {
+        int failures=checkSweep()+checkFork();
+        if(failures==0)
+            cerr << "[I] All checks passed" << endl;
+        return (failures>0?-1:0);
+    }
     if(config["usage"].size()>0||config["help"].size()>0) {
         printUsage(argv[0]);
         return -1;
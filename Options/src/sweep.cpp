@@ -0,0 +1,181 @@
+/* This file is a part of Options. {{{
+ * Copyright (C) 2012 Romain Dubessy
+ *
+ * Options is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Options is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Options.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * }}} */
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <iostream>
+#include <new>
+#include "sweep.h"
+long rangeSize(const range<double> &r) {
+    if(r.incr==0)
+        return 1;
+    double steps=(r.max-r.min)/r.incr;
+    if(!(steps>=0))                             //Empty range or NaN
+        return 1;
+    //Tolerate rounding errors on the last point.
+    return (long)floor(steps*(1+1e-12)+1e-9)+1;
+}
+Sweep::Sweep(const std::vector<range<double> > &axes, int nout) {
+    _axes=axes;
+    _nout=nout;
+    _size=1;
+    for(unsigned int i=0;i<_axes.size();i++) {
+        _sizes.push_back(rangeSize(_axes[i]));
+        _size*=_sizes[i];
+    }
+    size_t header=(sizeof(SweepCounters)+63)/64*64;
+    _length=header+_size*_nout*sizeof(double)+_size;
+    //The name is removed as soon as the memory is mapped, the mapping is
+    //then only shared with the forked workers.
+    char name[64];
+    static std::atomic<int> count(0);
+    snprintf(name,64,"/options-sweep-%d-%d",(int)getpid(),count++);
+    int fd=shm_open(name,O_RDWR|O_CREAT|O_EXCL,0600);
+    if(fd<0) {
+        std::cerr << "[E] Cannot create shared memory '" << name << "' : "
+            << strerror(errno) << " !" << std::endl;
+        throw std::bad_alloc();
+    }
+    shm_unlink(name);
+    if(ftruncate(fd,_length)!=0) {
+        close(fd);
+        std::cerr << "[E] Cannot allocate " << _length
+            << " bytes of shared memory !" << std::endl;
+        throw std::bad_alloc();
+    }
+    _map=mmap(0,_length,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    close(fd);
+    if(_map==MAP_FAILED) {
+        std::cerr << "[E] Cannot map " << _length
+            << " bytes of shared memory !" << std::endl;
+        throw std::bad_alloc();
+    }
+    _counters=new(_map) SweepCounters;
+    _counters->next=0;
+    _counters->done=0;
+    _data=(double*)((char*)_map+header);
+    _status=(unsigned char*)(_data+_size*_nout);
+}
+Sweep::~Sweep() {
+    _counters->~SweepCounters();
+    munmap(_map,_length);
+}
+void Sweep::point(long index, double *x) const {
+    for(int i=_axes.size()-1;i>=0;i--) {
+        x[i]=_axes[i].min+(index%_sizes[i])*_axes[i].incr;
+        index/=_sizes[i];
+    }
+}
+bool Sweep::run(const SweepFunction &f, int nproc, long chunk,
+        const SweepProgress &progress, double interval) {
+    if(nproc<=0)
+        nproc=sysconf(_SC_NPROCESSORS_ONLN);
+    if(nproc<=0)
+        nproc=1;
+    if(chunk<=0)
+        chunk=_size/(16*nproc);
+    if(chunk<=0)
+        chunk=1;
+    for(long i=0;i<_size*_nout;i++)
+        _data[i]=NAN;
+    memset(_status,0,_size);
+    _counters->next=0;
+    _counters->done=0;
+    //Buffered output would be written again by each worker.
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(0);
+    std::vector<pid_t> workers;
+    bool res=true;
+    for(int p=0;p<nproc;p++) {
+        pid_t pid=fork();
+        if(pid==0) {
+            work(f,chunk);
+            _exit(0);
+        }
+        if(pid<0) {
+            std::cerr << "[E] Cannot fork worker " << p << " : "
+                << strerror(errno) << " !" << std::endl;
+            res=false;
+            break;
+        }
+        workers.push_back(pid);
+    }
+    //Wait for the workers, reporting progress in between.
+    struct timespec pause;
+    pause.tv_sec=(time_t)interval;
+    pause.tv_nsec=(long)((interval-pause.tv_sec)*1e9);
+    unsigned int running=workers.size();
+    while(running>0) {
+        if(progress) {
+            progress(_counters->done,_size);
+            nanosleep(&pause,0);
+        }
+        for(unsigned int p=0;p<workers.size();p++) {
+            if(workers[p]==0)
+                continue;
+            int status;
+            pid_t pid=waitpid(workers[p],&status,progress?WNOHANG:0);
+            if(pid==0)
+                continue;
+            if(pid<0 || !WIFEXITED(status) || WEXITSTATUS(status)!=0) {
+                if(pid>0 && WIFSIGNALED(status))
+                    std::cerr << "[E] Worker " << p << " killed by signal "
+                        << WTERMSIG(status) << " !" << std::endl;
+                else
+                    std::cerr << "[E] Worker " << p << " failed !"
+                        << std::endl;
+                res=false;
+            }
+            workers[p]=0;
+            running--;
+        }
+    }
+    if(progress)
+        progress(_counters->done,_size);
+    return res && _counters->done==_size;
+}
+void Sweep::work(const SweepFunction &f, long chunk) {
+    std::vector<double> x(_axes.size());
+    for(;;) {
+        long i0=_counters->next.fetch_add(chunk);
+        if(i0>=_size)
+            return;
+        long i1=(i0+chunk<_size?i0+chunk:_size);
+        for(long i=i0;i<i1;i++) {
+            point(i,x.data());
+            try {
+                f(x.data(),_data+i*_nout);
+            } catch(std::exception &e) {
+                std::cerr << "[E] Sweep point " << i << " : " << e.what()
+                    << std::endl;
+                _exit(1);
+            }
+            _status[i]=1;
+            _counters->done++;
+        }
+    }
+}
+/* sweep.cpp */
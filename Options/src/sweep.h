@@ -0,0 +1,87 @@
+/* Copyright (C) 2012 Romain Dubessy */
+#ifndef SWEEP_H
+#define SWEEP_H
+#include <string>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include "common.h"
+/*! \brief Function evaluated at each point of a sweep, it receives the
+ * coordinates of the point and writes its results. */
+typedef std::function<void(const double *,double *)> SweepFunction;
+/*! \brief Function called by the parent process while a sweep runs, with
+ * the number of points done and the total number of points. */
+typedef std::function<void(long,long)> SweepProgress;
+/*! \brief This method returns the number of points of a range, min and max
+ * included. */
+long rangeSize(const range<double> &);
+/*! \brief Shared counter block of a sweep, each counter on its own cache
+ * line. */
+struct SweepCounters {
+    std::atomic<long> next;     //!<\brief First point of the next chunk.
+    char pad0[64-sizeof(std::atomic<long>)];
+    std::atomic<long> done;     //!<\brief Number of points done.
+    char pad1[64-sizeof(std::atomic<long>)];
+};
+/*! \brief This class runs a sweep over a grid of points in several
+ * processes.
+ *
+ * The grid is the cartesian product of the axes, the last axis running
+ * fastest. Worker processes are forked and claim chunks of consecutive
+ * points from a shared counter. They write the results of each point
+ * directly into an array in shared memory (shm_open/mmap) and count the
+ * points done in the shared counter block, so that nothing is serialized.
+ * A crashing worker only loses the points of its current chunk: they are
+ * left to NaN and run() returns false.
+ * The workers are forked from the calling thread only: f must not rely on
+ * threads started before run(), such as a thread pool.
+ */
+class Sweep {
+    public:
+        /*! \brief Constructor, for nout results per point. */
+        Sweep(const std::vector<range<double> > &axes, int nout);
+        /*! \brief Destructor, releases the shared memory. */
+        ~Sweep();
+        /*! \brief Returns the number of axes. */
+        int axes() const { return _axes.size(); }
+        /*! \brief Returns the number of points. */
+        long size() const { return _size; }
+        /*! \brief Returns the number of results per point. */
+        int results() const { return _nout; }
+        /*! \brief Writes the coordinates of a point in x. */
+        void point(long index, double *x) const;
+        /*! \brief Runs f over the grid in nproc processes.
+         *
+         * If nproc<=0, one process per online cpu is used. The chunk size
+         * is chosen from the number of points if chunk<=0. progress is
+         * called about every interval seconds until all the workers are
+         * done. Returns false if a worker failed.
+         */
+        bool run(const SweepFunction &f, int nproc=0, long chunk=0,
+                const SweepProgress &progress=SweepProgress(),
+                double interval=1.);
+        /*! \brief Returns the results, nout per point in the grid order. */
+        const double *data() const { return _data; }
+        /*! \brief Returns result k of a point. */
+        double at(long index, int k) const { return _data[index*_nout+k]; }
+        /*! \brief Returns true if the point was computed by the last run. */
+        bool done(long index) const { return _status[index]!=0; }
+        /*! \brief Returns the number of points computed by the last run. */
+        long done() const { return _counters->done; }
+    private:
+        Sweep(const Sweep &);
+        Sweep &operator=(const Sweep &);
+        /*! \brief Worker process main loop. */
+        void work(const SweepFunction &f, long chunk);
+        std::vector<range<double> > _axes;  //!<\brief Axes of the grid.
+        std::vector<long> _sizes;           //!<\brief Points per axis.
+        long _size;                         //!<\brief Number of points.
+        int _nout;                          //!<\brief Results per point.
+        void *_map;                         //!<\brief Shared mapping.
+        size_t _length;                     //!<\brief Mapping length.
+        SweepCounters *_counters;           //!<\brief Shared counters.
+        double *_data;                      //!<\brief Shared results.
+        unsigned char *_status;             //!<\brief Shared point status.
+};
+#endif
+/* sweep.h */